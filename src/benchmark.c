@@ -0,0 +1,404 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <clutter-gst/clutter-gst.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include "benchmark.h"
+#include "utils.h"
+
+/* Files are played through playbin, as snappy plays them, but with sinks
+ * that don't wait for the clock, so decoding runs as fast as the machine
+ * allows. The time between two frames reaching the video sink is what it
+ * took to decode (and, with the Clutter sink, upload) the second one.
+ * Nothing is ever late against a clock that isn't waited on, so instead
+ * of dropped frames the intervals longer than a frame's duration are
+ * counted: the frames that couldn't have kept up in real time. */
+
+typedef struct
+{
+  GMainLoop *loop;
+  GstElement *sink;
+
+  GMutex lock;
+  GArray *arrivals;
+  GError *error;
+} Benchmark;
+
+typedef struct
+{
+  guint frames, slow;
+  gdouble wall, user, system;
+  gdouble framerate;
+  gdouble p50, p90, p99, max;
+  glong peak_rss;
+} BenchmarkResult;
+
+// Declaration of static functions
+static gboolean bus_cb (GstBus * bus, GstMessage * msg, Benchmark * bench);
+static gint compare_int64 (const gint64 * a, const gint64 * b);
+static void handoff_cb (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    Benchmark * bench);
+static void new_frame_cb (ClutterGstVideoSink * sink, Benchmark * bench);
+static glong peak_rss (void);
+static gdouble percentile (GArray * sorted, gdouble fraction);
+static void print_result (const gchar * uri, BenchmarkResult * result,
+    gboolean json);
+static void record_frame (Benchmark * bench);
+static void reset_peak_rss (void);
+static gboolean run_benchmark (const gchar * uri, gboolean clutter_sink,
+    BenchmarkResult * result, GError ** error);
+static gdouble timeval_seconds (struct timeval *tv);
+
+/* ---------------------- static functions ----------------------- */
+
+static gboolean
+bus_cb (GstBus * bus, GstMessage * msg, Benchmark * bench)
+{
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_EOS:
+      g_main_loop_quit (bench->loop);
+      break;
+
+    case GST_MESSAGE_ERROR:
+      g_clear_error (&bench->error);
+      gst_message_parse_error (msg, &bench->error, NULL);
+      g_main_loop_quit (bench->loop);
+      break;
+
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+static gint
+compare_int64 (const gint64 * a, const gint64 * b)
+{
+  return (*a > *b) - (*a < *b);
+}
+
+static void
+handoff_cb (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    Benchmark * bench)
+{
+  record_frame (bench);
+}
+
+static void
+new_frame_cb (ClutterGstVideoSink * sink, Benchmark * bench)
+{
+  record_frame (bench);
+}
+
+// Most resident since reset_peak_rss, in kB, or -1 without /proc
+static glong
+peak_rss (void)
+{
+  glong kb = -1;
+  gchar *status, **lines;
+  gint i;
+
+  if (!g_file_get_contents ("/proc/self/status", &status, NULL, NULL))
+    return -1;
+
+  lines = g_strsplit (status, "\n", -1);
+  for (i = 0; lines[i] != NULL; i++) {
+    if (sscanf (lines[i], "VmHWM: %ld kB", &kb) == 1)
+      break;
+  }
+  g_strfreev (lines);
+  g_free (status);
+
+  return kb;
+}
+
+static gdouble
+percentile (GArray * sorted, gdouble fraction)
+{
+  guint index;
+
+  if (sorted->len == 0)
+    return 0;
+
+  index = (guint) ((sorted->len - 1) * fraction + 0.5);
+
+  return g_array_index (sorted, gint64, index) / 1000.0;
+}
+
+static void
+print_result (const gchar * uri, BenchmarkResult * result, gboolean json)
+{
+  GString *out;
+  gdouble fps, cpu;
+
+  fps = result->wall > 0 ? result->frames / result->wall : 0;
+  cpu = result->user + result->system;
+
+  out = g_string_new (NULL);
+  if (json) {
+    g_string_append (out, "{\"uri\":");
+    append_json_string (out, uri);
+    g_string_append_printf (out, ",\"frames\":%u", result->frames);
+    append_json_double (out, "seconds", result->wall);
+    append_json_double (out, "fps", fps);
+    append_json_double (out, "frame_ms_p50", result->p50);
+    append_json_double (out, "frame_ms_p90", result->p90);
+    append_json_double (out, "frame_ms_p99", result->p99);
+    append_json_double (out, "frame_ms_max", result->max);
+    append_json_double (out, "cpu_user", result->user);
+    append_json_double (out, "cpu_system", result->system);
+    if (result->peak_rss >= 0)
+      g_string_append_printf (out, ",\"peak_rss_kb\":%ld", result->peak_rss);
+    if (result->framerate > 0) {
+      append_json_double (out, "framerate", result->framerate);
+      g_string_append_printf (out, ",\"over_frame_duration\":%u",
+          result->slow);
+    }
+    g_string_append (out, "}\n");
+  } else {
+    g_string_append_printf (out, "%s\n", uri);
+    g_string_append_printf (out, "  Frames: %u in %.2f s, %.1f fps\n",
+        result->frames, result->wall, fps);
+    g_string_append_printf (out, "  Time per frame: p50 %.2f ms, "
+        "p90 %.2f ms, p99 %.2f ms, max %.2f ms\n", result->p50, result->p90,
+        result->p99, result->max);
+    g_string_append_printf (out, "  CPU time: %.2f s (user %.2f s, "
+        "system %.2f s), %.0f%% of one core\n", cpu, result->user,
+        result->system, result->wall > 0 ? 100 * cpu / result->wall : 0);
+    if (result->peak_rss >= 0)
+      g_string_append_printf (out, "  Peak RSS: %ld kB\n", result->peak_rss);
+    if (result->framerate > 0)
+      g_string_append_printf (out, "  Intervals over the frame duration "
+          "(%.2f ms at %.3f fps): %u\n", 1000 / result->framerate,
+          result->framerate, result->slow);
+  }
+
+  g_print ("%s", out->str);
+  g_string_free (out, TRUE);
+}
+
+static void
+record_frame (Benchmark * bench)
+{
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&bench->lock);
+  g_array_append_val (bench->arrivals, now);
+  g_mutex_unlock (&bench->lock);
+}
+
+// Bring the high-water mark down to what is resident now, so the peak is
+// this file's and not the biggest one before it. Kernels older than 4.0
+// can't, and the peak is then the whole process's
+static void
+reset_peak_rss (void)
+{
+  FILE *clear_refs;
+
+  clear_refs = fopen ("/proc/self/clear_refs", "w");
+  if (clear_refs == NULL)
+    return;
+  fputs ("5", clear_refs);
+  fclose (clear_refs);
+}
+
+static gboolean
+run_benchmark (const gchar * uri, gboolean clutter_sink,
+    BenchmarkResult * result, GError ** error)
+{
+  Benchmark bench = { NULL, };
+  GstElement *player, *audio_sink;
+  GstStateChangeReturn state;
+  GstBus *bus;
+  GstPad *pad;
+  GstCaps *caps;
+  GArray *intervals;
+  struct rusage before, after;
+  gint64 start, interval, frame_duration = 0;
+  gint num, denom;
+  guint watch_id, i;
+
+  player = gst_element_factory_make ("playbin", NULL);
+  audio_sink = gst_element_factory_make ("fakesink", NULL);
+  if (clutter_sink) {
+    bench.sink = GST_ELEMENT (clutter_gst_video_sink_new ());
+    g_signal_connect (bench.sink, "new-frame", G_CALLBACK (new_frame_cb),
+        &bench);
+  } else {
+    bench.sink = gst_element_factory_make ("fakesink", NULL);
+    if (bench.sink != NULL) {
+      g_object_set (bench.sink, "signal-handoffs", TRUE, NULL);
+      g_signal_connect (bench.sink, "handoff", G_CALLBACK (handoff_cb),
+          &bench);
+    }
+  }
+
+  if (player == NULL || audio_sink == NULL || bench.sink == NULL) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+        "Missing elements to benchmark with");
+    if (player != NULL)
+      gst_object_unref (player);
+    if (audio_sink != NULL)
+      gst_object_unref (audio_sink);
+    if (bench.sink != NULL)
+      gst_object_unref (bench.sink);
+    return FALSE;
+  }
+
+  // Audio is decoded too, as it would be while playing
+  g_object_set (bench.sink, "sync", FALSE, NULL);
+  g_object_set (audio_sink, "sync", FALSE, NULL);
+  g_object_set (player, "uri", uri, "video-sink", bench.sink,
+      "audio-sink", audio_sink, NULL);
+
+  bench.loop = g_main_loop_new (NULL, FALSE);
+  bench.arrivals = g_array_new (FALSE, FALSE, sizeof (gint64));
+  g_mutex_init (&bench.lock);
+
+  bus = gst_element_get_bus (player);
+  watch_id = gst_bus_add_watch (bus, (GstBusFunc) bus_cb, &bench);
+  gst_object_unref (bus);
+
+  reset_peak_rss ();
+  getrusage (RUSAGE_SELF, &before);
+  start = g_get_monotonic_time ();
+
+  state = gst_element_set_state (player, GST_STATE_PLAYING);
+  if (state != GST_STATE_CHANGE_FAILURE)
+    g_main_loop_run (bench.loop);
+
+  result->wall = (gdouble) (g_get_monotonic_time () - start) /
+      G_TIME_SPAN_SECOND;
+  getrusage (RUSAGE_SELF, &after);
+  result->peak_rss = peak_rss ();
+
+  // Frames that took longer to decode than they are shown for, which
+  // couldn't have been on time if the sink waited on the clock
+  pad = gst_element_get_static_pad (bench.sink, "sink");
+  caps = gst_pad_get_current_caps (pad);
+  result->framerate = 0;
+  if (caps != NULL) {
+    if (gst_structure_get_fraction (gst_caps_get_structure (caps, 0),
+            "framerate", &num, &denom) && num > 0 && denom > 0) {
+      result->framerate = (gdouble) num / denom;
+      frame_duration = gst_util_uint64_scale_int (G_TIME_SPAN_SECOND, denom,
+          num);
+    }
+    gst_caps_unref (caps);
+  }
+  gst_object_unref (pad);
+
+  gst_element_set_state (player, GST_STATE_NULL);
+  g_source_remove (watch_id);
+
+  // The first frame also waited for the pipeline to start
+  intervals = g_array_new (FALSE, FALSE, sizeof (gint64));
+  result->slow = 0;
+  for (i = 1; i < bench.arrivals->len; i++) {
+    interval = g_array_index (bench.arrivals, gint64, i) -
+        g_array_index (bench.arrivals, gint64, i - 1);
+    g_array_append_val (intervals, interval);
+    if (frame_duration > 0 && interval > frame_duration)
+      result->slow++;
+  }
+  g_array_sort (intervals, (GCompareFunc) compare_int64);
+
+  result->frames = bench.arrivals->len;
+  result->p50 = percentile (intervals, 0.50);
+  result->p90 = percentile (intervals, 0.90);
+  result->p99 = percentile (intervals, 0.99);
+  result->max = percentile (intervals, 1.0);
+  result->user = timeval_seconds (&after.ru_utime) -
+      timeval_seconds (&before.ru_utime);
+  result->system = timeval_seconds (&after.ru_stime) -
+      timeval_seconds (&before.ru_stime);
+
+  g_array_free (intervals, TRUE);
+  g_array_free (bench.arrivals, TRUE);
+  g_mutex_clear (&bench.lock);
+  g_main_loop_unref (bench.loop);
+  gst_object_unref (player);
+
+  if (bench.error != NULL) {
+    g_propagate_error (error, bench.error);
+    return FALSE;
+  }
+
+  if (state == GST_STATE_CHANGE_FAILURE) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_STATE_CHANGE,
+        "Couldn't start playing");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gdouble
+timeval_seconds (struct timeval *tv)
+{
+  return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+/* -------------------- non-static functions --------------------- */
+
+gboolean
+benchmark_print (GList * uri_list, gboolean clutter_sink, gboolean json)
+{
+  BenchmarkResult result;
+  GError *error = NULL;
+  GList *l;
+  gboolean ok = TRUE;
+
+  if (uri_list == NULL) {
+    g_print ("ERROR: No files to benchmark\n");
+    return FALSE;
+  }
+
+  // One at a time, so files don't compete for the CPU
+  for (l = uri_list; l != NULL; l = l->next) {
+    if (run_benchmark (l->data, clutter_sink, &result, &error)) {
+      print_result (l->data, &result, json);
+    } else if (json) {
+      GString *out = g_string_new ("{\"uri\":");
+
+      append_json_string (out, l->data);
+      g_string_append (out, ",\"error\":");
+      append_json_string (out, error->message);
+      g_print ("%s}\n", out->str);
+      g_string_free (out, TRUE);
+      g_clear_error (&error);
+      ok = FALSE;
+    } else {
+      g_print ("ERROR: Couldn't benchmark %s: %s\n", (gchar *) l->data,
+          error->message);
+      g_clear_error (&error);
+      ok = FALSE;
+    }
+  }
+
+  return ok;
+}
@@ -0,0 +1,37 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Decode each file as fast as it goes and report how fast that was. With
+ * clutter_sink frames are uploaded by a ClutterGstVideoSink, offscreen,
+ * which needs Clutter to be initialised */
+gboolean benchmark_print (GList * uri_list, gboolean clutter_sink,
+    gboolean json);
+
+G_END_DECLS
+#endif /* __BENCHMARK_H__ */
@@ -0,0 +1,1128 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "clip_export.h"
+
+/* Clips are cut without decoding anything: the file is demuxed and parsed,
+ * the streams go straight into a muxer and on to disk. The pipeline seeks
+ * to the keyframe at or before the in point, as anything earlier than that
+ * keyframe could not be decoded, and the demuxer stops at the out point.
+ * The pipeline is paused to find its streams and seeked before it plays;
+ * whatever was read before the seek is dropped so only the clip is written.
+ *
+ * Smart rendering makes the cut frame accurate. Only the partial GOPs at
+ * either end are decoded and re-encoded, the whole GOPs in between are
+ * copied, and concat splices the three into one stream. Each part reads
+ * the file through its own uridecodebin, a branch, seeked to its range. */
+
+/* How often the export thread checks on progress and cancellation */
+#define EXPORT_POLL (100 * GST_MSECOND)
+/* Constant quality for x264, high enough not to show at the splices */
+#define SMART_QUANTIZER 18
+
+// Values of decodebin's GstAutoplugSelectResult, copied here as the enum
+// is not public.
+typedef enum
+{
+  AUTOPLUG_SELECT_TRY,
+  AUTOPLUG_SELECT_EXPOSE,
+  AUTOPLUG_SELECT_SKIP
+} AutoplugSelectResult;
+
+typedef enum
+{
+  BRANCH_REMUX,                 // every stream straight into the muxer
+  BRANCH_COPY_VIDEO,            // the video, as it is, into the splice
+  BRANCH_ENCODE_VIDEO,          // the video, re-encoded, into the splice
+  BRANCH_COPY_AUDIO             // the audio straight into the muxer
+} BranchKind;
+
+typedef struct
+{
+  ClipExport *export;
+  BranchKind kind;
+  GstClockTime start, stop;
+  GstSeekFlags flags;
+
+  GstPad *splice_pad;
+  gboolean video_linked;
+
+  // Under the export's lock
+  GstPad *seek_pad;
+  gboolean pads_done;
+} ExportBranch;
+
+typedef struct
+{
+  GstElement *pipeline;
+  GstElement *video_sink;
+  gboolean has_audio;
+} KeyframeSearch;
+
+struct _ClipExport
+{
+  gchar *uri, *output;
+  GstClockTime start, stop;
+  gboolean smart;
+  gint cancelled;
+
+  GstElement *pipeline, *mux;
+  GList *branches;
+  GstCaps *video_caps;
+  GstElementFactory *encoder;
+
+  GMutex lock;
+  guint open_pads, ended_pads;
+  GstClockTime position;
+  gdouble progress;
+  gboolean done;
+  GError *error;
+  guint deliver_id;
+
+  GThread *thread;
+  ClipExportFunc func;
+  gpointer data;
+};
+
+// Declaration of static functions
+static AutoplugSelectResult autoplug_select_cb (GstElement * bin,
+    GstPad * pad, GstCaps * caps, GstElementFactory * factory,
+    ExportBranch * branch);
+static ExportBranch *branch_add (ClipExport * export, BranchKind kind,
+    GstClockTime start, GstClockTime stop, GstSeekFlags flags,
+    GstElement * concat, GError ** error);
+static void branch_free (ExportBranch * branch);
+static void branch_no_more_pads_cb (GstElement * element,
+    ExportBranch * branch);
+static void branch_pad_added_cb (GstElement * element, GstPad * pad,
+    ExportBranch * branch);
+static gboolean deliver_progress (ClipExport * export);
+static GstPadProbeReturn drop_probe_cb (GstPad * pad, GstPadProbeInfo * info,
+    ClipExport * export);
+static GstElementFactory *encoder_for (GstCaps * caps);
+static gboolean export_clip (ClipExport * export, GError ** error);
+static void export_free (ClipExport * export);
+static ClipExport *export_new (const gchar * uri, const gchar * output,
+    GstClockTime start, GstClockTime stop, gboolean smart);
+static gpointer export_thread (ClipExport * export);
+static gboolean find_keyframes (ClipExport * export, GstClockTime * first,
+    GstClockTime * last, gboolean * has_audio, GError ** error);
+static void keyframes_pad_added_cb (GstElement * element, GstPad * pad,
+    KeyframeSearch * search);
+static GstElement *link_fakesink (GstElement * pipeline, GstPad * pad,
+    gboolean async);
+static const gchar *muxer_for (const gchar * output);
+static GstPadProbeReturn position_probe_cb (GstPad * pad,
+    GstPadProbeInfo * info, ClipExport * export);
+static void report_progress (ClipExport * export, gdouble progress);
+static gboolean run_pipeline (ClipExport * export, GError ** error);
+static gboolean sample_stream_time (GstElement * sink, GstClockTime * time,
+    GstCaps ** caps);
+static gboolean seek_branches (ClipExport * export, GstClockTime * stop,
+    GError ** error);
+static gboolean smart_plan (ClipExport * export, GError ** error);
+static GstPad *splice_chain_new (ExportBranch * branch);
+static gboolean wait_async_done (ClipExport * export, GstElement * pipeline,
+    GError ** error);
+
+/* ---------------------- static functions ----------------------- */
+
+static AutoplugSelectResult
+autoplug_select_cb (GstElement * bin, GstPad * pad, GstCaps * caps,
+    GstElementFactory * factory, ExportBranch * branch)
+{
+  const gchar *klass;
+
+  // Streams come out parsed, ready for a muxer, before any decoder. Only
+  // the video of a branch that re-encodes it gets decoded
+  klass = gst_element_factory_get_metadata (factory,
+      GST_ELEMENT_METADATA_KLASS);
+  if (klass == NULL || strstr (klass, "Decoder") == NULL)
+    return AUTOPLUG_SELECT_TRY;
+
+  if (branch != NULL && branch->kind == BRANCH_ENCODE_VIDEO &&
+      strstr (klass, "Video") != NULL)
+    return AUTOPLUG_SELECT_TRY;
+
+  return AUTOPLUG_SELECT_EXPOSE;
+}
+
+static ExportBranch *
+branch_add (ClipExport * export, BranchKind kind, GstClockTime start,
+    GstClockTime stop, GstSeekFlags flags, GstElement * concat,
+    GError ** error)
+{
+  ExportBranch *branch;
+  GstElement *source;
+
+  source = gst_element_factory_make ("uridecodebin", NULL);
+  if (source == NULL) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+        "Missing elements to export with");
+    return NULL;
+  }
+
+  branch = g_new0 (ExportBranch, 1);
+  branch->export = export;
+  branch->kind = kind;
+  branch->start = start;
+  branch->stop = stop;
+  branch->flags = flags;
+  if (concat != NULL)
+    branch->splice_pad = gst_element_get_request_pad (concat, "sink_%u");
+
+  g_object_set (source, "uri", export->uri, NULL);
+  gst_bin_add (GST_BIN (export->pipeline), source);
+
+  g_signal_connect (source, "autoplug-select",
+      G_CALLBACK (autoplug_select_cb), branch);
+  g_signal_connect (source, "pad-added", G_CALLBACK (branch_pad_added_cb),
+      branch);
+  g_signal_connect (source, "no-more-pads",
+      G_CALLBACK (branch_no_more_pads_cb), branch);
+
+  export->branches = g_list_append (export->branches, branch);
+
+  return branch;
+}
+
+static void
+branch_free (ExportBranch * branch)
+{
+  if (branch->seek_pad != NULL)
+    gst_object_unref (branch->seek_pad);
+  if (branch->splice_pad != NULL)
+    gst_object_unref (branch->splice_pad);
+  g_free (branch);
+}
+
+static void
+branch_no_more_pads_cb (GstElement * element, ExportBranch * branch)
+{
+  g_mutex_lock (&branch->export->lock);
+  branch->pads_done = TRUE;
+  g_mutex_unlock (&branch->export->lock);
+}
+
+static void
+branch_pad_added_cb (GstElement * element, GstPad * pad,
+    ExportBranch * branch)
+{
+  ClipExport *export = branch->export;
+  GstPad *target = NULL;
+  GstCaps *caps;
+  const gchar *name = "";
+  gboolean linked = FALSE, wanted = FALSE;
+
+  caps = gst_pad_query_caps (pad, NULL);
+  if (!gst_caps_is_empty (caps))
+    name = gst_structure_get_name (gst_caps_get_structure (caps, 0));
+
+  switch (branch->kind) {
+    case BRANCH_REMUX:
+      wanted = TRUE;
+      target = gst_element_get_compatible_pad (export->mux, pad, caps);
+      break;
+    case BRANCH_COPY_AUDIO:
+      wanted = g_str_has_prefix (name, "audio/");
+      if (wanted)
+        target = gst_element_get_compatible_pad (export->mux, pad, caps);
+      break;
+    case BRANCH_COPY_VIDEO:
+    case BRANCH_ENCODE_VIDEO:
+      wanted = g_str_has_prefix (name, "video/") && !branch->video_linked;
+      if (wanted)
+        target = splice_chain_new (branch);
+      break;
+  }
+  gst_caps_unref (caps);
+
+  if (target != NULL) {
+    linked = gst_pad_link (pad, target) == GST_PAD_LINK_OK;
+    gst_object_unref (target);
+  }
+
+  // Any of the branch's pads takes the seek up to its demuxer
+  g_mutex_lock (&export->lock);
+  if (branch->seek_pad == NULL)
+    branch->seek_pad = gst_object_ref (pad);
+  g_mutex_unlock (&export->lock);
+
+  if (!linked) {
+    // A stream the muxer can't take is left out of the clip
+    if (wanted)
+      g_print ("Leaving a stream out of the clip: %s\n", GST_PAD_NAME (pad));
+    link_fakesink (export->pipeline, pad, FALSE);
+    return;
+  }
+
+  if (branch->kind == BRANCH_COPY_VIDEO ||
+      branch->kind == BRANCH_ENCODE_VIDEO)
+    branch->video_linked = TRUE;
+
+  g_mutex_lock (&export->lock);
+  export->open_pads++;
+  g_mutex_unlock (&export->lock);
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_FLUSH | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) drop_probe_cb, export, NULL);
+  if (!export->smart)
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) position_probe_cb, export, NULL);
+}
+
+static gboolean
+deliver_progress (ClipExport * export)
+{
+  gdouble progress;
+  gboolean done;
+  GError *error;
+
+  g_mutex_lock (&export->lock);
+  export->deliver_id = 0;
+  progress = export->progress;
+  done = export->done;
+  error = export->error;
+  export->error = NULL;
+  g_mutex_unlock (&export->lock);
+
+  if (!g_atomic_int_get (&export->cancelled))
+    export->func (export, progress, done, error, export->data);
+
+  if (error != NULL)
+    g_error_free (error);
+
+  // The thread is on its way out once done is set, the export is ours
+  // to free
+  if (done) {
+    g_thread_join (export->thread);
+    export_free (export);
+  }
+
+  return FALSE;
+}
+
+static GstPadProbeReturn
+drop_probe_cb (GstPad * pad, GstPadProbeInfo * info, ClipExport * export)
+{
+  GstEvent *event;
+  gboolean open;
+
+  open = g_object_get_data (G_OBJECT (pad), "clip-export-open") != NULL;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+    return open ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+
+  event = GST_PAD_PROBE_INFO_EVENT (info);
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_STOP:
+      // The flush of the seek opens the way for the clip's data
+      g_object_set_data (G_OBJECT (pad), "clip-export-open",
+          GINT_TO_POINTER (TRUE));
+      break;
+    case GST_EVENT_EOS:
+      // Reaching the end before the seek would end the clip before it
+      // starts, the seek sets the demuxer going again
+      if (!open)
+        return GST_PAD_PROBE_DROP;
+
+      g_mutex_lock (&export->lock);
+      export->ended_pads++;
+      g_mutex_unlock (&export->lock);
+      break;
+    default:
+      break;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstElementFactory *
+encoder_for (GstCaps * caps)
+{
+  GList *encoders, *matching;
+  GstCaps *codec;
+  GstElementFactory *factory = NULL;
+
+  codec = gst_caps_new_empty_simple (gst_structure_get_name
+      (gst_caps_get_structure (caps, 0)));
+  encoders = gst_element_factory_list_get_elements
+      (GST_ELEMENT_FACTORY_TYPE_ENCODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO,
+      GST_RANK_MARGINAL);
+  matching = gst_element_factory_list_filter (encoders, codec, GST_PAD_SRC,
+      FALSE);
+  matching = g_list_sort (matching,
+      (GCompareFunc) gst_plugin_feature_rank_compare_func);
+
+  if (matching != NULL)
+    factory = gst_object_ref (matching->data);
+
+  gst_plugin_feature_list_free (matching);
+  gst_plugin_feature_list_free (encoders);
+  gst_caps_unref (codec);
+
+  return factory;
+}
+
+static gboolean
+export_clip (ClipExport * export, GError ** error)
+{
+  GstElement *sink;
+  GList *l;
+  gboolean ok;
+
+  // Spliced streams carry their own parameter sets, MPEG-TS takes those
+  if (export->smart && g_strcmp0 (muxer_for (export->output),
+          "mpegtsmux") != 0) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_SETTINGS,
+        "Smart exports are written as MPEG-TS, %s doesn't end in .ts",
+        export->output);
+    return FALSE;
+  }
+
+  export->pipeline = gst_pipeline_new ("clip-export");
+  export->mux = gst_element_factory_make (muxer_for (export->output), NULL);
+  sink = gst_element_factory_make ("filesink", NULL);
+
+  if (export->mux == NULL || sink == NULL) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+        "Missing elements to export with");
+    if (export->mux != NULL)
+      gst_object_unref (export->mux);
+    if (sink != NULL)
+      gst_object_unref (sink);
+    gst_object_unref (export->pipeline);
+    export->pipeline = NULL;
+    export->mux = NULL;
+    return FALSE;
+  }
+
+  // Nothing gets to the sink before the seek, it can't preroll
+  g_object_set (sink, "location", export->output, "async", FALSE, NULL);
+  gst_bin_add_many (GST_BIN (export->pipeline), export->mux, sink, NULL);
+  gst_element_link (export->mux, sink);
+
+  if (export->smart)
+    ok = smart_plan (export, error);
+  else
+    ok = branch_add (export, BRANCH_REMUX, export->start, export->stop,
+        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+        GST_SEEK_FLAG_SNAP_BEFORE, NULL, error) != NULL;
+
+  if (ok)
+    ok = run_pipeline (export, error);
+
+  gst_element_set_state (export->pipeline, GST_STATE_NULL);
+  gst_object_unref (export->pipeline);
+  export->pipeline = NULL;
+  export->mux = NULL;
+
+  for (l = export->branches; l != NULL; l = l->next)
+    branch_free (l->data);
+  g_list_free (export->branches);
+  export->branches = NULL;
+
+  // Don't leave half a clip behind
+  if (!ok)
+    g_unlink (export->output);
+
+  return ok;
+}
+
+static void
+export_free (ClipExport * export)
+{
+  if (export->video_caps != NULL)
+    gst_caps_unref (export->video_caps);
+  if (export->encoder != NULL)
+    gst_object_unref (export->encoder);
+  if (export->error != NULL)
+    g_error_free (export->error);
+  g_mutex_clear (&export->lock);
+  g_free (export->output);
+  g_free (export->uri);
+  g_free (export);
+}
+
+static ClipExport *
+export_new (const gchar * uri, const gchar * output, GstClockTime start,
+    GstClockTime stop, gboolean smart)
+{
+  ClipExport *export;
+
+  export = g_new0 (ClipExport, 1);
+  export->uri = g_strdup (uri);
+  export->output = g_strdup (output);
+  export->start = start;
+  export->stop = stop;
+  export->smart = smart;
+  export->position = GST_CLOCK_TIME_NONE;
+  g_mutex_init (&export->lock);
+
+  return export;
+}
+
+static gpointer
+export_thread (ClipExport * export)
+{
+  GError *error = NULL;
+
+  export_clip (export, &error);
+
+  g_mutex_lock (&export->lock);
+  export->done = TRUE;
+  export->error = error;
+  if (export->deliver_id == 0)
+    export->deliver_id = g_idle_add ((GSourceFunc) deliver_progress, export);
+  g_mutex_unlock (&export->lock);
+
+  return NULL;
+}
+
+static gboolean
+find_keyframes (ClipExport * export, GstClockTime * first,
+    GstClockTime * last, gboolean * has_audio, GError ** error)
+{
+  KeyframeSearch search = { NULL, NULL, FALSE };
+  GstElement *source;
+  gboolean ok = FALSE;
+
+  // A parse-only pipeline, seeked to the keyframes just inside the clip
+  search.pipeline = gst_pipeline_new ("clip-keyframes");
+  source = gst_element_factory_make ("uridecodebin", NULL);
+  if (source == NULL) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+        "Missing elements to export with");
+    gst_object_unref (search.pipeline);
+    return FALSE;
+  }
+
+  g_object_set (source, "uri", export->uri, NULL);
+  gst_bin_add (GST_BIN (search.pipeline), source);
+  g_signal_connect (source, "autoplug-select",
+      G_CALLBACK (autoplug_select_cb), NULL);
+  g_signal_connect (source, "pad-added",
+      G_CALLBACK (keyframes_pad_added_cb), &search);
+
+  gst_element_set_state (search.pipeline, GST_STATE_PAUSED);
+  if (!wait_async_done (export, search.pipeline, error))
+    goto out;
+
+  if (search.video_sink == NULL) {
+    g_set_error (error, GST_STREAM_ERROR, GST_STREAM_ERROR_WRONG_TYPE,
+        "There is no video to smart render");
+    goto out;
+  }
+
+  gst_element_seek_simple (search.pipeline, GST_FORMAT_TIME,
+      GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_AFTER,
+      export->start);
+  if (!wait_async_done (export, search.pipeline, error) ||
+      !sample_stream_time (search.video_sink, first, &export->video_caps))
+    goto out;
+
+  *last = GST_CLOCK_TIME_NONE;
+  if (GST_CLOCK_TIME_IS_VALID (export->stop)) {
+    gst_element_seek_simple (search.pipeline, GST_FORMAT_TIME,
+        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+        GST_SEEK_FLAG_SNAP_BEFORE, export->stop);
+    if (!wait_async_done (export, search.pipeline, error) ||
+        !sample_stream_time (search.video_sink, last, NULL))
+      goto out;
+  }
+
+  *has_audio = search.has_audio;
+  ok = TRUE;
+
+out:
+  if (!ok && error != NULL && *error == NULL)
+    g_set_error (error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED,
+        "Couldn't find the keyframes of the clip");
+
+  gst_element_set_state (search.pipeline, GST_STATE_NULL);
+  if (search.video_sink != NULL)
+    gst_object_unref (search.video_sink);
+  gst_object_unref (search.pipeline);
+
+  return ok;
+}
+
+static void
+keyframes_pad_added_cb (GstElement * element, GstPad * pad,
+    KeyframeSearch * search)
+{
+  GstElement *sink;
+  GstCaps *caps;
+  const gchar *name = "";
+  gboolean video;
+
+  caps = gst_pad_query_caps (pad, NULL);
+  if (!gst_caps_is_empty (caps))
+    name = gst_structure_get_name (gst_caps_get_structure (caps, 0));
+
+  // Only the video prerolls, sparse streams would hold the seeks up
+  video = g_str_has_prefix (name, "video/") && search->video_sink == NULL;
+  sink = link_fakesink (search->pipeline, pad, video);
+  if (video)
+    search->video_sink = gst_object_ref (sink);
+  else if (g_str_has_prefix (name, "audio/"))
+    search->has_audio = TRUE;
+
+  gst_caps_unref (caps);
+}
+
+static GstElement *
+link_fakesink (GstElement * pipeline, GstPad * pad, gboolean async)
+{
+  GstElement *sink;
+  GstPad *sink_pad;
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (sink, "sync", FALSE, "async", async, NULL);
+  gst_bin_add (GST_BIN (pipeline), sink);
+
+  sink_pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_link (pad, sink_pad);
+  gst_object_unref (sink_pad);
+
+  gst_element_sync_state_with_parent (sink);
+
+  return sink;
+}
+
+static const gchar *
+muxer_for (const gchar * output)
+{
+  gchar *name;
+  const gchar *muxer = "matroskamux";
+
+  // Matroska takes about any stream, the rest only when asked for
+  name = g_ascii_strdown (output, -1);
+  if (g_str_has_suffix (name, ".mp4") || g_str_has_suffix (name, ".m4v"))
+    muxer = "mp4mux";
+  else if (g_str_has_suffix (name, ".mov"))
+    muxer = "qtmux";
+  else if (g_str_has_suffix (name, ".webm"))
+    muxer = "webmmux";
+  else if (g_str_has_suffix (name, ".ts"))
+    muxer = "mpegtsmux";
+  g_free (name);
+
+  return muxer;
+}
+
+static GstPadProbeReturn
+position_probe_cb (GstPad * pad, GstPadProbeInfo * info, ClipExport * export)
+{
+  GstBuffer *buffer;
+  GstEvent *event;
+  const GstSegment *segment;
+  GstClockTime position;
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return GST_PAD_PROBE_OK;
+
+  event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+  if (event == NULL)
+    return GST_PAD_PROBE_OK;
+
+  gst_event_parse_segment (event, &segment);
+  position = gst_segment_to_stream_time (segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  gst_event_unref (event);
+
+  g_mutex_lock (&export->lock);
+  if (GST_CLOCK_TIME_IS_VALID (position) &&
+      (!GST_CLOCK_TIME_IS_VALID (export->position) ||
+          position > export->position))
+    export->position = position;
+  g_mutex_unlock (&export->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+report_progress (ClipExport * export, gdouble progress)
+{
+  if (export->func == NULL) {
+    g_print ("\rExporting clip: %3.0f%%", progress * 100);
+    return;
+  }
+
+  // Only the latest progress matters, one delivery at a time is pending
+  g_mutex_lock (&export->lock);
+  export->progress = progress;
+  if (export->deliver_id == 0)
+    export->deliver_id = g_idle_add ((GSourceFunc) deliver_progress, export);
+  g_mutex_unlock (&export->lock);
+}
+
+static gboolean
+run_pipeline (ClipExport * export, GError ** error)
+{
+  GstBus *bus;
+  GstMessage *msg;
+  GstStateChangeReturn ret;
+  GstClockTime position, last_position = GST_CLOCK_TIME_NONE;
+  GstClockTime stop = export->stop;
+  gint64 last_change;
+  gboolean ended, ok = FALSE;
+
+  // Paused, the branches find their streams, then they are seeked to
+  // their ranges before anything is written
+  ret = gst_element_set_state (export->pipeline, GST_STATE_PAUSED);
+  if (ret == GST_STATE_CHANGE_FAILURE) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_STATE_CHANGE,
+        "Couldn't read the file");
+    return FALSE;
+  }
+  if ((ret == GST_STATE_CHANGE_ASYNC &&
+          !wait_async_done (export, export->pipeline, error)) ||
+      !seek_branches (export, &stop, error))
+    return FALSE;
+
+  gst_element_set_state (export->pipeline, GST_STATE_PLAYING);
+
+  bus = gst_element_get_bus (export->pipeline);
+  last_change = g_get_monotonic_time ();
+
+  while (!g_atomic_int_get (&export->cancelled)) {
+    g_mutex_lock (&export->lock);
+    position = export->position;
+    g_mutex_unlock (&export->lock);
+
+    if (position != last_position) {
+      last_position = position;
+      last_change = g_get_monotonic_time ();
+
+      if (GST_CLOCK_TIME_IS_VALID (position) && GST_CLOCK_TIME_IS_VALID (stop)
+          && stop > export->start)
+        report_progress (export, CLAMP ((gdouble) ((gint64) position -
+                    (gint64) export->start) / (stop - export->start), 0, 1));
+    } else if (g_get_monotonic_time () - last_change >
+        CLIP_EXPORT_TIMEOUT * G_TIME_SPAN_SECOND) {
+      g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_STATE_CHANGE,
+          "Timed out exporting the clip");
+      goto done;
+    }
+
+    msg = gst_bus_timed_pop_filtered (bus, EXPORT_POLL,
+        GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    if (msg == NULL)
+      continue;
+
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+      gst_message_parse_error (msg, error, NULL);
+      gst_message_unref (msg);
+      goto done;
+    }
+
+    // Muxers send an EOS of their own, so it can't be matched to the
+    // seeks. It only counts once every stream reached its out point
+    g_mutex_lock (&export->lock);
+    ended = export->ended_pads == export->open_pads;
+    g_mutex_unlock (&export->lock);
+
+    gst_message_unref (msg);
+    if (ended) {
+      ok = TRUE;
+      goto done;
+    }
+  }
+
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Cancelled");
+
+done:
+  gst_object_unref (bus);
+
+  return ok;
+}
+
+static gboolean
+sample_stream_time (GstElement * sink, GstClockTime * time, GstCaps ** caps)
+{
+  GstSample *sample = NULL;
+  GstBuffer *buffer;
+
+  g_object_get (sink, "last-sample", &sample, NULL);
+  if (sample == NULL)
+    return FALSE;
+
+  buffer = gst_sample_get_buffer (sample);
+  *time = gst_segment_to_stream_time (gst_sample_get_segment (sample),
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  if (caps != NULL && *caps == NULL)
+    *caps = gst_caps_ref (gst_sample_get_caps (sample));
+
+  gst_sample_unref (sample);
+
+  return GST_CLOCK_TIME_IS_VALID (*time);
+}
+
+static gboolean
+seek_branches (ClipExport * export, GstClockTime * stop, GError ** error)
+{
+  ExportBranch *branch;
+  GstEvent *seek;
+  GstPad *seek_pad;
+  GList *l;
+  gint64 duration;
+  gboolean pads_done;
+
+  for (l = export->branches; l != NULL; l = l->next) {
+    branch = l->data;
+
+    g_mutex_lock (&export->lock);
+    pads_done = branch->pads_done;
+    seek_pad = branch->seek_pad;
+    g_mutex_unlock (&export->lock);
+
+    if (!pads_done || seek_pad == NULL) {
+      g_set_error (error, GST_STREAM_ERROR, GST_STREAM_ERROR_DEMUX,
+          "No streams to export");
+      return FALSE;
+    }
+
+    seek = gst_event_new_seek (1.0, GST_FORMAT_TIME, branch->flags,
+        GST_SEEK_TYPE_SET, branch->start,
+        GST_CLOCK_TIME_IS_VALID (branch->stop) ? GST_SEEK_TYPE_SET :
+        GST_SEEK_TYPE_NONE,
+        GST_CLOCK_TIME_IS_VALID (branch->stop) ? branch->stop : -1);
+    if (!gst_pad_send_event (seek_pad, seek)) {
+      g_set_error (error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED,
+          "The file can't be seeked into");
+      return FALSE;
+    }
+
+    if (!GST_CLOCK_TIME_IS_VALID (*stop) &&
+        gst_pad_query_duration (seek_pad, GST_FORMAT_TIME, &duration))
+      *stop = duration;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+smart_plan (ClipExport * export, GError ** error)
+{
+#if GST_CHECK_VERSION(1, 6, 0)
+  GstElement *concat;
+  GstPad *pad;
+  GstClockTime first, last, start = export->start, stop = export->stop;
+  GstSeekFlags keyframe_flags, accurate_flags;
+  const gchar *codec;
+  gboolean has_audio = FALSE;
+
+  if (!find_keyframes (export, &first, &last, &has_audio, error))
+    return FALSE;
+
+  // Only these carry their parameter sets in band, which a splice of two
+  // encoders' output needs
+  codec = gst_structure_get_name (gst_caps_get_structure (export->video_caps,
+          0));
+  if (!g_str_equal (codec, "video/x-h264") &&
+      !g_str_equal (codec, "video/x-h265")) {
+    g_set_error (error, GST_STREAM_ERROR, GST_STREAM_ERROR_CODEC_NOT_FOUND,
+        "Only H.264 and H.265 video can be smart rendered, not %s", codec);
+    return FALSE;
+  }
+
+  export->encoder = encoder_for (export->video_caps);
+  if (export->encoder == NULL) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+        "No encoder for %s", codec);
+    return FALSE;
+  }
+
+  concat = gst_element_factory_make ("concat", NULL);
+  if (concat == NULL) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+        "Missing elements to export with");
+    return FALSE;
+  }
+  gst_bin_add (GST_BIN (export->pipeline), concat);
+  gst_element_link (concat, export->mux);
+
+  pad = gst_element_get_static_pad (concat, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) position_probe_cb, export, NULL);
+  gst_object_unref (pad);
+
+  keyframe_flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+      GST_SEEK_FLAG_SNAP_BEFORE;
+  accurate_flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE;
+
+  // Demuxers that don't snap to the asked side leave no whole GOP to
+  // copy, the clip is re-encoded from end to end then
+  if (first < start || (GST_CLOCK_TIME_IS_VALID (stop) &&
+          (last > stop || last <= first))) {
+    g_print ("Smart render: no whole GOP to copy, re-encoding the clip\n");
+    if (branch_add (export, BRANCH_ENCODE_VIDEO, start, stop, accurate_flags,
+            concat, error) == NULL)
+      return FALSE;
+  } else {
+    if (first > start && branch_add (export, BRANCH_ENCODE_VIDEO, start,
+            first, accurate_flags, concat, error) == NULL)
+      return FALSE;
+
+    if (branch_add (export, BRANCH_COPY_VIDEO, first,
+            GST_CLOCK_TIME_IS_VALID (stop) ? last : GST_CLOCK_TIME_NONE,
+            keyframe_flags, concat, error) == NULL)
+      return FALSE;
+
+    if (GST_CLOCK_TIME_IS_VALID (stop) && last < stop &&
+        branch_add (export, BRANCH_ENCODE_VIDEO, last, stop, accurate_flags,
+            concat, error) == NULL)
+      return FALSE;
+
+    g_print ("Smart render: re-encoding %.2f s, copying the rest\n",
+        (gdouble) ((first - start) + (GST_CLOCK_TIME_IS_VALID (stop) ?
+                stop - last : 0)) / GST_SECOND);
+  }
+
+  // Audio frames are short enough to be copied up to the exact cut
+  if (has_audio && branch_add (export, BRANCH_COPY_AUDIO, start, stop,
+          accurate_flags, NULL, error) == NULL)
+    return FALSE;
+
+  return TRUE;
+#else
+  g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+      "Smart rendering needs GStreamer 1.6 or newer");
+
+  return FALSE;
+#endif
+}
+
+static GstPad *
+splice_chain_new (ExportBranch * branch)
+{
+  ClipExport *export = branch->export;
+  GstElement *parser, *filter, *convert = NULL, *encoder = NULL;
+  GstCaps *caps;
+  GstPad *pad;
+  const gchar *codec;
+
+  codec = gst_structure_get_name (gst_caps_get_structure (export->video_caps,
+          0));
+
+  // Both the copied and re-encoded parts leave as byte-stream with the
+  // parameter sets repeated, so the decoder picks up each part's own
+  parser = gst_element_factory_make (g_str_equal (codec, "video/x-h265") ?
+      "h265parse" : "h264parse", NULL);
+  filter = gst_element_factory_make ("capsfilter", NULL);
+  if (branch->kind == BRANCH_ENCODE_VIDEO) {
+    convert = gst_element_factory_make ("videoconvert", NULL);
+    encoder = gst_element_factory_create (export->encoder, NULL);
+  }
+
+  if (parser == NULL || filter == NULL ||
+      (branch->kind == BRANCH_ENCODE_VIDEO && (convert == NULL ||
+              encoder == NULL))) {
+    if (parser != NULL)
+      gst_object_unref (parser);
+    if (filter != NULL)
+      gst_object_unref (filter);
+    if (convert != NULL)
+      gst_object_unref (convert);
+    if (encoder != NULL)
+      gst_object_unref (encoder);
+    return NULL;
+  }
+
+#if GST_CHECK_VERSION(1, 12, 0)
+  g_object_set (parser, "config-interval", -1, NULL);
+#else
+  g_object_set (parser, "config-interval", 1, NULL);
+#endif
+  caps = gst_caps_new_simple (codec, "stream-format", G_TYPE_STRING,
+      "byte-stream", "alignment", G_TYPE_STRING, "au", NULL);
+  g_object_set (filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  gst_bin_add_many (GST_BIN (export->pipeline), parser, filter, NULL);
+  gst_element_link (parser, filter);
+
+  if (encoder != NULL) {
+    if (g_str_equal (gst_plugin_feature_get_name (export->encoder),
+            "x264enc")) {
+      gst_util_set_object_arg (G_OBJECT (encoder), "pass", "qual");
+      g_object_set (encoder, "quantizer", SMART_QUANTIZER, NULL);
+    }
+
+    gst_bin_add_many (GST_BIN (export->pipeline), convert, encoder, NULL);
+    gst_element_link_many (convert, encoder, parser, NULL);
+  }
+
+  pad = gst_element_get_static_pad (filter, "src");
+  gst_pad_link (pad, branch->splice_pad);
+  gst_object_unref (pad);
+
+  gst_element_sync_state_with_parent (filter);
+  gst_element_sync_state_with_parent (parser);
+  if (encoder != NULL) {
+    gst_element_sync_state_with_parent (encoder);
+    gst_element_sync_state_with_parent (convert);
+  }
+
+  return gst_element_get_static_pad (encoder != NULL ? convert : parser,
+      "sink");
+}
+
+static gboolean
+wait_async_done (ClipExport * export, GstElement * pipeline, GError ** error)
+{
+  GstBus *bus;
+  GstMessage *msg = NULL;
+  gint64 deadline;
+  gboolean ok = FALSE;
+
+  bus = gst_element_get_bus (pipeline);
+  deadline = g_get_monotonic_time () +
+      CLIP_EXPORT_TIMEOUT * G_TIME_SPAN_SECOND;
+
+  // In short steps, so a cancelled export doesn't sit out the timeout
+  while (msg == NULL && !g_atomic_int_get (&export->cancelled) &&
+      g_get_monotonic_time () < deadline)
+    msg = gst_bus_timed_pop_filtered (bus, EXPORT_POLL,
+        GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR);
+
+  if (msg == NULL && g_atomic_int_get (&export->cancelled)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Cancelled");
+  } else if (msg == NULL) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_STATE_CHANGE,
+        "Timed out reading the file");
+  } else if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    gst_message_parse_error (msg, error, NULL);
+  } else {
+    ok = TRUE;
+  }
+
+  if (msg != NULL)
+    gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  return ok;
+}
+
+/* -------------------- non-static functions --------------------- */
+
+void
+clip_export_cancel (ClipExport * export)
+{
+  g_atomic_int_set (&export->cancelled, TRUE);
+  g_thread_join (export->thread);
+
+  // The thread may have queued one last delivery on its way out
+  if (export->deliver_id != 0)
+    g_source_remove (export->deliver_id);
+  export_free (export);
+}
+
+const gchar *
+clip_export_get_output (ClipExport * export)
+{
+  return export->output;
+}
+
+gchar *
+clip_export_output_for (const gchar * uri, GstClockTime start,
+    GstClockTime stop, gboolean smart)
+{
+  gchar *filename, *dir, *base, *dot, *name, *path;
+  gchar *stop_str;
+  const gchar *ext = smart ? "ts" : "mkv";
+
+  filename = g_filename_from_uri (uri, NULL, NULL);
+  if (filename != NULL) {
+    dir = g_path_get_dirname (filename);
+    base = g_path_get_basename (filename);
+  } else {
+    // Clips of streams go to the current directory
+    dir = g_get_current_dir ();
+    base = g_path_get_basename (uri);
+  }
+
+  // Keep the container when it is one a muxer is picked for
+  dot = strrchr (base, '.');
+  if (dot != NULL) {
+    if (!smart && g_strcmp0 (muxer_for (base), "matroskamux") != 0)
+      ext = dot + 1;
+    *dot = '\0';
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (stop))
+    stop_str = g_strdup_printf ("%" G_GUINT64_FORMAT, stop / GST_SECOND);
+  else
+    stop_str = g_strdup ("end");
+
+  name = g_strdup_printf ("%s.%" G_GUINT64_FORMAT "-%s.%s", base,
+      start / GST_SECOND, stop_str, ext);
+  path = g_build_filename (dir, name, NULL);
+
+  g_free (name);
+  g_free (stop_str);
+  g_free (base);
+  g_free (dir);
+  g_free (filename);
+
+  return path;
+}
+
+gboolean
+clip_export_run (const gchar * uri, const gchar * output, GstClockTime start,
+    GstClockTime stop, gboolean smart, GError ** error)
+{
+  ClipExport *export;
+  gboolean ok;
+
+  export = export_new (uri, output, start, stop, smart);
+  ok = export_clip (export, error);
+  // End the progress line
+  if (GST_CLOCK_TIME_IS_VALID (export->position))
+    g_print ("\n");
+  export_free (export);
+
+  return ok;
+}
+
+ClipExport *
+clip_export_start (const gchar * uri, const gchar * output,
+    GstClockTime start, GstClockTime stop, gboolean smart,
+    ClipExportFunc func, gpointer data)
+{
+  ClipExport *export;
+
+  export = export_new (uri, output, start, stop, smart);
+  export->func = func;
+  export->data = data;
+
+  export->thread = g_thread_new ("clip-export",
+      (GThreadFunc) export_thread, export);
+
+  return export;
+}
@@ -0,0 +1,58 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __CLIP_EXPORT_H__
+#define __CLIP_EXPORT_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* How long an export may stall before it is given up on, in seconds */
+#define CLIP_EXPORT_TIMEOUT 10
+
+typedef struct _ClipExport ClipExport;
+
+/* Called on the main thread while the clip is written, with progress
+ * between 0 and 1, and once more with done set when it has finished or
+ * failed, after which the export is freed. Never called after
+ * clip_export_cancel, which stops the export, waits for its thread and
+ * frees it */
+typedef void (*ClipExportFunc) (ClipExport * export, gdouble progress,
+    gboolean done, const GError * error, gpointer data);
+
+void clip_export_cancel (ClipExport * export);
+const gchar *clip_export_get_output (ClipExport * export);
+gchar *clip_export_output_for (const gchar * uri, GstClockTime start,
+    GstClockTime stop, gboolean smart);
+/* Exports a clip, here or on a thread of its own. The muxer is picked from
+ * the output's extension. A smart export re-encodes the partial GOPs at the
+ * cuts, making them frame accurate, and copies the rest. It writes MPEG-TS,
+ * so only to a .ts output, and needs H.264 or H.265 video */
+gboolean clip_export_run (const gchar * uri, const gchar * output,
+    GstClockTime start, GstClockTime stop, gboolean smart, GError ** error);
+ClipExport *clip_export_start (const gchar * uri, const gchar * output,
+    GstClockTime start, GstClockTime stop, gboolean smart,
+    ClipExportFunc func, gpointer data);
+
+G_END_DECLS
+#endif /* __CLIP_EXPORT_H__ */
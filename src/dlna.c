@@ -28,6 +28,7 @@
 
 #include <gio/gio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "dlna.h"
 
@@ -143,17 +144,430 @@ static const GDBusInterfaceVTable root_vtable = {
   NULL
 };
 
+static const GDBusInterfaceVTable tracklist_vtable = {
+  (GDBusInterfaceMethodCallFunc) handle_tracklist_method_call,
+  (GDBusInterfaceGetPropertyFunc) get_tracklist_property,
+  NULL
+};
+
 static GDBusNodeInfo *introspection_data = NULL;
 
+typedef struct
+{
+  SnappyMP *mp;
+  GDBusMethodInvocation *invocation;
+} MprisOpenRequest;
+
+typedef struct
+{
+  SnappyMP *mp;
+  GDBusMethodInvocation *invocation;
+  GVariantIter *paths;
+  GVariantBuilder metadata;
+} MprisMetadataRequest;
+
+// Declaration of static functions
+static gboolean mpris_can_go (SnappyMP * mp, gboolean next);
+static gboolean mpris_emit_properties (gpointer data);
+static void mpris_emit_seeked (SnappyMP * mp);
+static gboolean mpris_emit_tracklist (gpointer data);
+static void mpris_engine_changed (GstEngine * engine, EngineChange change,
+    SnappyMP * mp);
+static void mpris_forget_track (SnappyMP * mp, gchar * uri);
+static GVariant *mpris_metadata_for_uri (SnappyMP * mp, gchar * uri);
+static gboolean mpris_metadata_page (gpointer data);
+static const gchar *mpris_playback_status (SnappyMP * mp);
+static void mpris_queue_property (SnappyMP * mp, const gchar * name,
+    GVariant * value);
+static void mpris_queue_track_signal (SnappyMP * mp, const gchar * name,
+    GVariant * params);
+static gchar *mpris_track_from_path (SnappyMP * mp, const gchar * path);
+static GVariant *mpris_track_metadata (SnappyMP * mp);
+static gchar *mpris_track_next_to (SnappyMP * mp, gboolean next);
+static GVariant *mpris_track_path (SnappyMP * mp, gchar * uri);
+static void mpris_update_state (SnappyMP * mp);
+static void mpris_uri_opened (GstEngine * engine, gchar * uri,
+    const GError * error, MprisOpenRequest * request);
+
+static gboolean
+mpris_can_go (SnappyMP * mp, gboolean next)
+{
+  return mpris_track_next_to (mp, next) != NULL;
+}
+
+static gboolean
+mpris_emit_properties (gpointer data)
+{
+  SnappyMP *mp = data;
+  GVariantBuilder changed, invalidated;
+  GHashTableIter iter;
+  gpointer name, value;
+
+  mp->property_emit_id = 0;
+
+  /* Everything that changed since the last main loop iteration goes out in
+   * a single PropertiesChanged */
+  g_variant_builder_init (&changed, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_init (&invalidated, G_VARIANT_TYPE_STRING_ARRAY);
+
+  g_hash_table_iter_init (&iter, mp->player_property_changes);
+  while (g_hash_table_iter_next (&iter, &name, &value))
+    g_variant_builder_add (&changed, "{sv}", name, value);
+  g_hash_table_remove_all (mp->player_property_changes);
+
+  g_dbus_connection_emit_signal (mp->connection, NULL, MPRIS_OBJECT_NAME,
+      "org.freedesktop.DBus.Properties", "PropertiesChanged",
+      g_variant_new ("(sa{sv}as)", MPRIS_PLAYER_INTERFACE, &changed,
+          &invalidated), NULL);
+
+  return FALSE;
+}
+
+static void
+mpris_emit_seeked (SnappyMP * mp)
+{
+  gint64 position;
+
+  if (mp->connection == NULL)
+    return;
+
+  position = engine_interpolate_position (mp->engine) / GST_USECOND;
+  g_dbus_connection_emit_signal (mp->connection, NULL, MPRIS_OBJECT_NAME,
+      MPRIS_PLAYER_INTERFACE, "Seeked", g_variant_new ("(x)", position), NULL);
+}
+
+static gboolean
+mpris_emit_tracklist (gpointer data)
+{
+  SnappyMP *mp = data;
+  GVariant *tracks, *current;
+  const gchar *name;
+  GVariant *params;
+  guint c;
+
+  mp->tracklist_emit_id = 0;
+
+  /* Bulk edits are cheaper to announce as a whole new list */
+  if (mp->tracklist_signals->len > MPRIS_TRACKLIST_BATCH) {
+    tracks = get_tracklist_property (mp->connection, NULL, MPRIS_OBJECT_NAME,
+        MPRIS_TRACKLIST_INTERFACE, "Tracks", NULL, mp);
+    current = mpris_track_path (mp, mp->engine->uri);
+
+    g_dbus_connection_emit_signal (mp->connection, NULL, MPRIS_OBJECT_NAME,
+        MPRIS_TRACKLIST_INTERFACE, "TrackListReplaced",
+        g_variant_new ("(@ao@o)", tracks, current), NULL);
+
+  } else {
+    for (c = 0; c < mp->tracklist_signals->len; c++) {
+      g_variant_get (g_ptr_array_index (mp->tracklist_signals, c), "(&s@*)",
+          &name, &params);
+      g_dbus_connection_emit_signal (mp->connection, NULL, MPRIS_OBJECT_NAME,
+          MPRIS_TRACKLIST_INTERFACE, name, params, NULL);
+      g_variant_unref (params);
+    }
+  }
+
+  g_ptr_array_set_size (mp->tracklist_signals, 0);
+
+  return FALSE;
+}
+
+static void
+mpris_engine_changed (GstEngine * engine, EngineChange change, SnappyMP * mp)
+{
+  mpris_update_state (mp);
+
+  if (change & ENGINE_CHANGE_SEEKED)
+    mpris_emit_seeked (mp);
+}
+
+static void
+mpris_forget_track (SnappyMP * mp, gchar * uri)
+{
+  guint id;
+
+  id = GPOINTER_TO_UINT (g_hash_table_lookup (mp->track_ids, uri));
+  g_hash_table_remove (mp->track_uris, GUINT_TO_POINTER (id));
+  g_hash_table_remove (mp->track_ids, uri);
+  g_hash_table_remove (mp->metadata_cache, uri);
+}
+
+static GVariant *
+mpris_metadata_for_uri (SnappyMP * mp, gchar * uri)
+{
+  GVariantBuilder builder;
+  GVariant *metadata;
+  gchar *title;
+
+  /* Built from what we already know, never by probing the file */
+  metadata = g_hash_table_lookup (mp->metadata_cache, uri);
+  if (metadata != NULL)
+    return metadata;
+
+  title = g_path_get_basename (uri);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "mpris:trackid",
+      mpris_track_path (mp, uri));
+  g_variant_builder_add (&builder, "{sv}", "xesam:url",
+      g_variant_new_string (uri));
+  g_variant_builder_add (&builder, "{sv}", "xesam:title",
+      g_variant_new_string (title));
+  metadata = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  g_hash_table_insert (mp->metadata_cache, uri, metadata);
+  g_free (title);
+
+  return metadata;
+}
+
+/* Answer a page of a GetTracksMetadata request per main loop iteration, so
+ * a very long one doesn't hold everything else up, and all of it at the
+ * end */
+static gboolean
+mpris_metadata_page (gpointer data)
+{
+  MprisMetadataRequest *request = data;
+  SnappyMP *mp = request->mp;
+  const gchar *path;
+  gchar *uri;
+  guint count = 0;
+
+  while (count < MPRIS_METADATA_PAGE &&
+      g_variant_iter_next (request->paths, "&o", &path)) {
+    uri = mpris_track_from_path (mp, path);
+    if (uri == NULL)
+      continue;
+
+    if (uri == mp->engine->uri)
+      g_variant_builder_add_value (&request->metadata,
+          mpris_track_metadata (mp));
+    else
+      g_variant_builder_add_value (&request->metadata,
+          mpris_metadata_for_uri (mp, uri));
+    count++;
+  }
+
+  if (count == MPRIS_METADATA_PAGE)
+    return TRUE;
+
+  g_dbus_method_invocation_return_value (request->invocation,
+      g_variant_new ("(aa{sv})", &request->metadata));
+  g_variant_iter_free (request->paths);
+  g_free (request);
+
+  return FALSE;
+}
+
+static const gchar *
+mpris_playback_status (SnappyMP * mp)
+{
+  if (mp->engine->uri == NULL)
+    return "Stopped";
+
+  switch (GST_STATE (mp->engine->player)) {
+    case GST_STATE_PLAYING:
+      return "Playing";
+    case GST_STATE_PAUSED:
+      return "Paused";
+    default:
+      return "Stopped";
+  }
+}
+
+static void
+mpris_queue_property (SnappyMP * mp, const gchar * name, GVariant * value)
+{
+  /* Nobody to tell before we are on the bus */
+  if (mp->connection == NULL) {
+    g_variant_unref (g_variant_ref_sink (value));
+    return;
+  }
+
+  g_hash_table_replace (mp->player_property_changes, g_strdup (name),
+      g_variant_ref_sink (value));
+
+  if (mp->property_emit_id == 0)
+    mp->property_emit_id = g_idle_add (mpris_emit_properties, mp);
+}
+
+static void
+mpris_queue_track_signal (SnappyMP * mp, const gchar * name,
+    GVariant * params)
+{
+  g_ptr_array_add (mp->tracklist_signals,
+      g_variant_ref_sink (g_variant_new ("(s@*)", name, params)));
+
+  if (mp->tracklist_emit_id == 0)
+    mp->tracklist_emit_id = g_idle_add (mpris_emit_tracklist, mp);
+}
+
+static gchar *
+mpris_track_from_path (SnappyMP * mp, const gchar * path)
+{
+  guint64 id;
+
+  if (!g_str_has_prefix (path, MPRIS_TRACK_PATH "/"))
+    return NULL;
+
+  id = g_ascii_strtoull (path + strlen (MPRIS_TRACK_PATH "/"), NULL, 10);
+
+  return g_hash_table_lookup (mp->track_uris, GUINT_TO_POINTER (id));
+}
+
+static GVariant *
+mpris_track_metadata (SnappyMP * mp)
+{
+  GVariantBuilder builder;
+  GVariant *cached;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  if (mp->engine->uri != NULL) {
+    /* The current track also knows its length */
+    cached = mpris_metadata_for_uri (mp, mp->engine->uri);
+    g_variant_iter_init (&iter, cached);
+    while (g_variant_iter_next (&iter, "{&s@v}", &key, &value)) {
+      g_variant_builder_add (&builder, "{s@v}", key, value);
+      g_variant_unref (value);
+    }
+
+    if (mp->length > 0) {
+      g_variant_builder_add (&builder, "{sv}", "mpris:length",
+          g_variant_new_int64 (mp->length / GST_USECOND));
+    }
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+static gchar *
+mpris_track_next_to (SnappyMP * mp, gboolean next)
+{
+  GList *element;
+
+  element = g_list_find (mp->ui->uri_list, mp->engine->uri);
+  if (element == NULL)
+    return NULL;
+
+  element = next ? element->next : element->prev;
+
+  return element ? element->data : NULL;
+}
+
+static GVariant *
+mpris_track_path (SnappyMP * mp, gchar * uri)
+{
+  gchar path[sizeof (MPRIS_TRACK_PATH) + 16];
+  guint id;
+
+  if (uri == NULL)
+    return g_variant_new_object_path (MPRIS_NO_TRACK);
+
+  /* Ids are handed out on first sight and stay with the uri string */
+  id = GPOINTER_TO_UINT (g_hash_table_lookup (mp->track_ids, uri));
+  if (id == 0) {
+    id = ++mp->next_track_id;
+    g_hash_table_insert (mp->track_ids, uri, GUINT_TO_POINTER (id));
+    g_hash_table_insert (mp->track_uris, GUINT_TO_POINTER (id), uri);
+  }
+
+  g_snprintf (path, sizeof (path), MPRIS_TRACK_PATH "/%u", id);
+
+  return g_variant_new_object_path (path);
+}
+
+static void
+mpris_update_state (SnappyMP * mp)
+{
+  GstEngine *engine = mp->engine;
+  const gchar *status;
+  gdouble volume;
+
+  /* Compare against what clients last saw and only publish differences */
+  status = mpris_playback_status (mp);
+  if (status != mp->playback_status) {
+    mp->playback_status = status;
+    mpris_queue_property (mp, "PlaybackStatus", g_variant_new_string (status));
+  }
+
+  status = engine->loop ? "Track" : "None";
+  if (status != mp->loop_status) {
+    mp->loop_status = status;
+    mpris_queue_property (mp, "LoopStatus", g_variant_new_string (status));
+  }
+
+  if (engine->rate != mp->rate) {
+    mp->rate = engine->rate;
+    mpris_queue_property (mp, "Rate", g_variant_new_double (mp->rate));
+  }
+
+  g_object_get (G_OBJECT (engine->player), "volume", &volume, NULL);
+  if (volume != mp->volume) {
+    mp->volume = volume;
+    mpris_queue_property (mp, "Volume", g_variant_new_double (mp->volume));
+  }
+
+  if (g_strcmp0 (engine->uri, mp->track_uri) != 0 ||
+      engine->media_duration != mp->length) {
+    g_free (mp->track_uri);
+    mp->track_uri = g_strdup (engine->uri);
+    mp->length = engine->media_duration;
+    mpris_queue_property (mp, "Metadata", mpris_track_metadata (mp));
+  }
+
+  if (mpris_can_go (mp, TRUE) != mp->can_go_next) {
+    mp->can_go_next = !mp->can_go_next;
+    mpris_queue_property (mp, "CanGoNext",
+        g_variant_new_boolean (mp->can_go_next));
+  }
+
+  if (mpris_can_go (mp, FALSE) != mp->can_go_previous) {
+    mp->can_go_previous = !mp->can_go_previous;
+    mpris_queue_property (mp, "CanGoPrevious",
+        g_variant_new_boolean (mp->can_go_previous));
+  }
+}
+
+static void
+mpris_uri_opened (GstEngine * engine, gchar * uri, const GError * error,
+    MprisOpenRequest * request)
+{
+  if (error == NULL) {
+    interface_load_uri (request->mp->ui, uri);
+    engine_play (engine);
+  }
+
+  /* Only now is the call answered, with whatever came of it */
+  if (request->invocation != NULL) {
+    if (error == NULL)
+      g_dbus_method_invocation_return_value (request->invocation, NULL);
+    else
+      g_dbus_method_invocation_return_gerror (request->invocation, error);
+  }
+
+  g_free (request);
+}
+
 void
-my_object_change_uri (SnappyMP * myobj, gchar * uri)
+my_object_change_uri (SnappyMP * myobj, gchar * uri,
+    GDBusMethodInvocation * invocation)
 {
-  if (myobj != NULL)
-    myobj->uri = uri;
+  MprisOpenRequest *request;
+
+  myobj->uri = uri;
+  interface_expect_frame (myobj->ui);
 
-  engine_open_uri (myobj->engine, uri);
-  interface_load_uri (myobj->ui, uri);
-  engine_play (myobj->engine);
+  /* Discovery runs in the background so the bus keeps being served */
+  request = g_new (MprisOpenRequest, 1);
+  request->mp = myobj;
+  request->invocation = invocation;
+
+  engine_open_uri_async (myobj->engine, uri,
+      (EngineOpenFunc) mpris_uri_opened, request);
 }
 
 static void
@@ -199,12 +613,23 @@ handle_method_call (GDBusConnection * connection,
 
     // g_print ("openUri.. uri: %s\n", uri);
     g_variant_get (parameters, "(s)", &uri);
-    my_object_change_uri (myobj, uri);
+    my_object_change_uri (myobj, uri, invocation);
 
-    g_dbus_method_invocation_return_value (invocation, NULL);
+  } else if (g_strcmp0 (method_name, "Next") == 0 ||
+      g_strcmp0 (method_name, "Previous") == 0) {
+    gchar *uri;
+
+    uri = mpris_track_next_to (myobj, g_strcmp0 (method_name, "Next") == 0);
+    if (uri != NULL)
+      my_object_change_uri (myobj, uri, invocation);
+    else
+      handle_result (invocation, ret, error);
 
-  } else if (g_strcmp0 (method_name, "Next") == 0) {
-    /// ToDo: next track call
+  } else if (g_strcmp0 (method_name, "PlayPause") == 0) {
+    if (myobj->engine->playing)
+      change_state (myobj->engine, "Paused");
+    else
+      engine_play (myobj->engine);
 
     handle_result (invocation, ret, error);
 
@@ -224,16 +649,38 @@ handle_method_call (GDBusConnection * connection,
 
   } else if (g_strcmp0 (method_name, "Seek") == 0) {
     gint64 offset, position;
-    gfloat relative;
 
+    /* Offset in microseconds from the current position */
     g_variant_get (parameters, "(x)", &offset);
-    relative = offset / 100000000.0;
-    position = myobj->engine->media_duration * relative;
-    // g_print ("offset: %ld    relative: %f", offset, relative);
-    engine_seek (myobj->engine, position, FALSE);
+    position = engine_interpolate_position (myobj->engine) +
+        offset * GST_USECOND;
+    if (myobj->engine->media_duration > 0)
+      position = CLAMP (position, 0, myobj->engine->media_duration);
+    engine_seek (myobj->engine, MAX (position, 0), FALSE);
+
+    handle_result (invocation, ret, error);
+
+  } else if (g_strcmp0 (method_name, "SetPosition") == 0) {
+    const gchar *track;
+    gint64 position;
+
+    g_variant_get (parameters, "(&ox)", &track, &position);
+    position *= GST_USECOND;
+
+    /* Ignored unless it is meant for the current track and in range */
+    if (myobj->engine->uri != NULL &&
+        g_strcmp0 (mpris_track_from_path (myobj, track),
+            myobj->engine->uri) == 0 &&
+        position >= 0 && position <= myobj->engine->media_duration)
+      engine_seek (myobj->engine, position, TRUE);
 
     handle_result (invocation, ret, error);
 
+  } else {
+    g_dbus_method_invocation_return_error (invocation,
+        G_DBUS_ERROR,
+        G_DBUS_ERROR_NOT_SUPPORTED,
+        "Method %s.%s not supported", interface_name, method_name);
   }
 }
 
@@ -251,27 +698,29 @@ handle_get_property (GDBusConnection * connection,
   if (g_strcmp0 (property_name, "Name") == 0) {
     ret = g_variant_new_string (myobj->name ? myobj->name : "snappy");
   } else if (g_strcmp0 (property_name, "PlaybackStatus") == 0) {
-    ret = g_variant_new_string ("Paused");
+    ret = g_variant_new_string (myobj->playback_status);
   } else if (g_strcmp0 (property_name, "LoopStatus") == 0) {
-    ret = g_variant_new_string ("Paused");
+    ret = g_variant_new_string (myobj->loop_status);
   } else if (g_strcmp0 (property_name, "Rate") == 0) {
-    ret = g_variant_new_double (0);
+    ret = g_variant_new_double (myobj->rate);
   } else if (g_strcmp0 (property_name, "Shuffle") == 0) {
     ret = g_variant_new_boolean (FALSE);
   } else if (g_strcmp0 (property_name, "Metadata") == 0) {
-    ret = g_variant_new_array (G_VARIANT_TYPE_VARDICT, NULL, 0);
+    ret = mpris_track_metadata (myobj);
   } else if (g_strcmp0 (property_name, "Volume") == 0) {
-    ret = g_variant_new_double (0);
+    ret = g_variant_new_double (myobj->volume);
   } else if (g_strcmp0 (property_name, "Position") == 0) {
-    ret = g_variant_new_double (0);
+    /* Interpolated from the pipeline clock, in microseconds */
+    ret = g_variant_new_int64 (engine_interpolate_position (myobj->engine) /
+        GST_USECOND);
   } else if (g_strcmp0 (property_name, "MinimumRate") == 0) {
-    ret = g_variant_new_double (0);
+    ret = g_variant_new_double (MPRIS_MINIMUM_RATE);
   } else if (g_strcmp0 (property_name, "MaximumRate") == 0) {
-    ret = g_variant_new_double (0);
+    ret = g_variant_new_double (MPRIS_MAXIMUM_RATE);
   } else if (g_strcmp0 (property_name, "CanGoNext") == 0) {
-    ret = g_variant_new_boolean (TRUE);
+    ret = g_variant_new_boolean (myobj->can_go_next);
   } else if (g_strcmp0 (property_name, "CanGoPrevious") == 0) {
-    ret = g_variant_new_boolean (FALSE);
+    ret = g_variant_new_boolean (myobj->can_go_previous);
   } else if (g_strcmp0 (property_name, "CanPlay") == 0) {
     ret = g_variant_new_boolean (TRUE);
   } else if (g_strcmp0 (property_name, "CanPause") == 0) {
@@ -324,6 +773,18 @@ handle_set_property (GDBusConnection * connection,
 
     level = g_variant_get_double (value);
     engine_volume (myobj->engine, level);
+
+  } else if (g_strcmp0 (property_name, "Rate") == 0) {
+    gdouble rate;
+
+    rate = CLAMP (g_variant_get_double (value), MPRIS_MINIMUM_RATE,
+        MPRIS_MAXIMUM_RATE);
+    engine_change_speed (myobj->engine, rate);
+
+  } else if (g_strcmp0 (property_name, "LoopStatus") == 0) {
+    myobj->engine->loop =
+        g_strcmp0 (g_variant_get_string (value, NULL), "None") != 0;
+    engine_notify (myobj->engine, ENGINE_CHANGE_LOOP);
   }
 
   return TRUE;
@@ -347,8 +808,10 @@ handle_root_method_call (GDBusConnection * connection,
   }
 
   if (g_strcmp0 (method_name, "Raise") == 0) {
+    gtk_window_present (GTK_WINDOW (mp->ui->window));
     g_dbus_method_invocation_return_value (invocation, NULL);
   } else if (g_strcmp0 (method_name, "Quit") == 0) {
+    gtk_main_quit ();
     g_dbus_method_invocation_return_value (invocation, NULL);
   } else {
     g_dbus_method_invocation_return_error (invocation,
@@ -375,11 +838,11 @@ get_root_property (GDBusConnection * connection,
   }
 
   if (g_strcmp0 (property_name, "CanQuit") == 0) {
-    return g_variant_new_boolean (FALSE);
+    return g_variant_new_boolean (TRUE);
   } else if (g_strcmp0 (property_name, "CanRaise") == 0) {
-    return g_variant_new_boolean (FALSE);
+    return g_variant_new_boolean (TRUE);
   } else if (g_strcmp0 (property_name, "HasTrackList") == 0) {
-    return g_variant_new_boolean (FALSE);
+    return g_variant_new_boolean (TRUE);
   } else if (g_strcmp0 (property_name, "Identity") == 0) {
     return g_variant_new_string ("snappy");
   } else if (g_strcmp0 (property_name, "DesktopEntry") == 0) {
@@ -409,6 +872,148 @@ get_root_property (GDBusConnection * connection,
   return NULL;
 }
 
+void
+handle_tracklist_method_call (GDBusConnection * connection,
+    const char *sender,
+    const char *object_path,
+    const char *interface_name,
+    const char *method_name,
+    GVariant * parameters, GDBusMethodInvocation * invocation, SnappyMP * mp)
+{
+  GList *element;
+  gchar *uri;
+
+  if (g_strcmp0 (method_name, "GetTracksMetadata") == 0) {
+    MprisMetadataRequest *request;
+
+    request = g_new (MprisMetadataRequest, 1);
+    request->mp = mp;
+    request->invocation = invocation;
+    g_variant_get (parameters, "(ao)", &request->paths);
+    g_variant_builder_init (&request->metadata, G_VARIANT_TYPE ("aa{sv}"));
+
+    /* Answered from the cache, the first page right away */
+    if (mpris_metadata_page (request))
+      g_idle_add (mpris_metadata_page, request);
+
+  } else if (g_strcmp0 (method_name, "AddTrack") == 0) {
+    const gchar *new_uri, *after;
+    gboolean set_current;
+
+    g_variant_get (parameters, "(&s&ob)", &new_uri, &after, &set_current);
+
+    /* NoTrack means the start of the list */
+    element = NULL;
+    if (g_strcmp0 (after, MPRIS_NO_TRACK) != 0) {
+      element = g_list_find (mp->ui->uri_list,
+          mpris_track_from_path (mp, after));
+      if (element == NULL) {
+        g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+            G_DBUS_ERROR_INVALID_ARGS, "No track %s", after);
+        return;
+      }
+    }
+
+    uri = g_strdup (new_uri);
+    mp->ui->uri_list = g_list_insert_before (mp->ui->uri_list,
+        element ? element->next : mp->ui->uri_list, uri);
+
+    mpris_queue_track_signal (mp, "TrackAdded",
+        g_variant_new ("(@a{sv}@o)", mpris_metadata_for_uri (mp, uri),
+            g_variant_new_object_path (after)));
+
+    if (set_current)
+      my_object_change_uri (mp, uri, NULL);
+    mpris_update_state (mp);
+
+    g_dbus_method_invocation_return_value (invocation, NULL);
+
+  } else if (g_strcmp0 (method_name, "RemoveTrack") == 0) {
+    const gchar *path;
+
+    g_variant_get (parameters, "(&o)", &path);
+    uri = mpris_track_from_path (mp, path);
+    element = g_list_find (mp->ui->uri_list, uri);
+
+    if (element == NULL) {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+          G_DBUS_ERROR_INVALID_ARGS, "No track %s", path);
+      return;
+    }
+
+    if (uri == mp->engine->uri) {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+          G_DBUS_ERROR_ACCESS_DENIED, "Can't remove the current track");
+      return;
+    }
+
+    /* A track still being discovered is about to become the current one */
+    if (engine_is_opening (mp->engine, uri)) {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+          G_DBUS_ERROR_ACCESS_DENIED, "Can't remove a track being opened");
+      return;
+    }
+
+    mp->ui->uri_list = g_list_delete_link (mp->ui->uri_list, element);
+    mpris_queue_track_signal (mp, "TrackRemoved",
+        g_variant_new ("(o)", path));
+    mpris_forget_track (mp, uri);
+    g_free (uri);
+    mpris_update_state (mp);
+
+    g_dbus_method_invocation_return_value (invocation, NULL);
+
+  } else if (g_strcmp0 (method_name, "GoTo") == 0) {
+    const gchar *path;
+
+    g_variant_get (parameters, "(&o)", &path);
+    uri = mpris_track_from_path (mp, path);
+
+    if (g_list_find (mp->ui->uri_list, uri) == NULL) {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+          G_DBUS_ERROR_INVALID_ARGS, "No track %s", path);
+      return;
+    }
+
+    my_object_change_uri (mp, uri, invocation);
+
+  } else {
+    g_dbus_method_invocation_return_error (invocation,
+        G_DBUS_ERROR,
+        G_DBUS_ERROR_NOT_SUPPORTED,
+        "Method %s.%s not supported", interface_name, method_name);
+  }
+}
+
+GVariant *
+get_tracklist_property (GDBusConnection * connection,
+    const char *sender,
+    const char *object_path,
+    const char *interface_name,
+    const char *property_name, GError ** error, SnappyMP * mp)
+{
+  if (g_strcmp0 (property_name, "Tracks") == 0) {
+    GVariantBuilder builder;
+    GList *element;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_OBJECT_PATH_ARRAY);
+    for (element = mp->ui->uri_list; element; element = element->next)
+      g_variant_builder_add_value (&builder, mpris_track_path (mp,
+              element->data));
+
+    return g_variant_builder_end (&builder);
+
+  } else if (g_strcmp0 (property_name, "CanEditTracks") == 0) {
+    return g_variant_new_boolean (TRUE);
+  }
+
+  g_set_error (error,
+      G_DBUS_ERROR,
+      G_DBUS_ERROR_NOT_SUPPORTED,
+      "Property %s.%s not supported", interface_name, property_name);
+  return NULL;
+}
+
 static void
 on_name_acquired (GDBusConnection * connection,
     const gchar * name, gpointer user_data)
@@ -420,7 +1025,8 @@ static void
 on_name_lost (GDBusConnection * connection,
     const gchar * name, gpointer user_data)
 {
-  exit (1);
+  /* Another player holds the name; keep playing, just not over MPRIS */
+  g_warning ("unable to own %s, MPRIS control is disabled", name);
 }
 
 gboolean
@@ -431,6 +1037,27 @@ load_dlna (SnappyMP * mp)
   GDBusConnection *connection;
 
   connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+  if (connection == NULL) {
+    g_warning ("unable to connect to the session bus: %s", error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  /* Take the first snapshot before anyone can see it change */
+  mp->player_property_changes = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, (GDestroyNotify) g_variant_unref);
+  mp->property_emit_id = 0;
+  mp->track_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  mp->track_uris = g_hash_table_new (g_direct_hash, g_direct_equal);
+  mp->metadata_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) g_variant_unref);
+  mp->tracklist_signals =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+  mp->tracklist_emit_id = 0;
+  mpris_update_state (mp);
+
+  mp->connection = connection;
+  engine_set_notify (mp->engine, (EngineNotifyFunc) mpris_engine_changed, mp);
 
   /* Build the introspection data structures from the XML */
   introspection_data =
@@ -451,14 +1078,28 @@ load_dlna (SnappyMP * mp)
       MPRIS_ROOT_INTERFACE);
   mp->root_id =
       g_dbus_connection_register_object (connection, MPRIS_OBJECT_NAME,
-      ifaceinfo, &root_vtable, NULL, NULL, &error);
+      ifaceinfo, &root_vtable, mp, NULL, &error);
   if (error != NULL) {
     g_warning ("unable to register MPRIS root interface: %s", error->message);
     g_error_free (error);
+    error = NULL;
+  }
+
+  /* register track list interface */
+  ifaceinfo =
+      g_dbus_node_info_lookup_interface (introspection_data,
+      MPRIS_TRACKLIST_INTERFACE);
+  mp->tracklist_id =
+      g_dbus_connection_register_object (connection, MPRIS_OBJECT_NAME,
+      ifaceinfo, &tracklist_vtable, mp, NULL, &error);
+  if (error != NULL) {
+    g_warning ("unable to register MPRIS track list interface: %s",
+        error->message);
+    g_error_free (error);
   }
 
   mp->owner_id = g_bus_own_name (G_BUS_TYPE_SESSION,
-      "org.mpris.MediaPlayer2.snappy",
+      MPRIS_BUS_NAME,
       G_BUS_NAME_OWNER_FLAGS_NONE,
       NULL,
       (GBusNameAcquiredCallback) on_name_acquired,
@@ -470,13 +1111,85 @@ load_dlna (SnappyMP * mp)
   return TRUE;
 }
 
+gboolean
+forward_dlna (GList * uri_list)
+{
+  GDBusConnection *connection;
+  GVariant *reply, *tracks;
+  GList *l;
+  gchar *after;
+  gsize n_tracks;
+
+  connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, NULL);
+  if (connection == NULL)
+    return FALSE;
+
+  /* Fails straight away when no snappy is running to take the files */
+  reply = g_dbus_connection_call_sync (connection, MPRIS_BUS_NAME,
+      MPRIS_OBJECT_NAME, "org.freedesktop.DBus.Properties", "Get",
+      g_variant_new ("(ss)", MPRIS_TRACKLIST_INTERFACE, "Tracks"),
+      G_VARIANT_TYPE ("(v)"), G_DBUS_CALL_FLAGS_NO_AUTO_START,
+      MPRIS_FORWARD_TIMEOUT, NULL, NULL);
+  if (reply == NULL) {
+    g_object_unref (connection);
+    return FALSE;
+  }
+
+  g_variant_get (reply, "(v)", &tracks);
+  n_tracks = g_variant_n_children (tracks);
+  if (n_tracks > 0)
+    g_variant_get_child (tracks, n_tracks - 1, "o", &after);
+  else
+    after = g_strdup (MPRIS_NO_TRACK);
+  g_variant_unref (tracks);
+  g_variant_unref (reply);
+
+  /* Inserting backwards after the last track keeps the order given, and
+   * the final call, for the first file, makes it the one playing */
+  for (l = g_list_last (uri_list); l != NULL; l = l->prev) {
+    g_dbus_connection_call (connection, MPRIS_BUS_NAME, MPRIS_OBJECT_NAME,
+        MPRIS_TRACKLIST_INTERFACE, "AddTrack",
+        g_variant_new ("(sob)", l->data, after, l->prev == NULL),
+        NULL, G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, NULL, NULL);
+  }
+
+  g_dbus_connection_call (connection, MPRIS_BUS_NAME, MPRIS_OBJECT_NAME,
+      MPRIS_ROOT_INTERFACE, "Raise", NULL, NULL,
+      G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, NULL, NULL);
+
+  /* Nothing to wait for but the messages leaving this process */
+  g_dbus_connection_flush_sync (connection, NULL, NULL);
+
+  g_free (after);
+  g_object_unref (connection);
+
+  return TRUE;
+}
+
 gboolean
 close_dlna (SnappyMP * mp)
 {
+  if (mp->connection == NULL)
+    return FALSE;
+
+  engine_set_notify (mp->engine, NULL, NULL);
+  if (mp->property_emit_id != 0)
+    g_source_remove (mp->property_emit_id);
+  if (mp->tracklist_emit_id != 0)
+    g_source_remove (mp->tracklist_emit_id);
+
   g_bus_unown_name (mp->owner_id);
   g_dbus_node_info_unref (introspection_data);
   g_free (mp->name);
 
+  g_hash_table_destroy (mp->player_property_changes);
+  g_hash_table_destroy (mp->track_ids);
+  g_hash_table_destroy (mp->track_uris);
+  g_hash_table_destroy (mp->metadata_cache);
+  g_ptr_array_unref (mp->tracklist_signals);
+  g_free (mp->track_uri);
+  g_object_unref (mp->connection);
+
   return TRUE;
 }
 
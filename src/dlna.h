@@ -31,11 +31,25 @@
 
 G_BEGIN_DECLS
 #define MPRIS_BUS_NAME_PREFIX "org.mpris.MediaPlayer2"
+#define MPRIS_BUS_NAME MPRIS_BUS_NAME_PREFIX ".snappy"
 #define MPRIS_OBJECT_NAME "/org/mpris/MediaPlayer2"
 #define MPRIS_ROOT_INTERFACE "org.mpris.MediaPlayer2"
 #define MPRIS_PLAYER_INTERFACE "org.mpris.MediaPlayer2.Player"
 #define MPRIS_TRACKLIST_INTERFACE "org.mpris.MediaPlayer2.TrackList"
 #define MPRIS_PLAYLISTS_INTERFACE "org.mpris.MediaPlayer2.Playlists"
+#define MPRIS_NO_TRACK "/org/mpris/MediaPlayer2/TrackList/NoTrack"
+#define MPRIS_TRACK_PATH "/org/snappy/Track"
+
+/* Most entries GetTracksMetadata looks up per main loop iteration */
+#define MPRIS_METADATA_PAGE 500
+/* More queued track signals than this are sent as TrackListReplaced */
+#define MPRIS_TRACKLIST_BATCH 16
+
+/* How long a new invocation waits on the running instance, in ms */
+#define MPRIS_FORWARD_TIMEOUT 1000
+
+#define MPRIS_MINIMUM_RATE 0.1
+#define MPRIS_MAXIMUM_RATE 4.0
 
 typedef struct _SnappyMP SnappyMP;
 struct _SnappyMP
@@ -48,6 +62,7 @@ struct _SnappyMP
   guint root_id;
   guint player_id;
   guint playlists_id;
+  guint tracklist_id;
   guint owner_id;
 
   int playlist_count;
@@ -60,6 +75,23 @@ struct _SnappyMP
 
   gchar *uri;
 
+  /* Last player state published to MPRIS clients */
+  const gchar *playback_status;
+  const gchar *loop_status;
+  gdouble rate, volume;
+  gint64 length;
+  gchar *track_uri;
+  gboolean can_go_next, can_go_previous;
+
+  /* Playlist entries are identified by their uri string in ui->uri_list */
+  GHashTable *track_ids;
+  GHashTable *track_uris;
+  GHashTable *metadata_cache;
+  guint next_track_id;
+
+  GPtrArray *tracklist_signals;
+  guint tracklist_emit_id;
+
   GstEngine *engine;
   UserInterface *ui;
 };
@@ -80,6 +112,7 @@ enum
 // Declaration of non-static functions
 gboolean load_dlna (SnappyMP * mp_obj);
 gboolean close_dlna (SnappyMP * mp_obj);
+gboolean forward_dlna (GList * uri_list);
 
 void handle_method_call (GDBusConnection * connection,
     const gchar * sender,
@@ -115,6 +148,19 @@ GVariant *get_root_property (GDBusConnection * connection,
     const char *interface_name,
     const char *property_name, GError ** error, SnappyMP * mp);
 
+void handle_tracklist_method_call (GDBusConnection * connection,
+    const char *sender,
+    const char *object_path,
+    const char *interface_name,
+    const char *method_name,
+    GVariant * parameters, GDBusMethodInvocation * invocation, SnappyMP * mp);
+
+GVariant *get_tracklist_property (GDBusConnection * connection,
+    const char *sender,
+    const char *object_path,
+    const char *interface_name,
+    const char *property_name, GError ** error, SnappyMP * mp);
+
 
 G_END_DECLS
 #endif /* __DLNA_H__ */
@@ -26,6 +26,7 @@
 
 #include "user_interface.h"
 #include "gst_engine.h"
+#include "timings.h"
 #include "utils.h"
 
 #define SAVE_POSITION_MIN_DURATION 300 * 1000   // don't save >5 minute files
@@ -33,6 +34,16 @@
 
 #define RECENTLY_VIEWED_MAX 50
 
+#define DISCOVER_TIMEOUT 10
+
+typedef struct
+{
+  gchar *uri;
+  EngineOpenFunc func;
+  gpointer data;
+  gint64 queued;
+} OpenRequest;
+
 GST_DEBUG_CATEGORY_STATIC (_snappy_gst_debug);
 #define GST_CAT_DEFAULT _snappy_gst_debug
 
@@ -59,14 +70,21 @@ typedef enum
 gboolean add_uri_to_history (gchar * uri);
 gboolean add_uri_unfinished_playback (GstEngine * engine, gchar * uri,
     gint64 position);
+static gboolean can_seek_bytes (GstEngine * engine);
 gboolean discover (GstEngine * engine, gchar * uri);
+static void discover_apply (GstEngine * engine, GstDiscovererInfo * info);
+static void discovered_cb (GstDiscoverer * dc, GstDiscovererInfo * info,
+    GError * error, GstEngine * engine);
 static void handle_element_message (GstEngine * engine, GstMessage * msg);
+static void index_ready (KeyframeIndex * index, GstEngine * engine);
+static void index_reset (GstEngine * engine);
 gboolean is_stream_seakable (GstEngine * engine);
 gint64 is_uri_unfinished_playback (GstEngine * engine, gchar * uri);
-static void print_tag (const GstTagList * list, const gchar * tag,
-    gpointer unused);
 void remove_uri_unfinished_playback (GstEngine * engine, gchar * uri);
 void stream_done (GstEngine * engine, UserInterface * ui);
+static gboolean volume_changed (gpointer data);
+static void volume_notify_cb (GObject * player, GParamSpec * pspec,
+    GstEngine * engine);
 static void write_key_file_to_file (GKeyFile * keyfile, const char *path);
 
 /* -------------------- static functions --------------------- */
@@ -178,20 +196,32 @@ add_uri_unfinished_playback (GstEngine * engine, gchar * uri, gint64 position)
 }
 
 
+/* Query if the current stream can be seeked to a byte offset */
+static gboolean
+can_seek_bytes (GstEngine * engine)
+{
+  GstQuery *query;
+  gboolean res = FALSE;
+
+  query = gst_query_new_seeking (GST_FORMAT_BYTES);
+  if (gst_element_query (engine->player, query))
+    gst_query_parse_seeking (query, NULL, &res, NULL, NULL);
+  gst_query_unref (query);
+
+  return res;
+}
+
+
 /* Discover URI's properties: duration and dimensions */
 gboolean
 discover (GstEngine * engine, gchar * uri)
 {
-  gint timeout = 10;
   GstDiscoverer *dc;
   GstDiscovererInfo *info;
-  GstDiscovererVideoInfo *v_info;
   GError *error = NULL;
-  GList *list;
-  GstPlayFlags flags;
 
   /* new GST Discoverer */
-  dc = gst_discoverer_new (timeout * GST_SECOND, &error);
+  dc = gst_discoverer_new (DISCOVER_TIMEOUT * GST_SECOND, &error);
   if (G_UNLIKELY (error)) {
     GST_WARNING ("Error in GST Discoverer initializing: %s\n", error->message);
     g_error_free (error);
@@ -200,11 +230,29 @@ discover (GstEngine * engine, gchar * uri)
 
   /* Discover URI */
   info = gst_discoverer_discover_uri (dc, uri, &error);
+  g_object_unref (dc);
   if (G_UNLIKELY (error)) {
     GST_WARNING ("Error discovering URI: %s\n", error->message);
     g_error_free (error);
+    if (info)
+      gst_discoverer_info_unref (info);
     return FALSE;
   }
+
+  discover_apply (engine, info);
+  gst_discoverer_info_unref (info);
+
+  return TRUE;
+}
+
+/* Take duration, dimensions and streams from discovered info */
+static void
+discover_apply (GstEngine * engine, GstDiscovererInfo * info)
+{
+  GstDiscovererVideoInfo *v_info;
+  GList *list;
+  GstPlayFlags flags;
+
   /* Check if it has a video stream */
   list = gst_discoverer_info_get_video_streams (info);
   engine->has_video = (g_list_length (list) > 0);
@@ -236,10 +284,47 @@ discover (GstEngine * engine, gchar * uri)
     g_object_set (G_OBJECT (engine->player), "flags",
         flags | GST_PLAY_FLAG_VIS, NULL);
   }
+}
 
-  gst_discoverer_info_unref (info);
+/* Finish opening an URI once the discoverer is done with it */
+static void
+discovered_cb (GstDiscoverer * dc, GstDiscovererInfo * info, GError * error,
+    GstEngine * engine)
+{
+  OpenRequest *request;
+
+  /* Results arrive in the order the URIs were queued */
+  request = g_queue_pop_head (&engine->open_requests);
+  if (request == NULL)
+    return;
+
+  if (error == NULL) {
+    open_trace_begin (engine->open_trace, request->uri, request->queued,
+        !engine->secret);
+    open_trace_step (engine->open_trace, OPEN_STEP_DISCOVERED);
+
+    engine->uri = request->uri;
+    engine->position_anchor = 0;
+    engine->clock_anchor = GST_CLOCK_TIME_NONE;
+    engine->qos_count = 0;
+    engine->qos_jitter = 0;
+    engine->qos_dropped = 0;
+    index_reset (engine);
+
+    g_print ("Open uri: %s\n", request->uri);
+    gst_element_set_state (engine->player, GST_STATE_READY);
+    open_trace_step (engine->open_trace, OPEN_STEP_READY);
+    g_object_set (G_OBJECT (engine->player), "uri", request->uri, NULL);
+
+    discover_apply (engine, info);
+    engine_notify (engine, ENGINE_CHANGE_URI);
+  } else {
+    GST_WARNING ("Error discovering URI: %s", error->message);
+  }
 
-  return TRUE;
+  if (request->func)
+    request->func (engine, request->uri, error, request->data);
+  g_free (request);
 }
 
 /* Handle GST_ELEMENT_MESSAGEs */
@@ -264,6 +349,40 @@ handle_element_message (GstEngine * engine, GstMessage * msg)
   }
 }
 
+/* Take over a keyframe index built in the background */
+static void
+index_ready (KeyframeIndex * index, GstEngine * engine)
+{
+  engine->indexer = NULL;
+  if (index == NULL)
+    return;
+
+  if (engine->index)
+    keyframe_index_free (engine->index);
+  engine->index = index;
+
+  g_print ("Keyframe index ready: %u entries\n",
+      keyframe_index_get_size (index));
+}
+
+/* Drop the index of the previous URI and load the cached one, if any */
+static void
+index_reset (GstEngine * engine)
+{
+  if (engine->indexer) {
+    keyframe_indexer_cancel (engine->indexer);
+    engine->indexer = NULL;
+  }
+
+  if (engine->index) {
+    keyframe_index_free (engine->index);
+    engine->index = NULL;
+  }
+
+  if (engine->uri)
+    engine->index = keyframe_index_load (engine->uri);
+}
+
 /* Query if the current stream is seakable */
 gboolean
 is_stream_seakable (GstEngine * engine)
@@ -317,36 +436,6 @@ is_uri_unfinished_playback (GstEngine * engine, gchar * uri)
 }
 
 
-/*  Print message tags from elements  */
-static void
-print_tag (const GstTagList * list, const gchar * tag, gpointer unused)
-{
-  gint i, count;
-
-  count = gst_tag_list_get_tag_size (list, tag);
-
-  for (i = 0; i < count; i++) {
-    gchar *str;
-
-    if (gst_tag_get_type (tag) == G_TYPE_STRING) {
-      if (!gst_tag_list_get_string_index (list, tag, i, &str))
-        g_assert_not_reached ();
-    } else {
-      str =
-          g_strdup_value_contents (gst_tag_list_get_value_index (list, tag, i));
-    }
-
-    if (i == 0) {
-      g_print ("  %15s: %s\n", gst_tag_get_nick (tag), str);
-    } else {
-      g_print ("                 : %s\n", str);
-    }
-
-    g_free (str);
-  }
-}
-
-
 /*    Remove URI from unfinished playback list   */
 void
 remove_uri_unfinished_playback (GstEngine * engine, gchar * uri)
@@ -412,6 +501,21 @@ stream_done (GstEngine * engine, UserInterface * ui)
   }
 }
 
+static gboolean
+volume_changed (gpointer data)
+{
+  engine_notify ((GstEngine *) data, ENGINE_CHANGE_VOLUME);
+
+  return FALSE;
+}
+
+static void
+volume_notify_cb (GObject * player, GParamSpec * pspec, GstEngine * engine)
+{
+  /* The sink may change the volume from its own thread */
+  g_idle_add (volume_changed, engine);
+}
+
 static void
 write_key_file_to_file (GKeyFile * keyfile, const char *path)
 {
@@ -481,6 +585,33 @@ bus_call (GstBus * bus, GstMessage * msg, gpointer data)
 
       GST_DEBUG ("State changed");
       gst_message_parse_state_changed (msg, &old, &new, &pending);
+
+      /* Re-anchor the interpolated position on pipeline state changes */
+      if (GST_MESSAGE_SRC (msg) == GST_OBJECT (engine->player) &&
+          (new == GST_STATE_PLAYING || new == GST_STATE_PAUSED)) {
+        engine_sync_position (engine);
+        interface_update_controls (ui);
+      }
+
+      if (GST_MESSAGE_SRC (msg) == GST_OBJECT (engine->player) && old != new)
+        engine_notify (engine, ENGINE_CHANGE_STATE);
+
+      /* The first time this happens is the end of startup's preroll */
+      if (GST_MESSAGE_SRC (msg) == GST_OBJECT (engine->player) &&
+          new == GST_STATE_PAUSED) {
+        timings_end ("preroll");
+        open_trace_step (engine->open_trace, OPEN_STEP_PREROLLED);
+      }
+
+      /* Without video there is no first frame to wait for */
+      if (GST_MESSAGE_SRC (msg) == GST_OBJECT (engine->player) &&
+          new == GST_STATE_PLAYING && !engine->has_video) {
+        open_trace_finish (engine->open_trace);
+        timings_mark ("playing");
+        if (timings_finish ())
+          gtk_main_quit ();
+      }
+
       if (new == GST_STATE_PLAYING) {
         /* If loading file */
         if (!engine->has_started) {
@@ -512,20 +643,7 @@ bus_call (GstBus * bus, GstMessage * msg, gpointer data)
 
     case GST_MESSAGE_TAG:
     {
-      GstTagList *tags;
-
       GST_DEBUG ("Tag received");
-      if (ui->tags) {
-        gst_message_parse_tag (msg, &tags);
-        if (tags) {
-          g_print ("%s\n",
-              GST_STR_NULL (GST_ELEMENT_NAME (GST_MESSAGE_SRC (msg))));
-
-          gst_tag_list_foreach (tags, print_tag, NULL);
-          gst_tag_list_free (tags);
-          tags = NULL;
-        }
-      }
       break;
     }
 
@@ -533,6 +651,7 @@ bus_call (GstBus * bus, GstMessage * msg, gpointer data)
     {
       GST_DEBUG ("End of stream");
       stream_done (engine, ui);
+      engine_notify (engine, ENGINE_CHANGE_STATE);
 
       break;
     }
@@ -549,19 +668,68 @@ bus_call (GstBus * bus, GstMessage * msg, gpointer data)
     {
       GST_DEBUG ("Step done");
       engine->prev_done = TRUE;
+      engine_sync_position (engine);
       break;
     }
 
     case GST_MESSAGE_ASYNC_DONE:
       GST_DEBUG ("Async done");
       engine->queries_blocked = FALSE;
+      engine_sync_position (engine);
+      interface_update_controls (ui);
+
+      if (engine->seeking) {
+        engine->seeking = FALSE;
+
+        /* Slow to seek, index the keyframes so the next seeks are not.
+         * The index is only any use through byte seeks, which tsdemux,
+         * matroskademux and qtdemux refuse, so TS and MKV files gain
+         * nothing and aren't indexed */
+        if (g_get_monotonic_time () - engine->seek_start >
+            KEYFRAME_INDEX_SLOW_SEEK && engine->uri && !engine->index &&
+            !engine->indexer && can_seek_bytes (engine)) {
+          GST_DEBUG ("Slow seek, building a keyframe index");
+          engine->indexer = keyframe_indexer_start (engine->uri,
+              (KeyframeIndexFunc) index_ready, engine);
+        }
+
+        engine_notify (engine, ENGINE_CHANGE_SEEKED);
+      }
       break;
 
     case GST_MESSAGE_DURATION:
     {
       GST_DEBUG ("Message duration received");
       update_media_duration (engine);
+      engine_notify (engine, ENGINE_CHANGE_DURATION);
+
+      break;
+    }
 
+    case GST_MESSAGE_QOS:
+    {
+      /* Playback is running late, hover previews back off for a while */
+      if (ui->seek_preview != NULL)
+        seek_preview_report_qos (ui->seek_preview);
+
+      /* How late video is against the clock, which audio drives */
+      engine->qos_count++;
+      if (GST_MESSAGE_SRC (msg) == GST_OBJECT (engine->sink)) {
+        GstFormat format;
+        guint64 dropped;
+
+        gst_message_parse_qos_values (msg, &engine->qos_jitter, NULL, NULL);
+        /* The sink's own count of the frames it dropped so far */
+        gst_message_parse_qos_stats (msg, &format, NULL, &dropped);
+        if (format == GST_FORMAT_BUFFERS)
+          engine->qos_dropped = dropped;
+      }
+      break;
+    }
+
+    case GST_MESSAGE_BUFFERING:
+    {
+      gst_message_parse_buffering (msg, &engine->buffering);
       break;
     }
 
@@ -614,6 +782,11 @@ bus_call (GstBus * bus, GstMessage * msg, gpointer data)
         }
       }
 
+      /* Startup ends here if it never got to a frame */
+      timings_mark ("error");
+      if (timings_finish ())
+        gtk_main_quit ();
+
       break;
     }
 
@@ -736,6 +909,7 @@ engine_init (GstEngine * engine, ClutterGstVideoSink * sink)
   engine->loop = FALSE;
   engine->secret = FALSE;
   engine->queries_blocked = TRUE;
+  engine->seeking = FALSE;
 
   engine->media_width = 600;
   engine->media_height = 400;
@@ -744,7 +918,27 @@ engine_init (GstEngine * engine, ClutterGstVideoSink * sink)
   engine->av_offset = 0;
   engine->rate = 1.0;
 
+  engine->position_anchor = 0;
+  engine->clock_anchor = GST_CLOCK_TIME_NONE;
+
+  engine->qos_count = 0;
+  engine->qos_jitter = 0;
+  engine->qos_dropped = 0;
+  engine->buffering = 100;
+
   engine->uri = NULL;
+  engine->seek_start = 0;
+
+  engine->discoverer = NULL;
+  g_queue_init (&engine->open_requests);
+
+  engine->index = NULL;
+  engine->indexer = NULL;
+
+  engine->open_trace = NULL;
+
+  engine->notify_func = NULL;
+  engine->notify_data = NULL;
 
   gchar *version_str;
 
@@ -765,10 +959,16 @@ engine_init (GstEngine * engine, ClutterGstVideoSink * sink)
   g_object_set (G_OBJECT (engine->player), "video-sink", engine->sink, NULL);
   engine->bus = gst_pipeline_get_bus (GST_PIPELINE (engine->player));
 
+  /* Follow every URI open through the elements playbin creates for it */
+  engine->open_trace = open_trace_new (engine->player);
+
   engine->navigation =
       GST_NAVIGATION (gst_bin_get_by_interface (GST_BIN (engine->player),
           GST_TYPE_NAVIGATION));
 
+  g_signal_connect (engine->player, "notify::volume",
+      G_CALLBACK (volume_notify_cb), engine);
+
   return TRUE;
 }
 
@@ -803,22 +1003,75 @@ engine_change_speed (GstEngine * engine, gdouble rate)
   gst_element_send_event (engine->player, seek_event);
 
   engine->rate = rate;
+  engine_notify (engine, ENGINE_CHANGE_RATE);
 
   return TRUE;
 }
 
+/*     Playback position without a pipeline query    */
+gint64
+engine_interpolate_position (GstEngine * engine)
+{
+  gint64 position;
+  GstClock *clock;
+
+  position = engine->position_anchor;
+
+  /* Advance the last known position with the pipeline clock */
+  if (GST_CLOCK_TIME_IS_VALID (engine->clock_anchor)) {
+    clock = gst_element_get_clock (engine->player);
+    if (clock) {
+      position += (gst_clock_get_time (clock) - engine->clock_anchor) *
+          engine->rate;
+      gst_object_unref (clock);
+    }
+  }
+
+  if (engine->media_duration > 0)
+    position = CLAMP (position, 0, engine->media_duration);
+
+  return position;
+}
+
+/*  Whether an URI is waiting on the discoverer  */
+gboolean
+engine_is_opening (GstEngine * engine, const gchar * uri)
+{
+  GList *l;
+
+  /* Requests hold the caller's string, which must outlive discovery */
+  for (l = engine->open_requests.head; l != NULL; l = l->next)
+    if (((OpenRequest *) l->data)->uri == uri)
+      return TRUE;
+
+  return FALSE;
+}
+
+
 /*               Load URI to engine              */
 void
 engine_load_uri (GstEngine * engine, gchar * uri)
 {
   engine->uri = uri;
+  engine->position_anchor = 0;
+  engine->clock_anchor = GST_CLOCK_TIME_NONE;
+  engine->qos_count = 0;
+  engine->qos_jitter = 0;
+  engine->qos_dropped = 0;
+  index_reset (engine);
 
   /* Loading a new URI means we haven't started playing this URI yet */
   engine->has_started = FALSE;
   engine->queries_blocked = TRUE;
 
   if (uri) {
+    open_trace_begin (engine->open_trace, uri, g_get_monotonic_time (),
+        !engine->secret);
+
+    timings_begin ("discover");
     discover (engine, uri);
+    timings_end ("discover");
+    open_trace_step (engine->open_trace, OPEN_STEP_DISCOVERED);
 
     g_print ("Loading: %s\n", uri);
     g_object_set (G_OBJECT (engine->player), "uri", uri, NULL);
@@ -827,27 +1080,94 @@ engine_load_uri (GstEngine * engine, gchar * uri)
         "You can drag and drop a file into snappy to play it.");
   }
 
+  engine_notify (engine, ENGINE_CHANGE_URI);
+
   return;
 }
 
 
+/*        Tell the listener what has changed      */
+void
+engine_notify (GstEngine * engine, EngineChange change)
+{
+  if (engine->notify_func)
+    engine->notify_func (engine, change, engine->notify_data);
+}
+
+
 /*               Open Uri in engine              */
 void
 engine_open_uri (GstEngine * engine, gchar * uri)
 {
   /* Need to set back to Ready state so Playbin loads uri */
   engine->uri = uri;
+  engine->position_anchor = 0;
+  engine->clock_anchor = GST_CLOCK_TIME_NONE;
+  engine->qos_count = 0;
+  engine->qos_jitter = 0;
+  engine->qos_dropped = 0;
+  index_reset (engine);
 
   g_print ("Open uri: %s\n", uri);
+  open_trace_begin (engine->open_trace, uri, g_get_monotonic_time (),
+      !engine->secret);
   gst_element_set_state (engine->player, GST_STATE_READY);
+  open_trace_step (engine->open_trace, OPEN_STEP_READY);
   g_object_set (G_OBJECT (engine->player), "uri", uri, NULL);
 
   discover (engine, uri);
+  open_trace_step (engine->open_trace, OPEN_STEP_DISCOVERED);
+
+  engine_notify (engine, ENGINE_CHANGE_URI);
 
   return;
 }
 
 
+/*     Open Uri without blocking the main loop    */
+void
+engine_open_uri_async (GstEngine * engine, gchar * uri, EngineOpenFunc func,
+    gpointer data)
+{
+  OpenRequest *request;
+  GError *error = NULL;
+
+  /* One discoverer running in the background serves every request */
+  if (engine->discoverer == NULL) {
+    engine->discoverer =
+        gst_discoverer_new (DISCOVER_TIMEOUT * GST_SECOND, &error);
+    if (engine->discoverer == NULL) {
+      if (func)
+        func (engine, uri, error, data);
+      g_error_free (error);
+      return;
+    }
+
+    g_signal_connect (engine->discoverer, "discovered",
+        G_CALLBACK (discovered_cb), engine);
+    gst_discoverer_start (engine->discoverer);
+  }
+
+  request = g_new (OpenRequest, 1);
+  request->uri = uri;
+  request->func = func;
+  request->data = data;
+  request->queued = g_get_monotonic_time ();
+  g_queue_push_tail (&engine->open_requests, request);
+
+  if (!gst_discoverer_discover_uri_async (engine->discoverer, uri)) {
+    g_queue_pop_tail (&engine->open_requests);
+    g_free (request);
+
+    g_set_error (&error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_FAILED,
+        "Unable to queue %s for discovery", uri);
+    if (func)
+      func (engine, uri, error, data);
+    g_error_free (error);
+  }
+}
+
+
 /*                  Set to Playing               */
 gboolean
 engine_play (GstEngine * engine)
@@ -867,13 +1187,41 @@ engine_play (GstEngine * engine)
 }
 
 
+/*    Load decoding plugins ahead of first use   */
+guint
+engine_preload (GstEngine * engine)
+{
+  GList *factories, *l;
+  GstPluginFeature *feature;
+  guint count = 0;
+
+  /* Demuxers, parsers and decoders are what playbin plugs on open */
+  factories =
+      gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_DECODABLE,
+      GST_RANK_MARGINAL);
+
+  for (l = factories; l != NULL; l = l->next) {
+    feature = gst_plugin_feature_load (GST_PLUGIN_FEATURE (l->data));
+    if (feature != NULL) {
+      gst_object_unref (feature);
+      count++;
+    }
+  }
+  gst_plugin_feature_list_free (factories);
+
+  return count;
+}
+
+
 /*            Seek engine to position            */
 gboolean
 engine_seek (GstEngine * engine, gint64 position, gboolean accurate)
 {
-  gboolean ok;
+  gboolean ok = FALSE;
   GstFormat fmt = GST_FORMAT_TIME;
   GstSeekFlags flags;
+  GstClockTime keyframe;
+  guint64 offset;
 
   if (accurate) {
     flags =
@@ -883,14 +1231,77 @@ engine_seek (GstEngine * engine, gint64 position, gboolean accurate)
         GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_SEGMENT | GST_SEEK_FLAG_KEY_UNIT;
   }
 
-  ok = gst_element_seek_simple (engine->player, fmt, flags, position);
+  engine->seek_start = g_get_monotonic_time ();
+
+  /* Straight to the keyframe's spot in the file when it's been indexed.
+   * Byte seeks can only land on a keyframe, so accurate seeks don't use
+   * the index and are no faster with it */
+  if (!accurate && engine->index && keyframe_index_lookup (engine->index,
+          position, &keyframe, &offset)) {
+    ok = gst_element_seek (engine->player, 1.0, GST_FORMAT_BYTES,
+        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_SEGMENT, GST_SEEK_TYPE_SET,
+        offset, GST_SEEK_TYPE_NONE, -1);
+    if (ok) {
+      GST_DEBUG ("Byte seek to %" G_GUINT64_FORMAT, offset);
+      position = keyframe;
+    }
+  }
+
+  if (!ok)
+    ok = gst_element_seek_simple (engine->player, fmt, flags, position);
 
   engine->queries_blocked = TRUE;
 
+  /* Hold the target until the seek is done and the position is re-synced */
+  engine->position_anchor = position;
+  engine->clock_anchor = GST_CLOCK_TIME_NONE;
+  engine->seeking = ok;
+
   return ok;
 }
 
 
+/*        Set who gets told about changes         */
+void
+engine_set_notify (GstEngine * engine, EngineNotifyFunc func, gpointer data)
+{
+  engine->notify_func = func;
+  engine->notify_data = data;
+}
+
+
+/*        Suspend or resume video decoding       */
+gboolean
+engine_set_video_enabled (GstEngine * engine, gboolean enabled)
+{
+  gint flags;
+
+  /* Without an audio track there would be nothing left to play */
+  if (!enabled && (!engine->has_video || !engine->has_audio))
+    return FALSE;
+
+  g_object_get (G_OBJECT (engine->player), "flags", &flags, NULL);
+  if (((flags & GST_PLAY_FLAG_VIDEO) != 0) == enabled)
+    return TRUE;
+
+  if (enabled)
+    flags |= GST_PLAY_FLAG_VIDEO;
+  else
+    flags &= ~GST_PLAY_FLAG_VIDEO;
+  g_object_set (G_OBJECT (engine->player), "flags", flags, NULL);
+
+  g_print ("%s video\n", enabled ? "Resuming" : "Suspending");
+
+  /* Decode from the previous keyframe to bring video back in sync */
+  if (enabled && engine->has_started) {
+    engine_seek (engine, engine_interpolate_position (engine), TRUE);
+    engine->seeking = FALSE;
+  }
+
+  return TRUE;
+}
+
+
 /*                 Stop playback                 */
 gboolean
 engine_stop (GstEngine * engine)
@@ -909,6 +1320,30 @@ engine_stop (GstEngine * engine)
 }
 
 
+/*   Anchor interpolated position to the pipeline  */
+void
+engine_sync_position (GstEngine * engine)
+{
+  gint64 position;
+  GstClock *clock;
+
+  if (!gst_element_query_position (engine->player, GST_FORMAT_TIME, &position))
+    return;
+
+  engine->position_anchor = position;
+  engine->clock_anchor = GST_CLOCK_TIME_NONE;
+
+  /* Only a running pipeline advances, a paused one holds its position */
+  if (GST_STATE (engine->player) == GST_STATE_PLAYING) {
+    clock = gst_element_get_clock (engine->player);
+    if (clock) {
+      engine->clock_anchor = gst_clock_get_time (clock);
+      gst_object_unref (clock);
+    }
+  }
+}
+
+
 /*                   Set volume                  */
 void
 engine_volume (GstEngine * engine, gdouble level)
@@ -24,15 +24,38 @@
 #define __GST_ENGINE_H__
 
 #include <gst/gst.h>
+#include <gst/pbutils/pbutils.h>
 #include <clutter-gst/clutter-gst.h>
 
 /* GStreamer Interfaces */
 #include <gst/video/navigation.h>
 
+#include "keyframe_index.h"
+#include "open_trace.h"
+
 G_BEGIN_DECLS
 
 typedef struct _GstEngine GstEngine;
 
+/* What changed when the engine notifies its listener */
+typedef enum
+{
+  ENGINE_CHANGE_STATE = 1 << 0,
+  ENGINE_CHANGE_URI = 1 << 1,
+  ENGINE_CHANGE_DURATION = 1 << 2,
+  ENGINE_CHANGE_RATE = 1 << 3,
+  ENGINE_CHANGE_LOOP = 1 << 4,
+  ENGINE_CHANGE_VOLUME = 1 << 5,
+  ENGINE_CHANGE_SEEKED = 1 << 6
+} EngineChange;
+
+typedef void (*EngineNotifyFunc) (GstEngine * engine, EngineChange change,
+    gpointer data);
+
+/* Called once an asynchronously opened URI is loaded, or failed to */
+typedef void (*EngineOpenFunc) (GstEngine * engine, gchar * uri,
+    const GError * error, gpointer data);
+
 struct _GstEngine
 {
   gboolean playing, direction_foward, prev_done;
@@ -41,6 +64,7 @@ struct _GstEngine
   gboolean loop;
   gboolean secret;
   gboolean queries_blocked;
+  gboolean seeking;
 
   guint media_width, media_height;
   gint64 media_duration;
@@ -48,6 +72,16 @@ struct _GstEngine
   gint64 av_offset;
   gdouble rate;
 
+  gint64 position_anchor;
+  GstClockTime clock_anchor;
+  gint64 seek_start;
+
+  /* From QoS and buffering messages, for the statistics overlay */
+  guint qos_count;
+  gint64 qos_jitter;
+  guint64 qos_dropped;
+  gint buffering;
+
   gchar *uri;
 
   GstElement *player;
@@ -56,6 +90,17 @@ struct _GstEngine
   GstBus *bus;
 
   GstNavigation *navigation;
+
+  GstDiscoverer *discoverer;
+  GQueue open_requests;
+
+  KeyframeIndex *index;
+  KeyframeIndexer *indexer;
+
+  OpenTrace *open_trace;
+
+  EngineNotifyFunc notify_func;
+  gpointer notify_data;
 };
 
 // Declaration of non-static functions
@@ -68,11 +113,21 @@ gboolean cycle_streams (GstEngine * engine, guint streamid);
 gboolean engine_init (GstEngine * engine, ClutterGstVideoSink * sink);
 gboolean engine_change_offset (GstEngine * engine, gint64 av_offest);
 gboolean engine_change_speed (GstEngine * engine, gdouble rate);
+gint64 engine_interpolate_position (GstEngine * engine);
+gboolean engine_is_opening (GstEngine * engine, const gchar * uri);
 void engine_load_uri (GstEngine * engine, gchar * uri);
+void engine_notify (GstEngine * engine, EngineChange change);
 void engine_open_uri (GstEngine * engine, gchar * uri);
+void engine_open_uri_async (GstEngine * engine, gchar * uri,
+    EngineOpenFunc func, gpointer data);
 gboolean engine_play (GstEngine * engine);
+guint engine_preload (GstEngine * engine);
 gboolean engine_seek (GstEngine * engine, gint64 position, gboolean accurate);
+void engine_set_notify (GstEngine * engine, EngineNotifyFunc func,
+    gpointer data);
+gboolean engine_set_video_enabled (GstEngine * engine, gboolean enabled);
 gboolean engine_stop (GstEngine * engine);
+void engine_sync_position (GstEngine * engine);
 void engine_volume (GstEngine * engine, gdouble level);
 gboolean frame_stepping (GstEngine * engine, gboolean foward);
 gchar **get_recently_viewed ();
@@ -0,0 +1,599 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "keyframe_index.h"
+
+/* Formats without an index of their own (MPEG-TS/PS, raw elementary streams,
+ * some AVI and Matroska files) make the demuxer bisect for every seek. The
+ * index built here maps the stream time of the keyframes of a file to the
+ * byte offset they were read from, so seeks can go straight to the right
+ * spot in the file. It is built by a parse-only pipeline on its own thread
+ * and cached under ~/.cache/snappy/index/ for the next time.
+ *
+ * Only players that take byte seeks can use it. tsdemux, matroskademux and
+ * qtdemux only seek in time, so MPEG-TS, Matroska and MP4 files are not
+ * helped, and the engine doesn't start an indexer for them. Accurate seeks
+ * stay in time and never use the index either. */
+
+#define INDEX_MAGIC "SNPI"
+#define INDEX_VERSION 1
+/* magic, version, file size, file mtime and number of entries */
+#define INDEX_HEADER_SIZE (4 + 4 + 8 + 8 + 4)
+#define INDEX_ENTRY_SIZE (8 + 8)
+
+/* How often the builder checks whether it was cancelled */
+#define INDEXER_POLL (100 * GST_MSECOND)
+
+// Values of decodebin's GstAutoplugSelectResult, copied here as the enum
+// is not public.
+typedef enum
+{
+  AUTOPLUG_SELECT_TRY,
+  AUTOPLUG_SELECT_EXPOSE,
+  AUTOPLUG_SELECT_SKIP
+} AutoplugSelectResult;
+
+typedef struct
+{
+  GstClockTime time;
+  guint64 offset;
+} IndexEntry;
+
+struct _KeyframeIndex
+{
+  GArray *entries;
+};
+
+struct _KeyframeIndexer
+{
+  gchar *uri;
+  gint cancelled;
+
+  GMutex lock;
+  guint64 offset, read_offset;
+  GstElement *indexed;
+  GstPad *stream_pad;
+  gboolean video, deltas;
+  GArray *entries;
+
+  KeyframeIndex *index;
+  KeyframeIndexFunc func;
+  gpointer data;
+};
+
+// Declaration of static functions
+static AutoplugSelectResult autoplug_select_cb (GstElement * bin,
+    GstPad * pad, GstCaps * caps, GstElementFactory * factory,
+    gpointer data);
+static gpointer build_index (KeyframeIndexer * indexer);
+static gboolean deliver_index (KeyframeIndexer * indexer);
+static void element_added_cb (GstBin * bin, GstElement * element,
+    KeyframeIndexer * indexer);
+static gboolean file_stamp (const gchar * uri, guint64 * size,
+    guint64 * mtime);
+static gchar *index_path (const gchar * uri);
+static void indexer_free (KeyframeIndexer * indexer);
+static GstPadProbeReturn keyframe_probe_cb (GstPad * pad,
+    GstPadProbeInfo * info, KeyframeIndexer * indexer);
+static void pad_added_cb (GstElement * element, GstPad * pad,
+    GstElement * pipeline);
+static guint32 read_uint32 (const gchar * data);
+static guint64 read_uint64 (const gchar * data);
+static void save_index (const gchar * uri, GArray * entries);
+static GstPadProbeReturn source_probe_cb (GstPad * pad,
+    GstPadProbeInfo * info, KeyframeIndexer * indexer);
+static void stream_pad_added_cb (GstElement * element, GstPad * pad,
+    KeyframeIndexer * indexer);
+
+/* ---------------------- static functions ----------------------- */
+
+static AutoplugSelectResult
+autoplug_select_cb (GstElement * bin, GstPad * pad, GstCaps * caps,
+    GstElementFactory * factory, gpointer data)
+{
+  const gchar *klass;
+
+  // Demux and parse, but stop short of decoding anything
+  klass = gst_element_factory_get_metadata (factory,
+      GST_ELEMENT_METADATA_KLASS);
+  if (klass != NULL && strstr (klass, "Decoder") != NULL)
+    return AUTOPLUG_SELECT_EXPOSE;
+
+  return AUTOPLUG_SELECT_TRY;
+}
+
+static gpointer
+build_index (KeyframeIndexer * indexer)
+{
+  GstElement *pipeline, *source, *decodebin;
+  GstPad *pad;
+  GstBus *bus;
+  GstMessage *msg;
+  gchar *filename;
+  gboolean done = FALSE;
+
+  filename = g_filename_from_uri (indexer->uri, NULL, NULL);
+
+  pipeline = gst_pipeline_new ("keyframe-indexer");
+  source = gst_element_factory_make ("filesrc", NULL);
+  decodebin = gst_element_factory_make ("decodebin", NULL);
+
+  if (filename != NULL && source != NULL && decodebin != NULL) {
+    g_object_set (source, "location", filename, NULL);
+    gst_bin_add_many (GST_BIN (pipeline), source, decodebin, NULL);
+    gst_element_link (source, decodebin);
+
+    g_signal_connect (decodebin, "autoplug-select",
+        G_CALLBACK (autoplug_select_cb), NULL);
+    g_signal_connect (decodebin, "element-added",
+        G_CALLBACK (element_added_cb), indexer);
+    g_signal_connect (decodebin, "pad-added", G_CALLBACK (pad_added_cb),
+        pipeline);
+
+    pad = gst_element_get_static_pad (source, "src");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_PUSH | GST_PAD_PROBE_TYPE_PULL,
+        (GstPadProbeCallback) source_probe_cb, indexer, NULL);
+    gst_object_unref (pad);
+
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+    bus = gst_element_get_bus (pipeline);
+    while (!g_atomic_int_get (&indexer->cancelled)) {
+      msg = gst_bus_timed_pop_filtered (bus, INDEXER_POLL,
+          GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+      if (msg == NULL)
+        continue;
+
+      done = GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS;
+      gst_message_unref (msg);
+      break;
+    }
+    gst_object_unref (bus);
+
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+  } else {
+    if (source != NULL)
+      gst_object_unref (source);
+    if (decodebin != NULL)
+      gst_object_unref (decodebin);
+  }
+  gst_object_unref (pipeline);
+  g_free (filename);
+
+  // A video stream without a single delta frame carried no keyframe
+  // flags, every entry would be a guess
+  if (done && indexer->entries->len > 0 &&
+      (!indexer->video || indexer->deltas)) {
+    save_index (indexer->uri, indexer->entries);
+
+    indexer->index = g_new0 (KeyframeIndex, 1);
+    indexer->index->entries = indexer->entries;
+    indexer->entries = NULL;
+  }
+
+  if (g_atomic_int_get (&indexer->cancelled)) {
+    if (indexer->index != NULL)
+      keyframe_index_free (indexer->index);
+    indexer_free (indexer);
+  } else {
+    g_idle_add ((GSourceFunc) deliver_index, indexer);
+  }
+
+  return NULL;
+}
+
+static gboolean
+deliver_index (KeyframeIndexer * indexer)
+{
+  if (g_atomic_int_get (&indexer->cancelled)) {
+    if (indexer->index != NULL)
+      keyframe_index_free (indexer->index);
+  } else {
+    indexer->func (indexer->index, indexer->data);
+  }
+  indexer_free (indexer);
+
+  return FALSE;
+}
+
+static void
+element_added_cb (GstBin * bin, GstElement * element,
+    KeyframeIndexer * indexer)
+{
+  GstElementFactory *factory;
+  const gchar *klass;
+  GstPad *pad;
+
+  factory = gst_element_get_factory (element);
+  if (factory == NULL || indexer->indexed != NULL)
+    return;
+
+  // Keyframes are taken right after the first demuxer, or the parser of an
+  // elementary stream, as that still runs in step with the file source
+  klass = gst_element_factory_get_metadata (factory,
+      GST_ELEMENT_METADATA_KLASS);
+  if (klass == NULL)
+    return;
+
+  if (strstr (klass, "Demux") != NULL) {
+    indexer->indexed = element;
+    g_signal_connect (element, "pad-added",
+        G_CALLBACK (stream_pad_added_cb), indexer);
+  } else if (strstr (klass, "Parser") != NULL) {
+    indexer->indexed = element;
+    pad = gst_element_get_static_pad (element, "src");
+    if (pad != NULL) {
+      stream_pad_added_cb (element, pad, indexer);
+      gst_object_unref (pad);
+    }
+  }
+}
+
+static gboolean
+file_stamp (const gchar * uri, guint64 * size, guint64 * mtime)
+{
+  GStatBuf buf;
+  gchar *filename;
+  gboolean ok;
+
+  filename = g_filename_from_uri (uri, NULL, NULL);
+  if (filename == NULL)
+    return FALSE;
+
+  ok = g_stat (filename, &buf) == 0;
+  if (ok) {
+    *size = buf.st_size;
+    *mtime = buf.st_mtime;
+  }
+  g_free (filename);
+
+  return ok;
+}
+
+static gchar *
+index_path (const gchar * uri)
+{
+  gchar *md5, *name, *path;
+
+  md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+  name = g_strdup_printf ("%s.idx", md5);
+  path = g_build_filename (g_get_user_cache_dir (), "snappy", "index", name,
+      NULL);
+
+  g_free (name);
+  g_free (md5);
+
+  return path;
+}
+
+static void
+indexer_free (KeyframeIndexer * indexer)
+{
+  if (indexer->entries != NULL)
+    g_array_free (indexer->entries, TRUE);
+  g_mutex_clear (&indexer->lock);
+  g_free (indexer->uri);
+  g_free (indexer);
+}
+
+static GstPadProbeReturn
+keyframe_probe_cb (GstPad * pad, GstPadProbeInfo * info,
+    KeyframeIndexer * indexer)
+{
+  GstBuffer *buffer;
+  GstEvent *event;
+  GstCaps *caps;
+  const GstSegment *segment;
+  IndexEntry entry, *last;
+  gboolean video = FALSE;
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return GST_PAD_PROBE_OK;
+
+  caps = gst_pad_get_current_caps (pad);
+  if (caps != NULL) {
+    video = g_str_has_prefix (gst_structure_get_name
+        (gst_caps_get_structure (caps, 0)), "video/");
+    gst_caps_unref (caps);
+  }
+
+  g_mutex_lock (&indexer->lock);
+
+  // Index the video stream, or the first stream of audio only files
+  if (indexer->stream_pad == NULL || (video && !indexer->video)) {
+    if (indexer->stream_pad != pad) {
+      g_array_set_size (indexer->entries, 0);
+      indexer->deltas = FALSE;
+    }
+    indexer->stream_pad = pad;
+    indexer->video = video;
+  }
+  if (pad != indexer->stream_pad)
+    goto done;
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    indexer->deltas = TRUE;
+    goto done;
+  }
+
+  event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+  if (event == NULL)
+    goto done;
+
+  gst_event_parse_segment (event, &segment);
+  entry.time = gst_segment_to_stream_time (segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  entry.offset = indexer->offset;
+  gst_event_unref (event);
+
+  if (!GST_CLOCK_TIME_IS_VALID (entry.time))
+    goto done;
+
+  if (indexer->entries->len > 0) {
+    last = &g_array_index (indexer->entries, IndexEntry,
+        indexer->entries->len - 1);
+    if (entry.time < last->time + KEYFRAME_INDEX_SPACING ||
+        entry.offset < last->offset)
+      goto done;
+  }
+  g_array_append_val (indexer->entries, entry);
+
+done:
+  g_mutex_unlock (&indexer->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+pad_added_cb (GstElement * element, GstPad * pad, GstElement * pipeline)
+{
+  GstElement *sink;
+  GstPad *sinkpad;
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (sink, "sync", FALSE, "async", FALSE, NULL);
+  gst_bin_add (GST_BIN (pipeline), sink);
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_link (pad, sinkpad);
+  gst_object_unref (sinkpad);
+
+  gst_element_sync_state_with_parent (sink);
+}
+
+static guint32
+read_uint32 (const gchar * data)
+{
+  guint32 value;
+
+  memcpy (&value, data, sizeof (value));
+
+  return GUINT32_FROM_LE (value);
+}
+
+static guint64
+read_uint64 (const gchar * data)
+{
+  guint64 value;
+
+  memcpy (&value, data, sizeof (value));
+
+  return GUINT64_FROM_LE (value);
+}
+
+static void
+save_index (const gchar * uri, GArray * entries)
+{
+  GByteArray *bytes;
+  IndexEntry *entry;
+  guint64 size, mtime, value;
+  guint32 value32;
+  gchar *path, *dir;
+  guint i;
+
+  if (!file_stamp (uri, &size, &mtime))
+    return;
+
+  bytes = g_byte_array_sized_new (INDEX_HEADER_SIZE +
+      entries->len * INDEX_ENTRY_SIZE);
+  g_byte_array_append (bytes, (const guint8 *) INDEX_MAGIC, 4);
+  value32 = GUINT32_TO_LE (INDEX_VERSION);
+  g_byte_array_append (bytes, (const guint8 *) &value32, 4);
+  value = GUINT64_TO_LE (size);
+  g_byte_array_append (bytes, (const guint8 *) &value, 8);
+  value = GUINT64_TO_LE (mtime);
+  g_byte_array_append (bytes, (const guint8 *) &value, 8);
+  value32 = GUINT32_TO_LE (entries->len);
+  g_byte_array_append (bytes, (const guint8 *) &value32, 4);
+
+  for (i = 0; i < entries->len; i++) {
+    entry = &g_array_index (entries, IndexEntry, i);
+    value = GUINT64_TO_LE (entry->time);
+    g_byte_array_append (bytes, (const guint8 *) &value, 8);
+    value = GUINT64_TO_LE (entry->offset);
+    g_byte_array_append (bytes, (const guint8 *) &value, 8);
+  }
+
+  path = index_path (uri);
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0700);
+  g_file_set_contents (path, (const gchar *) bytes->data, bytes->len, NULL);
+
+  g_free (dir);
+  g_free (path);
+  g_byte_array_free (bytes, TRUE);
+}
+
+static GstPadProbeReturn
+source_probe_cb (GstPad * pad, GstPadProbeInfo * info,
+    KeyframeIndexer * indexer)
+{
+  GstBuffer *buffer;
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  if (buffer == NULL || !GST_BUFFER_OFFSET_IS_VALID (buffer))
+    return GST_PAD_PROBE_OK;
+
+  // A keyframe coming out now may have started in the block read before
+  // the last one, its offset is the safe place to seek to
+  g_mutex_lock (&indexer->lock);
+  indexer->offset = indexer->read_offset;
+  indexer->read_offset = GST_BUFFER_OFFSET (buffer);
+  g_mutex_unlock (&indexer->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+stream_pad_added_cb (GstElement * element, GstPad * pad,
+    KeyframeIndexer * indexer)
+{
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) keyframe_probe_cb, indexer, NULL);
+}
+
+/* -------------------- non-static functions --------------------- */
+
+void
+keyframe_index_free (KeyframeIndex * index)
+{
+  g_array_free (index->entries, TRUE);
+  g_free (index);
+}
+
+guint
+keyframe_index_get_size (KeyframeIndex * index)
+{
+  return index->entries->len;
+}
+
+KeyframeIndex *
+keyframe_index_load (const gchar * uri)
+{
+  KeyframeIndex *index;
+  IndexEntry entry;
+  guint64 size, mtime;
+  gchar *path, *contents;
+  gsize length;
+  guint32 count, i;
+
+  if (!file_stamp (uri, &size, &mtime))
+    return NULL;
+
+  path = index_path (uri);
+  if (!g_file_get_contents (path, &contents, &length, NULL)) {
+    g_free (path);
+    return NULL;
+  }
+  g_free (path);
+
+  // Stale once the file has changed since it was indexed
+  if (length < INDEX_HEADER_SIZE || memcmp (contents, INDEX_MAGIC, 4) != 0 ||
+      read_uint32 (contents + 4) != INDEX_VERSION ||
+      read_uint64 (contents + 8) != size ||
+      read_uint64 (contents + 16) != mtime) {
+    g_free (contents);
+    return NULL;
+  }
+
+  count = read_uint32 (contents + 24);
+  if (count == 0 || length != INDEX_HEADER_SIZE + (gsize) count *
+      INDEX_ENTRY_SIZE) {
+    g_free (contents);
+    return NULL;
+  }
+
+  index = g_new0 (KeyframeIndex, 1);
+  index->entries = g_array_sized_new (FALSE, FALSE, sizeof (IndexEntry),
+      count);
+  for (i = 0; i < count; i++) {
+    entry.time = read_uint64 (contents + INDEX_HEADER_SIZE +
+        i * INDEX_ENTRY_SIZE);
+    entry.offset = read_uint64 (contents + INDEX_HEADER_SIZE +
+        i * INDEX_ENTRY_SIZE + 8);
+    g_array_append_val (index->entries, entry);
+  }
+  g_free (contents);
+
+  return index;
+}
+
+gboolean
+keyframe_index_lookup (KeyframeIndex * index, GstClockTime position,
+    GstClockTime * time, guint64 * offset)
+{
+  IndexEntry *entry;
+  guint low = 0, high = index->entries->len, middle;
+
+  // Last keyframe at or before position
+  while (low < high) {
+    middle = low + (high - low) / 2;
+    entry = &g_array_index (index->entries, IndexEntry, middle);
+    if (entry->time <= position)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  if (low == 0)
+    return FALSE;
+
+  entry = &g_array_index (index->entries, IndexEntry, low - 1);
+  *time = entry->time;
+  *offset = entry->offset;
+
+  return TRUE;
+}
+
+void
+keyframe_indexer_cancel (KeyframeIndexer * indexer)
+{
+  // The thread, or the pending delivery, frees the indexer
+  g_atomic_int_set (&indexer->cancelled, TRUE);
+}
+
+KeyframeIndexer *
+keyframe_indexer_start (const gchar * uri, KeyframeIndexFunc func,
+    gpointer data)
+{
+  KeyframeIndexer *indexer;
+
+  if (!g_str_has_prefix (uri, "file://"))
+    return NULL;
+
+  indexer = g_new0 (KeyframeIndexer, 1);
+  indexer->uri = g_strdup (uri);
+  indexer->entries = g_array_new (FALSE, FALSE, sizeof (IndexEntry));
+  indexer->func = func;
+  indexer->data = data;
+  g_mutex_init (&indexer->lock);
+
+  g_thread_unref (g_thread_new ("keyframe-indexer",
+          (GThreadFunc) build_index, indexer));
+
+  return indexer;
+}
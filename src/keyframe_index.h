@@ -0,0 +1,52 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KEYFRAME_INDEX_H__
+#define __KEYFRAME_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Keyframes closer together than this are left out of the index */
+#define KEYFRAME_INDEX_SPACING (GST_SECOND / 2)
+/* Seeks slower than this start building an index for the file */
+#define KEYFRAME_INDEX_SLOW_SEEK (250 * G_TIME_SPAN_MILLISECOND)
+
+typedef struct _KeyframeIndex KeyframeIndex;
+typedef struct _KeyframeIndexer KeyframeIndexer;
+
+/* Called on the main thread once an index is built, index is NULL if the
+ * file could not be indexed. Never called after keyframe_indexer_cancel */
+typedef void (*KeyframeIndexFunc) (KeyframeIndex * index, gpointer data);
+
+void keyframe_index_free (KeyframeIndex * index);
+guint keyframe_index_get_size (KeyframeIndex * index);
+KeyframeIndex *keyframe_index_load (const gchar * uri);
+gboolean keyframe_index_lookup (KeyframeIndex * index, GstClockTime position,
+    GstClockTime * time, guint64 * offset);
+void keyframe_indexer_cancel (KeyframeIndexer * indexer);
+KeyframeIndexer *keyframe_indexer_start (const gchar * uri,
+    KeyframeIndexFunc func, gpointer data);
+
+G_END_DECLS
+#endif /* __KEYFRAME_INDEX_H__ */
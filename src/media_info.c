@@ -0,0 +1,505 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <gio/gio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "media_info.h"
+#include "utils.h"
+
+/* Media information is gathered with GstDiscoverer alone, so it works
+ * without a display and without building the playback pipeline.
+ * Files are probed concurrently, one discoverer per worker thread, and
+ * each report is printed whole as soon as it is ready. */
+
+typedef struct _MediaInfoBatch MediaInfoBatch;
+
+struct _MediaInfoBatch
+{
+  gboolean json;
+  gint failed;
+
+  GThreadPool *pool;
+  GMutex output_lock;
+};
+
+// Declaration of static functions
+static void append_json_tag (const GstTagList * list, const gchar * tag,
+    gpointer data);
+static void append_stream_json (GString * out,
+    GstDiscovererStreamInfo * stream);
+static void append_stream_text (GString * out,
+    GstDiscovererStreamInfo * stream);
+static void append_tag_text (const GstTagList * list, const gchar * tag,
+    gpointer data);
+static gchar *codec_description (GstCaps * caps);
+static GstDiscoverer *get_discoverer (void);
+static void probe_uri (gchar * uri, MediaInfoBatch * batch);
+static void queue_directory (MediaInfoBatch * batch, GFile * dir);
+static void queue_uri (MediaInfoBatch * batch, const gchar * uri);
+static void report_json (GString * out, const gchar * uri,
+    GstDiscovererInfo * info, guint64 size);
+static void report_text (GString * out, const gchar * uri,
+    GstDiscovererInfo * info);
+
+/* Each worker thread keeps its own discoverer for as long as it lives */
+static GPrivate thread_discoverer = G_PRIVATE_INIT (g_object_unref);
+
+/* ---------------------- static functions ----------------------- */
+
+static void
+append_json_tag (const GstTagList * list, const gchar * tag, gpointer data)
+{
+  GString *out = data;
+  const GValue *value;
+  gchar *str;
+  gint i, count;
+
+  // Cover art and other binary tags don't belong in an inventory line
+  value = gst_tag_list_get_value_index (list, tag, 0);
+  if (G_VALUE_HOLDS (value, GST_TYPE_SAMPLE) ||
+      G_VALUE_HOLDS (value, GST_TYPE_BUFFER))
+    return;
+
+  if (out->str[out->len - 1] != '{')
+    g_string_append_c (out, ',');
+  append_json_string (out, gst_tag_get_nick (tag));
+  g_string_append_c (out, ':');
+
+  count = gst_tag_list_get_tag_size (list, tag);
+  if (count > 1)
+    g_string_append_c (out, '[');
+
+  for (i = 0; i < count; i++) {
+    value = gst_tag_list_get_value_index (list, tag, i);
+    if (G_VALUE_HOLDS_STRING (value))
+      str = g_value_dup_string (value);
+    else
+      str = g_strdup_value_contents (value);
+
+    if (i > 0)
+      g_string_append_c (out, ',');
+    append_json_string (out, str ? str : "");
+    g_free (str);
+  }
+
+  if (count > 1)
+    g_string_append_c (out, ']');
+}
+
+static void
+append_stream_json (GString * out, GstDiscovererStreamInfo * stream)
+{
+  GstCaps *caps;
+  gchar *desc;
+
+  caps = gst_discoverer_stream_info_get_caps (stream);
+  if (caps == NULL)
+    return;
+
+  if (out->str[out->len - 1] != '[')
+    g_string_append_c (out, ',');
+
+  g_string_append (out, "{\"type\":");
+  append_json_string (out, gst_discoverer_stream_info_get_stream_type_nick
+      (stream));
+
+  g_string_append (out, ",\"caps\":");
+  append_json_string (out,
+      gst_structure_get_name (gst_caps_get_structure (caps, 0)));
+
+  desc = codec_description (caps);
+  g_string_append (out, ",\"codec\":");
+  append_json_string (out, desc);
+  g_free (desc);
+
+  if (GST_IS_DISCOVERER_VIDEO_INFO (stream)) {
+    GstDiscovererVideoInfo *video = (GstDiscovererVideoInfo *) stream;
+    guint num, denom;
+
+    num = gst_discoverer_video_info_get_framerate_num (video);
+    denom = gst_discoverer_video_info_get_framerate_denom (video);
+
+    g_string_append_printf (out, ",\"width\":%u,\"height\":%u,"
+        "\"bitrate\":%u,\"interlaced\":%s",
+        gst_discoverer_video_info_get_width (video),
+        gst_discoverer_video_info_get_height (video),
+        gst_discoverer_video_info_get_bitrate (video),
+        gst_discoverer_video_info_is_interlaced (video) ? "true" : "false");
+    if (denom != 0)
+      append_json_double (out, "framerate", (gdouble) num / denom);
+  } else if (GST_IS_DISCOVERER_AUDIO_INFO (stream)) {
+    GstDiscovererAudioInfo *audio = (GstDiscovererAudioInfo *) stream;
+
+    g_string_append_printf (out, ",\"channels\":%u,\"sample_rate\":%u,"
+        "\"bitrate\":%u",
+        gst_discoverer_audio_info_get_channels (audio),
+        gst_discoverer_audio_info_get_sample_rate (audio),
+        gst_discoverer_audio_info_get_bitrate (audio));
+    if (gst_discoverer_audio_info_get_language (audio) != NULL) {
+      g_string_append (out, ",\"language\":");
+      append_json_string (out, gst_discoverer_audio_info_get_language (audio));
+    }
+  } else if (GST_IS_DISCOVERER_SUBTITLE_INFO (stream)) {
+    GstDiscovererSubtitleInfo *subtitle = (GstDiscovererSubtitleInfo *) stream;
+
+    if (gst_discoverer_subtitle_info_get_language (subtitle) != NULL) {
+      g_string_append (out, ",\"language\":");
+      append_json_string (out,
+          gst_discoverer_subtitle_info_get_language (subtitle));
+    }
+  }
+
+  g_string_append_c (out, '}');
+  gst_caps_unref (caps);
+}
+
+static void
+append_stream_text (GString * out, GstDiscovererStreamInfo * stream)
+{
+  GstCaps *caps;
+  gchar *desc;
+
+  caps = gst_discoverer_stream_info_get_caps (stream);
+  if (caps == NULL)
+    return;
+
+  desc = codec_description (caps);
+
+  if (GST_IS_DISCOVERER_VIDEO_INFO (stream)) {
+    GstDiscovererVideoInfo *video = (GstDiscovererVideoInfo *) stream;
+
+    g_string_append_printf (out, "  %15s: %s, %ux%u, %u/%u fps\n", "video",
+        desc, gst_discoverer_video_info_get_width (video),
+        gst_discoverer_video_info_get_height (video),
+        gst_discoverer_video_info_get_framerate_num (video),
+        gst_discoverer_video_info_get_framerate_denom (video));
+  } else if (GST_IS_DISCOVERER_AUDIO_INFO (stream)) {
+    GstDiscovererAudioInfo *audio = (GstDiscovererAudioInfo *) stream;
+
+    g_string_append_printf (out, "  %15s: %s, %u channels, %u Hz\n", "audio",
+        desc, gst_discoverer_audio_info_get_channels (audio),
+        gst_discoverer_audio_info_get_sample_rate (audio));
+  } else if (GST_IS_DISCOVERER_SUBTITLE_INFO (stream)) {
+    GstDiscovererSubtitleInfo *subtitle = (GstDiscovererSubtitleInfo *) stream;
+
+    g_string_append_printf (out, "  %15s: %s, %s\n", "subtitles", desc,
+        GST_STR_NULL (gst_discoverer_subtitle_info_get_language (subtitle)));
+  } else if (GST_IS_DISCOVERER_CONTAINER_INFO (stream)) {
+    g_string_append_printf (out, "  %15s: %s\n", "container", desc);
+  }
+
+  g_free (desc);
+  gst_caps_unref (caps);
+}
+
+/*  Append tags found in the media  */
+static void
+append_tag_text (const GstTagList * list, const gchar * tag, gpointer data)
+{
+  GString *out = data;
+  gint i, count;
+
+  count = gst_tag_list_get_tag_size (list, tag);
+
+  for (i = 0; i < count; i++) {
+    gchar *str;
+
+    if (gst_tag_get_type (tag) == G_TYPE_STRING) {
+      if (!gst_tag_list_get_string_index (list, tag, i, &str))
+        g_assert_not_reached ();
+    } else {
+      str =
+          g_strdup_value_contents (gst_tag_list_get_value_index (list, tag, i));
+    }
+
+    if (i == 0) {
+      g_string_append_printf (out, "  %15s: %s\n", gst_tag_get_nick (tag),
+          str);
+    } else {
+      g_string_append_printf (out, "                 : %s\n", str);
+    }
+
+    g_free (str);
+  }
+}
+
+static gchar *
+codec_description (GstCaps * caps)
+{
+  if (gst_caps_is_fixed (caps))
+    return gst_pb_utils_get_codec_description (caps);
+  else
+    return gst_caps_to_string (caps);
+}
+
+static GstDiscoverer *
+get_discoverer (void)
+{
+  GstDiscoverer *discoverer;
+
+  discoverer = g_private_get (&thread_discoverer);
+  if (discoverer == NULL) {
+    discoverer = gst_discoverer_new (MEDIA_INFO_TIMEOUT * GST_SECOND, NULL);
+    g_private_set (&thread_discoverer, discoverer);
+  }
+
+  return discoverer;
+}
+
+static void
+probe_uri (gchar * uri, MediaInfoBatch * batch)
+{
+  GstDiscoverer *discoverer;
+  GstDiscovererInfo *info = NULL;
+  GError *error = NULL;
+  GString *out;
+  GFile *file;
+  GFileInfo *file_info;
+  guint64 size = 0;
+
+  out = g_string_new (NULL);
+
+  discoverer = get_discoverer ();
+  if (discoverer != NULL)
+    info = gst_discoverer_discover_uri (discoverer, uri, &error);
+
+  if (info == NULL ||
+      gst_discoverer_info_get_result (info) != GST_DISCOVERER_OK) {
+    const gchar *message;
+
+    if (error != NULL)
+      message = error->message;
+    else if (info != NULL && gst_discoverer_info_get_result (info) ==
+        GST_DISCOVERER_MISSING_PLUGINS)
+      message = "Not a media file, or no plugin to read it";
+    else
+      message = "Unable to read media information";
+    if (batch->json) {
+      g_string_append (out, "{\"uri\":");
+      append_json_string (out, uri);
+      g_string_append (out, ",\"error\":");
+      append_json_string (out, message);
+      g_string_append (out, "}\n");
+    } else {
+      g_string_append_printf (out, "%s\n  ERROR: %s\n\n", uri, message);
+    }
+    g_atomic_int_inc (&batch->failed);
+
+  } else if (batch->json) {
+    file = g_file_new_for_uri (uri);
+    file_info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+        G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    if (file_info != NULL) {
+      size = g_file_info_get_size (file_info);
+      g_object_unref (file_info);
+    }
+    g_object_unref (file);
+
+    report_json (out, uri, info, size);
+
+  } else {
+    report_text (out, uri, info);
+  }
+
+  // Whole reports only, never interleaved with another thread's
+  g_mutex_lock (&batch->output_lock);
+  fwrite (out->str, 1, out->len, stdout);
+  fflush (stdout);
+  g_mutex_unlock (&batch->output_lock);
+
+  g_clear_error (&error);
+  if (info != NULL)
+    gst_discoverer_info_unref (info);
+  g_string_free (out, TRUE);
+  g_free (uri);
+}
+
+static void
+queue_directory (MediaInfoBatch * batch, GFile * dir)
+{
+  GFileEnumerator *children;
+  GFileInfo *info;
+  GFile *child;
+
+  // Symlinks are not followed, they could loop back up the tree
+  children = g_file_enumerate_children (dir,
+      G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE,
+      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL);
+  if (children == NULL)
+    return;
+
+  while ((info = g_file_enumerator_next_file (children, NULL, NULL))) {
+    child = g_file_get_child (dir, g_file_info_get_name (info));
+
+    // Every regular file is probed, names miss MXF, ASF or .ts files, and
+    // an inventory should list what it couldn't read rather than skip it
+    if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+      queue_directory (batch, child);
+    else if (g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR)
+      g_thread_pool_push (batch->pool, g_file_get_uri (child), NULL);
+
+    g_object_unref (child);
+    g_object_unref (info);
+  }
+
+  g_object_unref (children);
+}
+
+static void
+queue_uri (MediaInfoBatch * batch, const gchar * uri)
+{
+  GFile *file;
+
+  // Directories are walked, anything else named explicitly is probed
+  file = g_file_new_for_uri (uri);
+  if (g_file_has_uri_scheme (file, "file") &&
+      g_file_query_file_type (file, G_FILE_QUERY_INFO_NONE,
+          NULL) == G_FILE_TYPE_DIRECTORY)
+    queue_directory (batch, file);
+  else
+    g_thread_pool_push (batch->pool, g_strdup (uri), NULL);
+
+  g_object_unref (file);
+}
+
+static void
+report_json (GString * out, const gchar * uri, GstDiscovererInfo * info,
+    guint64 size)
+{
+  GstDiscovererStreamInfo *container;
+  GstClockTime duration;
+  const GstTagList *tags;
+  GList *streams, *l;
+  gchar *desc;
+
+  g_string_append (out, "{\"uri\":");
+  append_json_string (out, uri);
+
+  duration = gst_discoverer_info_get_duration (info);
+  if (GST_CLOCK_TIME_IS_VALID (duration))
+    append_json_double (out, "duration", (gdouble) duration / GST_SECOND);
+  g_string_append_printf (out, ",\"seekable\":%s",
+      gst_discoverer_info_get_seekable (info) ? "true" : "false");
+
+  // Overall bitrate, from the size of the file and how long it plays
+  if (size > 0) {
+    g_string_append_printf (out, ",\"size\":%" G_GUINT64_FORMAT, size);
+    if (GST_CLOCK_TIME_IS_VALID (duration) && duration > 0)
+      g_string_append_printf (out, ",\"bitrate\":%" G_GUINT64_FORMAT,
+          gst_util_uint64_scale (size * 8, GST_SECOND, duration));
+  }
+
+  container = gst_discoverer_info_get_stream_info (info);
+  if (container != NULL) {
+    if (GST_IS_DISCOVERER_CONTAINER_INFO (container)) {
+      GstCaps *caps = gst_discoverer_stream_info_get_caps (container);
+
+      if (caps != NULL) {
+        desc = codec_description (caps);
+        g_string_append (out, ",\"container\":");
+        append_json_string (out, desc);
+        g_free (desc);
+        gst_caps_unref (caps);
+      }
+    }
+    gst_discoverer_stream_info_unref (container);
+  }
+
+  g_string_append (out, ",\"streams\":[");
+  streams = gst_discoverer_info_get_stream_list (info);
+  for (l = streams; l != NULL; l = l->next) {
+    if (!GST_IS_DISCOVERER_CONTAINER_INFO (l->data))
+      append_stream_json (out, l->data);
+  }
+  gst_discoverer_stream_info_list_free (streams);
+  g_string_append_c (out, ']');
+
+  g_string_append (out, ",\"tags\":{");
+  tags = gst_discoverer_info_get_tags (info);
+  if (tags != NULL)
+    gst_tag_list_foreach (tags, append_json_tag, out);
+  g_string_append (out, "}}\n");
+}
+
+static void
+report_text (GString * out, const gchar * uri, GstDiscovererInfo * info)
+{
+  GstClockTime duration;
+  const GstTagList *tags;
+  GList *streams, *l;
+
+  g_string_append_printf (out, "%s\n", uri);
+
+  duration = gst_discoverer_info_get_duration (info);
+  if (GST_CLOCK_TIME_IS_VALID (duration))
+    g_string_append_printf (out, "  %15s: %" GST_TIME_FORMAT "\n", "duration",
+        GST_TIME_ARGS (duration));
+  g_string_append_printf (out, "  %15s: %s\n", "seekable",
+      gst_discoverer_info_get_seekable (info) ? "yes" : "no");
+
+  streams = gst_discoverer_info_get_stream_list (info);
+  for (l = streams; l != NULL; l = l->next)
+    append_stream_text (out, l->data);
+  gst_discoverer_stream_info_list_free (streams);
+
+  tags = gst_discoverer_info_get_tags (info);
+  if (tags != NULL)
+    gst_tag_list_foreach (tags, append_tag_text, out);
+
+  g_string_append_c (out, '\n');
+}
+
+/* -------------------- non-static functions --------------------- */
+
+gboolean
+media_info_print (GList * uri_list, gboolean json)
+{
+  MediaInfoBatch batch;
+  GError *error = NULL;
+  GList *l;
+
+  batch.json = json;
+  batch.failed = 0;
+  g_mutex_init (&batch.output_lock);
+
+  // Discovery mostly waits on decoders, one worker per core keeps them busy
+  batch.pool = g_thread_pool_new ((GFunc) probe_uri, &batch,
+      g_get_num_processors (), TRUE, &error);
+  if (batch.pool == NULL) {
+    g_print ("ERROR: Unable to start media info workers: %s\n",
+        error->message);
+    g_error_free (error);
+    g_mutex_clear (&batch.output_lock);
+    return FALSE;
+  }
+
+  for (l = uri_list; l != NULL; l = l->next)
+    queue_uri (&batch, l->data);
+
+  // Wait for every queued file to be reported
+  g_thread_pool_free (batch.pool, FALSE, TRUE);
+  g_mutex_clear (&batch.output_lock);
+
+  return batch.failed == 0;
+}
@@ -0,0 +1,488 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "open_trace.h"
+#include "utils.h"
+
+/* Every URI opened by the player is traced from the open request to its
+ * first frame. Elements are followed as the player's bins create them,
+ * with a pad probe for the first buffer out of the source and of the
+ * decoders. The breakdown is kept per URI under ~/.cache/snappy/, so a
+ * slow switch can be put down to storage, the container or the decoder. */
+
+typedef struct
+{
+  const gchar *name;
+  gint from, to;                // steps, -1 is the open request itself
+} OpenPhase;
+
+struct _OpenTrace
+{
+  GMutex lock;
+  gint open;                    // atomic, whether an open is being traced
+  gboolean persist;
+  gchar *uri;
+  gint64 start;
+  gint64 steps[OPEN_STEP_COUNT];        // 0 until the step happens
+};
+
+typedef struct
+{
+  gchar *uri;
+  gdouble steps[OPEN_STEP_COUNT];
+} SaveRequest;
+
+// One save at a time, each reads what the one before wrote
+static GMutex save_lock;
+
+static const gchar *step_names[OPEN_STEP_COUNT] = {
+  "ready", "discovered", "source", "source_read", "typefind", "demux_pad",
+  "decoder", "decoded", "prerolled", "first_frame"
+};
+
+static const OpenPhase phases[] = {
+  {"discover", -1, OPEN_STEP_DISCOVERED},
+  {"storage", OPEN_STEP_SOURCE, OPEN_STEP_SOURCE_READ},
+  {"container", OPEN_STEP_SOURCE_READ, OPEN_STEP_DEMUX_PAD},
+  {"decoder", OPEN_STEP_DEMUX_PAD, OPEN_STEP_DECODED},
+  {"render", OPEN_STEP_DECODED, OPEN_STEP_FIRST_FRAME}
+};
+
+#define N_PHASES G_N_ELEMENTS (phases)
+
+// Declaration of static functions
+static gint compare_double (const gdouble * a, const gdouble * b);
+static GstPadProbeReturn decoded_probe_cb (GstPad * pad,
+    GstPadProbeInfo * info, OpenTrace * trace);
+static void demux_pad_added_cb (GstElement * demuxer, GstPad * pad,
+    OpenTrace * trace);
+static void format_ms (gdouble ms, gchar * str, gsize size);
+static void have_type_cb (GstElement * typefind, guint probability,
+    GstCaps * caps, OpenTrace * trace);
+static gdouble median (GArray * values);
+static gdouble phase_ms (const gdouble * steps, const OpenPhase * phase);
+static void print_row (const gchar * label, guint opens, GArray ** values);
+static void probe_first_buffer (GstElement * element,
+    GstPadProbeCallback callback, OpenTrace * trace);
+static void save (const gchar * uri, const gdouble * steps);
+static gchar *save_path (void);
+static gpointer save_thread (SaveRequest * request);
+static GstPadProbeReturn source_probe_cb (GstPad * pad,
+    GstPadProbeInfo * info, OpenTrace * trace);
+static gdouble total_ms (const gdouble * steps);
+static void watch_element (GstElement * element, OpenTrace * trace);
+
+/* ---------------------- static functions ----------------------- */
+
+static gint
+compare_double (const gdouble * a, const gdouble * b)
+{
+  return (*a > *b) - (*a < *b);
+}
+
+static GstPadProbeReturn
+decoded_probe_cb (GstPad * pad, GstPadProbeInfo * info, OpenTrace * trace)
+{
+  open_trace_step (trace, OPEN_STEP_DECODED);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static void
+demux_pad_added_cb (GstElement * demuxer, GstPad * pad, OpenTrace * trace)
+{
+  open_trace_step (trace, OPEN_STEP_DEMUX_PAD);
+}
+
+static void
+format_ms (gdouble ms, gchar * str, gsize size)
+{
+  if (ms < 0)
+    g_strlcpy (str, "-", size);
+  else
+    g_snprintf (str, size, "%.1f", ms);
+}
+
+static void
+have_type_cb (GstElement * typefind, guint probability, GstCaps * caps,
+    OpenTrace * trace)
+{
+  open_trace_step (trace, OPEN_STEP_TYPEFIND);
+}
+
+static gdouble
+median (GArray * values)
+{
+  if (values->len == 0)
+    return -1;
+
+  g_array_sort (values, (GCompareFunc) compare_double);
+
+  return g_array_index (values, gdouble, values->len / 2);
+}
+
+static gdouble
+phase_ms (const gdouble * steps, const OpenPhase * phase)
+{
+  gdouble from = phase->from < 0 ? 0 : steps[phase->from];
+  gdouble to = steps[phase->to];
+
+  if (from < 0 || to < from)
+    return -1;
+
+  return to - from;
+}
+
+static void
+print_row (const gchar * label, guint opens, GArray ** values)
+{
+  gchar str[N_PHASES + 1][16];
+  guint i;
+
+  for (i = 0; i <= N_PHASES; i++)
+    format_ms (median (values[i]), str[i], sizeof (str[i]));
+
+  g_print ("  %5u %9s %9s %9s %9s %9s %9s  %s\n", opens, str[0], str[1],
+      str[2], str[3], str[4], str[N_PHASES], label);
+}
+
+static void
+probe_first_buffer (GstElement * element, GstPadProbeCallback callback,
+    OpenTrace * trace)
+{
+  GstPad *pad = gst_element_get_static_pad (element, "src");
+
+  if (pad == NULL)
+    return;
+
+  // Push or pull, whichever the source is driven in
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, callback, trace, NULL);
+  gst_object_unref (pad);
+}
+
+static void
+save (const gchar * uri, const gdouble * steps)
+{
+  GKeyFile *keyfile = g_key_file_new ();
+  gchar *path = save_path ();
+  gchar *group = clean_brackets_in_uri ((gchar *) uri);
+  gchar *dir, *data, **groups;
+  gdouble *old[OPEN_STEP_COUNT];
+  gsize n[OPEN_STEP_COUNT], length, n_groups;
+  guint i;
+
+  g_key_file_load_from_file (keyfile, path, G_KEY_FILE_NONE, NULL);
+
+  for (i = 0; i < OPEN_STEP_COUNT; i++) {
+    n[i] = 0;
+    old[i] = g_key_file_get_double_list (keyfile, group, step_names[i], &n[i],
+        NULL);
+  }
+  // Written anew, the group moves to the end of the file
+  g_key_file_remove_group (keyfile, group, NULL);
+
+  // Append this open to each step's list, dropping the oldest ones
+  for (i = 0; i < OPEN_STEP_COUNT; i++) {
+    gdouble *list;
+    gsize skip;
+
+    skip = n[i] >= OPEN_TRACE_SAMPLES ? n[i] - OPEN_TRACE_SAMPLES + 1 : 0;
+    list = g_new (gdouble, n[i] - skip + 1);
+    if (old[i] != NULL)
+      memcpy (list, old[i] + skip, (n[i] - skip) * sizeof (gdouble));
+    list[n[i] - skip] = steps[i];
+
+    g_key_file_set_double_list (keyfile, group, step_names[i], list,
+        n[i] - skip + 1);
+    g_free (list);
+    g_free (old[i]);
+  }
+
+  // Groups are in the order their URIs were last opened
+  groups = g_key_file_get_groups (keyfile, &n_groups);
+  for (i = 0; i + OPEN_TRACE_URIS < n_groups; i++)
+    g_key_file_remove_group (keyfile, groups[i], NULL);
+  g_strfreev (groups);
+
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0700);
+  data = g_key_file_to_data (keyfile, &length, NULL);
+  g_file_set_contents (path, data, length, NULL);
+
+  g_free (data);
+  g_free (dir);
+  g_free (group);
+  g_free (path);
+  g_key_file_free (keyfile);
+}
+
+static gchar *
+save_path (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "snappy", "open-times",
+      NULL);
+}
+
+static gpointer
+save_thread (SaveRequest * request)
+{
+  g_mutex_lock (&save_lock);
+  save (request->uri, request->steps);
+  g_mutex_unlock (&save_lock);
+
+  g_free (request->uri);
+  g_free (request);
+
+  return NULL;
+}
+
+static GstPadProbeReturn
+source_probe_cb (GstPad * pad, GstPadProbeInfo * info, OpenTrace * trace)
+{
+  open_trace_step (trace, OPEN_STEP_SOURCE_READ);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+// Until the first frame, or the preroll for files without video
+static gdouble
+total_ms (const gdouble * steps)
+{
+  if (steps[OPEN_STEP_FIRST_FRAME] >= 0)
+    return steps[OPEN_STEP_FIRST_FRAME];
+
+  return steps[OPEN_STEP_PREROLLED];
+}
+
+// Called from whichever thread added the element, often a streaming one
+static void
+watch_element (GstElement * element, OpenTrace * trace)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+  const gchar *klass = NULL;
+
+  if (factory != NULL)
+    klass = gst_element_factory_get_metadata (factory,
+        GST_ELEMENT_METADATA_KLASS);
+
+  if (klass == NULL)
+    return;
+
+  if (!g_strcmp0 (GST_OBJECT_NAME (factory), "typefind")) {
+    g_signal_handlers_disconnect_by_func (element, have_type_cb, trace);
+    g_signal_connect (element, "have-type", G_CALLBACK (have_type_cb),
+        trace);
+  } else if (strstr (klass, "Source") != NULL) {
+    open_trace_step (trace, OPEN_STEP_SOURCE);
+    probe_first_buffer (element, (GstPadProbeCallback) source_probe_cb,
+        trace);
+  } else if (strstr (klass, "Demux") != NULL) {
+    g_signal_handlers_disconnect_by_func (element, demux_pad_added_cb,
+        trace);
+    g_signal_connect (element, "pad-added",
+        G_CALLBACK (demux_pad_added_cb), trace);
+  } else if (strstr (klass, "Decoder") != NULL && !GST_IS_BIN (element)) {
+    // decodebin and uridecodebin call themselves decoders too
+    open_trace_step (trace, OPEN_STEP_DECODER);
+    probe_first_buffer (element, (GstPadProbeCallback) decoded_probe_cb,
+        trace);
+  }
+}
+
+/* -------------------- non-static functions --------------------- */
+
+void
+open_trace_begin (OpenTrace * trace, const gchar * uri, gint64 start,
+    gboolean persist)
+{
+  g_mutex_lock (&trace->lock);
+  g_free (trace->uri);
+  trace->uri = g_strdup (uri);
+  trace->start = start;
+  trace->persist = persist;
+  memset (trace->steps, 0, sizeof (trace->steps));
+  g_atomic_int_set (&trace->open, TRUE);
+  g_mutex_unlock (&trace->lock);
+}
+
+void
+open_trace_finish (OpenTrace * trace)
+{
+  gdouble steps[OPEN_STEP_COUNT];
+  gchar str[N_PHASES][16], total[16];
+  gchar *uri, *name;
+  gboolean persist;
+  guint i;
+
+  if (!g_atomic_int_get (&trace->open))
+    return;
+
+  g_mutex_lock (&trace->lock);
+  g_atomic_int_set (&trace->open, FALSE);
+  for (i = 0; i < OPEN_STEP_COUNT; i++) {
+    if (trace->steps[i] == 0)
+      steps[i] = -1;
+    else
+      steps[i] = (trace->steps[i] - trace->start) /
+          (gdouble) G_TIME_SPAN_MILLISECOND;
+  }
+  uri = trace->uri;
+  trace->uri = NULL;
+  persist = trace->persist;
+  g_mutex_unlock (&trace->lock);
+
+  for (i = 0; i < N_PHASES; i++)
+    format_ms (phase_ms (steps, &phases[i]), str[i], sizeof (str[i]));
+  format_ms (total_ms (steps), total, sizeof (total));
+
+  name = g_path_get_basename (uri);
+  g_print ("Opened %s in %s ms: discover %s, storage %s, container %s, "
+      "decoder %s, render %s\n", name, total, str[0], str[1], str[2], str[3],
+      str[4]);
+  g_free (name);
+
+  // Off the main thread, the first frame is still to be painted
+  if (persist) {
+    SaveRequest *request = g_new (SaveRequest, 1);
+
+    request->uri = uri;
+    memcpy (request->steps, steps, sizeof (steps));
+    g_thread_unref (g_thread_new ("open-trace-save",
+            (GThreadFunc) save_thread, request));
+  } else {
+    g_free (uri);
+  }
+}
+
+void
+open_trace_free (OpenTrace * trace)
+{
+  g_mutex_clear (&trace->lock);
+  g_free (trace->uri);
+  g_free (trace);
+}
+
+OpenTrace *
+open_trace_new (GstElement * pipeline)
+{
+  OpenTrace *trace = g_new0 (OpenTrace, 1);
+
+  g_mutex_init (&trace->lock);
+  watch_elements (pipeline, (WatchElementFunc) watch_element, trace);
+
+  return trace;
+}
+
+/* Median time of each phase over the last opens of every traced URI */
+gboolean
+open_trace_print_summary (void)
+{
+  GKeyFile *keyfile = g_key_file_new ();
+  GArray *all[N_PHASES + 1];
+  gchar *path = save_path ();
+  gchar **groups;
+  guint i, j, all_opens = 0;
+
+  if (!g_key_file_load_from_file (keyfile, path, G_KEY_FILE_NONE, NULL)) {
+    g_print ("No opens traced yet\n");
+    g_key_file_free (keyfile);
+    g_free (path);
+    return FALSE;
+  }
+
+  for (i = 0; i <= N_PHASES; i++)
+    all[i] = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+  g_print ("Open times in ms, medians over the last %d opens of each "
+      "file\n", OPEN_TRACE_SAMPLES);
+  g_print ("  %5s %9s %9s %9s %9s %9s %9s  %s\n", "opens", phases[0].name,
+      phases[1].name, phases[2].name, phases[3].name, phases[4].name,
+      "total", "file");
+
+  groups = g_key_file_get_groups (keyfile, NULL);
+  for (i = 0; groups[i] != NULL; i++) {
+    GArray *values[N_PHASES + 1];
+    gdouble *lists[OPEN_STEP_COUNT];
+    gsize length, opens = G_MAXSIZE, k;
+    gchar *name;
+
+    for (j = 0; j < OPEN_STEP_COUNT; j++) {
+      lists[j] = g_key_file_get_double_list (keyfile, groups[i],
+          step_names[j], &length, NULL);
+      opens = lists[j] != NULL ? MIN (opens, length) : 0;
+    }
+    for (j = 0; j <= N_PHASES; j++)
+      values[j] = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+    for (k = 0; k < opens; k++) {
+      gdouble steps[OPEN_STEP_COUNT], ms;
+
+      for (j = 0; j < OPEN_STEP_COUNT; j++)
+        steps[j] = lists[j][k];
+
+      for (j = 0; j <= N_PHASES; j++) {
+        ms = j < N_PHASES ? phase_ms (steps, &phases[j]) : total_ms (steps);
+        if (ms >= 0) {
+          g_array_append_val (values[j], ms);
+          g_array_append_val (all[j], ms);
+        }
+      }
+    }
+
+    name = g_path_get_basename (groups[i]);
+    print_row (name, opens, values);
+    all_opens += opens;
+    g_free (name);
+
+    for (j = 0; j < OPEN_STEP_COUNT; j++)
+      g_free (lists[j]);
+    for (j = 0; j <= N_PHASES; j++)
+      g_array_free (values[j], TRUE);
+  }
+  print_row ("(all files)", all_opens, all);
+
+  for (i = 0; i <= N_PHASES; i++)
+    g_array_free (all[i], TRUE);
+  g_strfreev (groups);
+  g_key_file_free (keyfile);
+  g_free (path);
+
+  return TRUE;
+}
+
+void
+open_trace_step (OpenTrace * trace, OpenStep step)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  // Cheap enough to call for every frame
+  if (!g_atomic_int_get (&trace->open))
+    return;
+
+  g_mutex_lock (&trace->lock);
+  if (trace->steps[step] == 0)
+    trace->steps[step] = now;
+  g_mutex_unlock (&trace->lock);
+}
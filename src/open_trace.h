@@ -0,0 +1,65 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __OPEN_TRACE_H__
+#define __OPEN_TRACE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* How many opens of each URI are kept for the summary */
+#define OPEN_TRACE_SAMPLES 16
+/* How many URIs are kept, the least recently opened go first */
+#define OPEN_TRACE_URIS 256
+
+/* Steps of opening a URI, each timed the first time it happens */
+typedef enum
+{
+  OPEN_STEP_READY,              // player back to READY
+  OPEN_STEP_DISCOVERED,         // duration, size and streams known
+  OPEN_STEP_SOURCE,             // source element created
+  OPEN_STEP_SOURCE_READ,        // first bytes out of the source
+  OPEN_STEP_TYPEFIND,           // container type found
+  OPEN_STEP_DEMUX_PAD,          // first stream out of the demuxer
+  OPEN_STEP_DECODER,            // first decoder created
+  OPEN_STEP_DECODED,            // first decoded buffer
+  OPEN_STEP_PREROLLED,          // player in PAUSED
+  OPEN_STEP_FIRST_FRAME,        // first frame at the video sink
+  OPEN_STEP_COUNT
+} OpenStep;
+
+typedef struct _OpenTrace OpenTrace;
+
+/* Steps can be recorded from any thread, the rest is for the main thread.
+ * Finishing prints the breakdown and, if persist was set, saves it from a
+ * thread of its own. */
+void open_trace_begin (OpenTrace * trace, const gchar * uri, gint64 start,
+    gboolean persist);
+void open_trace_finish (OpenTrace * trace);
+void open_trace_free (OpenTrace * trace);
+OpenTrace *open_trace_new (GstElement * pipeline);
+gboolean open_trace_print_summary (void);
+void open_trace_step (OpenTrace * trace, OpenStep step);
+
+G_END_DECLS
+#endif /* __OPEN_TRACE_H__ */
@@ -0,0 +1,709 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "profiler.h"
+#include "utils.h"
+
+#ifdef G_OS_UNIX
+#include <glib-unix.h>
+#include <signal.h>
+#endif
+
+/* What GStreamer's tracers (and GstShark's proctime and queuelevel ones)
+ * measure, gathered in-process with pad probes so it works on any
+ * GStreamer: the time each element takes from a buffer coming in to its
+ * first buffer going out, in the same streaming thread, and how many
+ * buffers wait in each queue. QoS messages give the lateness at the sinks,
+ * and the core latency tracer, when there is one, the source to sink
+ * latency. Everything goes into histograms of powers of two. */
+
+typedef struct
+{
+  guint64 counts[PROFILER_BUCKETS];
+  guint64 n;
+  gdouble sum, max;
+} Histogram;
+
+typedef struct
+{
+  Profiler *profiler;
+  gchar *path;                  // unique, playsink has several "conv"
+  gchar *name, *label, *type_name;
+  gpointer element;             // the latest one at path, not a reference
+  gboolean queue;
+  gint level;                   // atomic, buffers inside a queue
+
+  Histogram time;               // µs per buffer, or queue level samples
+  Histogram late;               // µs late, from QoS
+} ElementStats;
+
+// The element whose buffer the current streaming thread is processing
+typedef struct
+{
+  ElementStats *stats;
+  gint64 time;
+} Entry;
+
+struct _Profiler
+{
+  GstElement *pipeline;
+  GstBus *bus;
+  Scheduler *scheduler;
+  guint sample_id, signal_id;
+  gint64 start;
+  guint dumps;
+
+  GMutex lock;
+  GHashTable *elements;         // path to ElementStats
+  GPtrArray *order;
+  GHashTable *latencies;        // "src -> sink" to Histogram
+};
+
+static GPrivate current_entry = G_PRIVATE_INIT (g_free);
+
+// Declaration of static functions
+static void annotate (Profiler * profiler, GString * dot);
+static GstBusSyncReply bus_sync_cb (GstBus * bus, GstMessage * msg,
+    Profiler * profiler);
+static gint compare_total (ElementStats ** a, ElementStats ** b);
+static void element_stats_free (ElementStats * stats);
+static void histogram_add (Histogram * histogram, gdouble value);
+static gdouble histogram_percentile (Histogram * histogram,
+    gdouble fraction);
+#if GST_CHECK_VERSION(1, 8, 0)
+static void log_cb (GstDebugCategory * category, GstDebugLevel level,
+    const gchar * file, const gchar * function, gint line, GObject * object,
+    GstDebugMessage * message, Profiler * profiler);
+#endif
+static void pad_added_cb (GstElement * element, GstPad * pad,
+    ElementStats * stats);
+static GstPadProbeReturn queue_in_probe_cb (GstPad * pad,
+    GstPadProbeInfo * info, ElementStats * stats);
+static GstPadProbeReturn queue_out_probe_cb (GstPad * pad,
+    GstPadProbeInfo * info, ElementStats * stats);
+static gboolean sample_queues (gpointer data);
+#if defined(G_OS_UNIX) && GLIB_CHECK_VERSION(2, 36, 0)
+static gboolean signal_cb (gpointer data);
+#endif
+static GstPadProbeReturn sink_probe_cb (GstPad * pad, GstPadProbeInfo * info,
+    ElementStats * stats);
+static GstPadProbeReturn src_probe_cb (GstPad * pad, GstPadProbeInfo * info,
+    ElementStats * stats);
+static ElementStats *stats_for (Profiler * profiler, GstElement * element,
+    gboolean queue);
+static void summarise (Profiler * profiler, GString * out);
+static void watch_element (GstElement * element, Profiler * profiler);
+static void watch_pad (ElementStats * stats, GstPad * pad);
+static void watch_pad_item (const GValue * item, ElementStats * stats);
+
+/* ---------------------- static functions ----------------------- */
+
+// Adds the element's numbers under its name in the graph's labels, which
+// read "<type>\n<name>\n..." inside a cluster named after the element's
+// name and address
+static void
+annotate (Profiler * profiler, GString * dot)
+{
+  guint i;
+
+  for (i = 0; i < profiler->order->len; i++) {
+    ElementStats *stats = g_ptr_array_index (profiler->order, i);
+    gchar *cluster, *needle, *note = NULL;
+    const gchar *found;
+
+    if (stats->time.n > 0 && stats->queue)
+      note = g_strdup_printf ("level p50 %.0f p90 %.0f, empty %.0f%%",
+          histogram_percentile (&stats->time, 0.5),
+          histogram_percentile (&stats->time, 0.9),
+          100.0 * stats->time.counts[0] / stats->time.n);
+    else if (stats->time.n > 0)
+      note = g_strdup_printf ("proc p50 %.0f p99 %.0f us, %.1f ms total",
+          histogram_percentile (&stats->time, 0.5),
+          histogram_percentile (&stats->time, 0.99), stats->time.sum / 1000);
+    if (stats->late.n > 0) {
+      gchar *late = g_strdup_printf ("%s%slate %" G_GUINT64_FORMAT
+          " times, p90 %.0f us", note ? note : "", note ? "\\n" : "",
+          stats->late.n, histogram_percentile (&stats->late, 0.9));
+
+      g_free (note);
+      note = late;
+    }
+    if (note == NULL)
+      continue;
+
+    cluster = g_strcanon (g_strdup_printf ("%s_%p", stats->name,
+            stats->element), G_CSET_A_2_Z G_CSET_a_2_z G_CSET_DIGITS "_", '_');
+    needle = g_strdup_printf ("subgraph cluster_%s {", cluster);
+    found = strstr (dot->str, needle);
+    g_free (needle);
+    g_free (cluster);
+
+    needle = g_strdup_printf ("label=\"%s\\n%s\\n", stats->type_name,
+        stats->name);
+    if (found != NULL)
+      found = strstr (found, needle);
+    if (found != NULL) {
+      gssize pos = found - dot->str + strlen (needle);
+
+      g_string_insert (dot, pos, "\\n");
+      g_string_insert (dot, pos, note);
+    }
+
+    g_free (needle);
+    g_free (note);
+  }
+}
+
+// Streaming threads post QoS, the main loop would see it late
+static GstBusSyncReply
+bus_sync_cb (GstBus * bus, GstMessage * msg, Profiler * profiler)
+{
+  GstElement *element;
+  ElementStats *stats;
+  gint64 jitter;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_QOS ||
+      !GST_IS_ELEMENT (GST_MESSAGE_SRC (msg)))
+    return GST_BUS_PASS;
+
+  element = GST_ELEMENT (GST_MESSAGE_SRC (msg));
+  gst_message_parse_qos_values (msg, &jitter, NULL, NULL);
+  if (jitter <= 0)
+    return GST_BUS_PASS;
+
+  stats = stats_for (profiler, element, FALSE);
+  g_mutex_lock (&profiler->lock);
+  histogram_add (&stats->late, jitter / GST_USECOND);
+  g_mutex_unlock (&profiler->lock);
+
+  return GST_BUS_PASS;
+}
+
+// Most total time first, that's the bottleneck
+static gint
+compare_total (ElementStats ** a, ElementStats ** b)
+{
+  return ((*a)->time.sum < (*b)->time.sum) - ((*a)->time.sum > (*b)->time.sum);
+}
+
+static void
+element_stats_free (ElementStats * stats)
+{
+  g_free (stats->path);
+  g_free (stats->name);
+  g_free (stats->label);
+  g_free (stats->type_name);
+  g_free (stats);
+}
+
+static void
+histogram_add (Histogram * histogram, gdouble value)
+{
+  guint bucket = 0;
+
+  if (value >= 1)
+    bucket = MIN (g_bit_storage ((gulong) value), PROFILER_BUCKETS - 1);
+
+  histogram->counts[bucket]++;
+  histogram->n++;
+  histogram->sum += value;
+  histogram->max = MAX (histogram->max, value);
+}
+
+// The top of the bucket the percentile falls in, so at most twice too high
+static gdouble
+histogram_percentile (Histogram * histogram, gdouble fraction)
+{
+  guint64 rank = fraction * histogram->n, seen = 0;
+  guint i;
+
+  if (rank < fraction * histogram->n)
+    rank++;
+
+  for (i = 0; i < PROFILER_BUCKETS; i++) {
+    seen += histogram->counts[i];
+    if (seen >= rank && seen > 0)
+      return MIN (i == 0 ? 0 : (1ul << i) - 1, histogram->max);
+  }
+
+  return histogram->max;
+}
+
+#if GST_CHECK_VERSION(1, 8, 0)
+// Picks the latency tracer's records out of the debug log, anything else
+// goes on to the default log function
+static void
+log_cb (GstDebugCategory * category, GstDebugLevel level, const gchar * file,
+    const gchar * function, gint line, GObject * object,
+    GstDebugMessage * message, Profiler * profiler)
+{
+  GstStructure *record;
+  const gchar *src, *sink;
+  guint64 time;
+
+  if (g_strcmp0 (gst_debug_category_get_name (category), "GST_TRACER")) {
+    gst_debug_log_default (category, level, file, function, line, object,
+        message, NULL);
+    return;
+  }
+
+  record = gst_structure_from_string (gst_debug_message_get (message), NULL);
+  if (record == NULL)
+    return;
+
+  src = gst_structure_get_string (record, "src");
+  sink = gst_structure_get_string (record, "sink");
+  if (gst_structure_has_name (record, "latency") && src && sink &&
+      gst_structure_get_uint64 (record, "time", &time)) {
+    gchar *path = g_strdup_printf ("%s -> %s", src, sink);
+    Histogram *histogram;
+
+    g_mutex_lock (&profiler->lock);
+    histogram = g_hash_table_lookup (profiler->latencies, path);
+    if (histogram == NULL) {
+      histogram = g_new0 (Histogram, 1);
+      g_hash_table_insert (profiler->latencies, path, histogram);
+    } else {
+      g_free (path);
+    }
+    histogram_add (histogram, time / GST_USECOND);
+    g_mutex_unlock (&profiler->lock);
+  }
+
+  gst_structure_free (record);
+}
+#endif
+
+static void
+pad_added_cb (GstElement * element, GstPad * pad, ElementStats * stats)
+{
+  watch_pad (stats, pad);
+}
+
+static GstPadProbeReturn
+queue_in_probe_cb (GstPad * pad, GstPadProbeInfo * info, ElementStats * stats)
+{
+  // A flush empties the queue
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_FLUSH) {
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+        GST_EVENT_FLUSH_STOP)
+      g_atomic_int_set (&stats->level, 0);
+  } else {
+    g_atomic_int_inc (&stats->level);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+queue_out_probe_cb (GstPad * pad, GstPadProbeInfo * info, ElementStats * stats)
+{
+  g_atomic_int_add (&stats->level, -1);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+sample_queues (gpointer data)
+{
+  Profiler *profiler = data;
+  guint i;
+
+  // Paused queues are full for no fault of their own
+  if (GST_STATE (profiler->pipeline) != GST_STATE_PLAYING)
+    return TRUE;
+
+  g_mutex_lock (&profiler->lock);
+  for (i = 0; i < profiler->order->len; i++) {
+    ElementStats *stats = g_ptr_array_index (profiler->order, i);
+
+    if (stats->queue)
+      histogram_add (&stats->time, MAX (g_atomic_int_get (&stats->level), 0));
+  }
+  g_mutex_unlock (&profiler->lock);
+
+  return TRUE;
+}
+
+#if defined(G_OS_UNIX) && GLIB_CHECK_VERSION(2, 36, 0)
+static gboolean
+signal_cb (gpointer data)
+{
+  profiler_dump (data);
+
+  return TRUE;
+}
+#endif
+
+static GstPadProbeReturn
+sink_probe_cb (GstPad * pad, GstPadProbeInfo * info, ElementStats * stats)
+{
+  Entry *entry = g_private_get (&current_entry);
+
+  if (entry == NULL) {
+    entry = g_new0 (Entry, 1);
+    g_private_set (&current_entry, entry);
+  }
+  entry->stats = stats;
+  entry->time = g_get_monotonic_time ();
+
+  return GST_PAD_PROBE_OK;
+}
+
+// Only the first buffer out per buffer in counts, before it goes downstream
+static GstPadProbeReturn
+src_probe_cb (GstPad * pad, GstPadProbeInfo * info, ElementStats * stats)
+{
+  Entry *entry = g_private_get (&current_entry);
+  gint64 elapsed;
+
+  if (entry == NULL || entry->stats != stats)
+    return GST_PAD_PROBE_OK;
+
+  elapsed = g_get_monotonic_time () - entry->time;
+  entry->stats = NULL;
+
+  g_mutex_lock (&stats->profiler->lock);
+  histogram_add (&stats->time, elapsed);
+  g_mutex_unlock (&stats->profiler->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static ElementStats *
+stats_for (Profiler * profiler, GstElement * element, gboolean queue)
+{
+  ElementStats *stats;
+  GstObject *parent;
+  gchar *path = gst_object_get_path_string (GST_OBJECT (element));
+
+  g_mutex_lock (&profiler->lock);
+  stats = g_hash_table_lookup (profiler->elements, path);
+  if (stats == NULL) {
+    stats = g_new0 (ElementStats, 1);
+    stats->profiler = profiler;
+    stats->path = path;
+    stats->name = gst_object_get_name (GST_OBJECT (element));
+    stats->type_name = g_strdup (G_OBJECT_TYPE_NAME (element));
+    stats->queue = queue;
+
+    // The parent's name is enough to tell apart the tables' rows
+    parent = gst_object_get_parent (GST_OBJECT (element));
+    if (parent != NULL) {
+      stats->label = g_strdup_printf ("%s/%s", GST_OBJECT_NAME (parent),
+          stats->name);
+      gst_object_unref (parent);
+    } else {
+      stats->label = g_strdup (stats->name);
+    }
+
+    g_hash_table_insert (profiler->elements, stats->path, stats);
+    g_ptr_array_add (profiler->order, stats);
+  } else {
+    g_free (path);
+  }
+  stats->element = element;
+  g_mutex_unlock (&profiler->lock);
+
+  return stats;
+}
+
+static void
+summarise (Profiler * profiler, GString * out)
+{
+  GPtrArray *sorted = g_ptr_array_sized_new (profiler->order->len);
+  GHashTableIter iter;
+  gpointer key, value;
+  guint i;
+
+  for (i = 0; i < profiler->order->len; i++)
+    g_ptr_array_add (sorted, g_ptr_array_index (profiler->order, i));
+  g_ptr_array_sort (sorted, (GCompareFunc) compare_total);
+
+  g_string_append_printf (out, "Profile of the last %.1f s\n",
+      (g_get_monotonic_time () - profiler->start) /
+      (gdouble) G_TIME_SPAN_SECOND);
+
+  g_string_append_printf (out, "\nProcessing time per buffer in us, most "
+      "total time first:\n  %-28s %8s %9s %7s %7s %7s %7s\n", "element",
+      "buffers", "total ms", "mean", "p50", "p99", "max");
+  for (i = 0; i < sorted->len; i++) {
+    ElementStats *stats = g_ptr_array_index (sorted, i);
+
+    if (stats->queue || stats->time.n == 0)
+      continue;
+    g_string_append_printf (out, "  %-28s %8" G_GUINT64_FORMAT
+        " %9.1f %7.0f %7.0f %7.0f %7.0f\n", stats->label, stats->time.n,
+        stats->time.sum / 1000, stats->time.sum / stats->time.n,
+        histogram_percentile (&stats->time, 0.5),
+        histogram_percentile (&stats->time, 0.99), stats->time.max);
+  }
+
+  g_string_append_printf (out, "\nQueue levels in buffers, every %d ms "
+      "while playing:\n  %-28s %8s %6s %5s %5s %5s %6s\n",
+      PROFILER_SAMPLE_INTERVAL, "queue", "samples", "mean", "p50", "p90",
+      "max", "empty");
+  for (i = 0; i < sorted->len; i++) {
+    ElementStats *stats = g_ptr_array_index (sorted, i);
+
+    if (!stats->queue || stats->time.n == 0)
+      continue;
+    g_string_append_printf (out, "  %-28s %8" G_GUINT64_FORMAT
+        " %6.1f %5.0f %5.0f %5.0f %5.0f%%\n", stats->label, stats->time.n,
+        stats->time.sum / stats->time.n,
+        histogram_percentile (&stats->time, 0.5),
+        histogram_percentile (&stats->time, 0.9), stats->time.max,
+        100.0 * stats->time.counts[0] / stats->time.n);
+  }
+
+  g_string_append_printf (out, "\nLate buffers from QoS, in us:\n"
+      "  %-28s %8s %7s %7s %7s\n", "element", "late", "p50", "p90", "max");
+  for (i = 0; i < sorted->len; i++) {
+    ElementStats *stats = g_ptr_array_index (sorted, i);
+
+    if (stats->late.n == 0)
+      continue;
+    g_string_append_printf (out, "  %-28s %8" G_GUINT64_FORMAT
+        " %7.0f %7.0f %7.0f\n", stats->label, stats->late.n,
+        histogram_percentile (&stats->late, 0.5),
+        histogram_percentile (&stats->late, 0.9), stats->late.max);
+  }
+
+  if (g_hash_table_size (profiler->latencies) > 0)
+    g_string_append_printf (out, "\nSource to sink latency from the latency "
+        "tracer, in us:\n  %-40s %8s %7s %7s %7s\n", "path", "buffers",
+        "p50", "p99", "max");
+  g_hash_table_iter_init (&iter, profiler->latencies);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    Histogram *histogram = value;
+
+    g_string_append_printf (out, "  %-40s %8" G_GUINT64_FORMAT
+        " %7.0f %7.0f %7.0f\n", (gchar *) key, histogram->n,
+        histogram_percentile (histogram, 0.5),
+        histogram_percentile (histogram, 0.99), histogram->max);
+  }
+
+  g_ptr_array_free (sorted, TRUE);
+}
+
+// Called from whichever thread added the element, often a streaming one
+static void
+watch_element (GstElement * element, Profiler * profiler)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+  const gchar *klass, *factory_name;
+  ElementStats *stats;
+  GstIterator *it;
+  gboolean queue;
+
+  // Bins only hold the elements that do the work
+  if (GST_IS_BIN (element) || factory == NULL)
+    return;
+
+  // Sources wait on I/O and sinks on the clock, neither is processing
+  klass = gst_element_factory_get_metadata (factory,
+      GST_ELEMENT_METADATA_KLASS);
+  if (strstr (klass, "Source") != NULL || strstr (klass, "Sink") != NULL)
+    return;
+
+  factory_name = GST_OBJECT_NAME (factory);
+  queue = !g_strcmp0 (factory_name, "queue") ||
+      !g_strcmp0 (factory_name, "queue2") ||
+      !g_strcmp0 (factory_name, "multiqueue");
+
+  stats = stats_for (profiler, element, queue);
+  g_atomic_int_set (&stats->level, 0);
+
+  g_signal_handlers_disconnect_by_func (element, pad_added_cb, stats);
+  g_signal_connect (element, "pad-added", G_CALLBACK (pad_added_cb), stats);
+
+  it = gst_element_iterate_pads (element);
+  gst_iterator_foreach (it, (GstIteratorForeachFunction) watch_pad_item,
+      stats);
+  gst_iterator_free (it);
+}
+
+static void
+watch_pad (ElementStats * stats, GstPad * pad)
+{
+  gboolean sink = GST_PAD_DIRECTION (pad) == GST_PAD_SINK;
+
+  // Pads of re-added elements are already probed
+  if (g_object_get_data (G_OBJECT (pad), "snappy-profiler") != NULL)
+    return;
+  g_object_set_data (G_OBJECT (pad), "snappy-profiler", stats);
+
+  if (stats->queue && sink)
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+        (GstPadProbeCallback) queue_in_probe_cb, stats, NULL);
+  else if (stats->queue)
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) queue_out_probe_cb, stats, NULL);
+  else if (sink)
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) sink_probe_cb, stats, NULL);
+  else
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) src_probe_cb, stats, NULL);
+}
+
+static void
+watch_pad_item (const GValue * item, ElementStats * stats)
+{
+  watch_pad (stats, g_value_get_object (item));
+}
+
+/* -------------------- non-static functions --------------------- */
+
+/* Prints the summary and writes the pipeline graph with the numbers of
+ * each element in its label */
+void
+profiler_dump (Profiler * profiler)
+{
+  GString *summary = g_string_new (NULL);
+
+  g_mutex_lock (&profiler->lock);
+  summarise (profiler, summary);
+  g_mutex_unlock (&profiler->lock);
+  g_print ("%s", summary->str);
+  g_string_free (summary, TRUE);
+
+#if GST_CHECK_VERSION(1, 6, 0)
+  {
+    const gchar *dir = g_getenv ("GST_DEBUG_DUMP_DOT_DIR");
+    gchar *data, *path;
+    GString *dot;
+
+    data = gst_debug_bin_to_dot_data (GST_BIN (profiler->pipeline),
+        GST_DEBUG_GRAPH_SHOW_ALL);
+    dot = g_string_new (data);
+    g_free (data);
+
+    g_mutex_lock (&profiler->lock);
+    annotate (profiler, dot);
+    g_mutex_unlock (&profiler->lock);
+
+    path = g_strdup_printf ("%s/snappy-profile-%d-%u.dot",
+        dir ? dir : g_get_tmp_dir (), getpid (), ++profiler->dumps);
+    if (g_file_set_contents (path, dot->str, dot->len, NULL))
+      g_print ("\nPipeline graph with timings: %s\n", path);
+
+    g_free (path);
+    g_string_free (dot, TRUE);
+  }
+#else
+  // Without the graph as text there is nothing to annotate
+  GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (profiler->pipeline),
+      GST_DEBUG_GRAPH_SHOW_ALL, "snappy-profile");
+#endif
+}
+
+void
+profiler_free (Profiler * profiler)
+{
+#if defined(G_OS_UNIX) && GLIB_CHECK_VERSION(2, 36, 0)
+  g_source_remove (profiler->signal_id);
+#endif
+  scheduler_remove (profiler->scheduler, profiler->sample_id);
+
+  gst_bus_set_sync_handler (profiler->bus, NULL, NULL, NULL);
+  gst_object_unref (profiler->bus);
+
+#if GST_CHECK_VERSION(1, 8, 0)
+  gst_debug_remove_log_function_by_data (profiler);
+  gst_debug_add_log_function (gst_debug_log_default, NULL, NULL);
+#endif
+
+  // The pipeline is stopped, none of its probes will run again
+  gst_object_unref (profiler->pipeline);
+
+  g_hash_table_destroy (profiler->latencies);
+  g_hash_table_destroy (profiler->elements);
+  g_ptr_array_free (profiler->order, TRUE);
+  g_mutex_clear (&profiler->lock);
+  g_free (profiler);
+}
+
+Profiler *
+profiler_new (GstElement * pipeline, Scheduler * scheduler)
+{
+  Profiler *profiler = g_new0 (Profiler, 1);
+
+  g_mutex_init (&profiler->lock);
+  profiler->elements = g_hash_table_new (g_str_hash, g_str_equal);
+  profiler->order =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) element_stats_free);
+  profiler->latencies = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_free);
+  profiler->pipeline = gst_object_ref (pipeline);
+  profiler->scheduler = scheduler;
+  profiler->start = g_get_monotonic_time ();
+
+  watch_elements (pipeline, (WatchElementFunc) watch_element, profiler);
+
+  profiler->bus = gst_element_get_bus (pipeline);
+  gst_bus_set_sync_handler (profiler->bus, (GstBusSyncHandler) bus_sync_cb,
+      profiler, NULL);
+
+  profiler->sample_id = scheduler_add (scheduler, PROFILER_SAMPLE_INTERVAL,
+      sample_queues, profiler);
+
+#if GST_CHECK_VERSION(1, 8, 0)
+  // The latency tracer logs its records at TRACE level
+  gst_debug_set_threshold_for_name ("GST_TRACER", GST_LEVEL_TRACE);
+  gst_debug_remove_log_function (gst_debug_log_default);
+  gst_debug_add_log_function ((GstLogFunction) log_cb, profiler, NULL);
+#endif
+
+#if defined(G_OS_UNIX) && GLIB_CHECK_VERSION(2, 36, 0)
+  profiler->signal_id = g_unix_signal_add (SIGUSR1, signal_cb, profiler);
+  g_print ("Profiling: press p, or send SIGUSR1 to %d, for a summary\n",
+      getpid ());
+#else
+  g_print ("Profiling: press p for a summary\n");
+#endif
+
+  return profiler;
+}
+
+/* The core latency tracer is only loaded by gst_init() */
+void
+profiler_setup (void)
+{
+#if GST_CHECK_VERSION(1, 8, 0)
+  const gchar *tracers = g_getenv ("GST_TRACERS");
+
+  // Keep whatever tracers were asked for already
+  if (tracers == NULL || *tracers == '\0') {
+    g_setenv ("GST_TRACERS", "latency", TRUE);
+  } else if (strstr (tracers, "latency") == NULL) {
+    gchar *all = g_strdup_printf ("%s;latency", tracers);
+
+    g_setenv ("GST_TRACERS", all, TRUE);
+    g_free (all);
+  }
+#endif
+}
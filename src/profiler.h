@@ -0,0 +1,48 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <gst/gst.h>
+
+#include "scheduler.h"
+
+G_BEGIN_DECLS
+
+/* Histogram buckets, powers of two from 1 */
+#define PROFILER_BUCKETS 32
+/* How often queue levels are sampled, in ms */
+#define PROFILER_SAMPLE_INTERVAL 100
+
+typedef struct _Profiler Profiler;
+
+/* Profiles every element of the pipeline: processing time per buffer,
+ * queue levels, QoS lateness and, where GStreamer has the tracer, source
+ * to sink latency. profiler_setup() has to run before gst_init() */
+void profiler_dump (Profiler * profiler);
+void profiler_free (Profiler * profiler);
+Profiler *profiler_new (GstElement * pipeline, Scheduler * scheduler);
+void profiler_setup (void);
+
+G_END_DECLS
+#endif /* __PROFILER_H__ */
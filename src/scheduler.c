@@ -0,0 +1,267 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "scheduler.h"
+
+/* Every periodic task snappy runs goes through one GSource, so whatever is
+ * due around the same time shares a single wakeup. Tasks may run up to a
+ * fraction of their interval late to line up with each other. */
+
+#define SCHEDULER_SLACK_RATIO 8
+#define SCHEDULER_MAX_SLACK (G_TIME_SPAN_SECOND / 2)
+
+typedef struct _SchedulerTask SchedulerTask;
+
+struct _SchedulerTask
+{
+  guint id;
+  gint64 interval;
+  gint64 deadline;
+
+  GSourceFunc func;
+  gpointer data;
+};
+
+struct _Scheduler
+{
+  gboolean suspended, dispatching;
+  gboolean idle;
+  guint next_id;
+
+  guint64 idle_wakeups;
+  gint64 idle_since, idle_time;
+
+  GList *tasks;
+  GSource *source;
+};
+
+static gboolean
+scheduler_source_dispatch (GSource * source, GSourceFunc callback,
+    gpointer user_data)
+{
+  return callback (user_data);
+}
+
+static GSourceFuncs scheduler_source_funcs = {
+  NULL,
+  NULL,
+  scheduler_source_dispatch,
+  NULL
+};
+
+static void
+scheduler_rearm (Scheduler * scheduler)
+{
+  GList *l;
+  gint64 wakeup = -1;
+
+  if (!scheduler->suspended) {
+    // Wake up when the least patient task runs out of slack
+    for (l = scheduler->tasks; l != NULL; l = l->next) {
+      SchedulerTask *task = l->data;
+      gint64 latest;
+
+      if (task->func == NULL)
+        continue;
+
+      latest = task->deadline + MIN (task->interval / SCHEDULER_SLACK_RATIO,
+          SCHEDULER_MAX_SLACK);
+      if (wakeup == -1 || latest < wakeup)
+        wakeup = latest;
+    }
+  }
+
+  g_source_set_ready_time (scheduler->source, wakeup);
+}
+
+static gboolean
+scheduler_dispatch (gpointer data)
+{
+  Scheduler *scheduler = data;
+  GList *l, *next;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+  if (scheduler->idle)
+    scheduler->idle_wakeups++;
+
+  // Tasks may add or remove tasks from their callbacks. New ones are
+  // prepended and removed ones only cleared until the walk is over.
+  scheduler->dispatching = TRUE;
+  for (l = scheduler->tasks; l != NULL; l = l->next) {
+    SchedulerTask *task = l->data;
+
+    if (task->func == NULL || task->deadline > now)
+      continue;
+
+    if (!task->func (task->data)) {
+      task->func = NULL;
+    } else if (task->func != NULL) {
+      task->deadline += task->interval;
+      if (task->deadline <= now)
+        task->deadline = now + task->interval;
+    }
+  }
+  scheduler->dispatching = FALSE;
+
+  for (l = scheduler->tasks; l != NULL; l = next) {
+    SchedulerTask *task = l->data;
+
+    next = l->next;
+    if (task->func == NULL) {
+      scheduler->tasks = g_list_delete_link (scheduler->tasks, l);
+      g_free (task);
+    }
+  }
+
+  scheduler_rearm (scheduler);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* -------------------- non-static functions --------------------- */
+
+guint
+scheduler_add (Scheduler * scheduler, guint interval, GSourceFunc func,
+    gpointer data)
+{
+  SchedulerTask *task;
+
+  g_return_val_if_fail (func != NULL, 0);
+
+  task = g_new0 (SchedulerTask, 1);
+  task->id = ++scheduler->next_id;
+  task->interval = MAX (interval, 1) * (G_TIME_SPAN_SECOND / 1000);
+  task->deadline = g_get_monotonic_time () + task->interval;
+  task->func = func;
+  task->data = data;
+
+  scheduler->tasks = g_list_prepend (scheduler->tasks, task);
+  if (!scheduler->dispatching)
+    scheduler_rearm (scheduler);
+
+  return task->id;
+}
+
+void
+scheduler_free (Scheduler * scheduler)
+{
+  g_source_destroy (scheduler->source);
+  g_source_unref (scheduler->source);
+
+  g_list_free_full (scheduler->tasks, g_free);
+  g_free (scheduler);
+}
+
+gdouble
+scheduler_get_idle_wakeup_rate (Scheduler * scheduler)
+{
+  gint64 idle_time = scheduler->idle_time;
+
+  if (scheduler->idle)
+    idle_time += g_get_monotonic_time () - scheduler->idle_since;
+
+  if (idle_time <= 0)
+    return 0.0;
+
+  return (gdouble) scheduler->idle_wakeups * G_TIME_SPAN_SECOND / idle_time;
+}
+
+Scheduler *
+scheduler_new (void)
+{
+  Scheduler *scheduler;
+
+  scheduler = g_new0 (Scheduler, 1);
+
+  scheduler->source = g_source_new (&scheduler_source_funcs, sizeof (GSource));
+  g_source_set_name (scheduler->source, "snappy scheduler");
+  g_source_set_callback (scheduler->source, scheduler_dispatch, scheduler,
+      NULL);
+  g_source_set_ready_time (scheduler->source, -1);
+  g_source_attach (scheduler->source, NULL);
+
+  return scheduler;
+}
+
+void
+scheduler_remove (Scheduler * scheduler, guint id)
+{
+  GList *l;
+
+  for (l = scheduler->tasks; l != NULL; l = l->next) {
+    SchedulerTask *task = l->data;
+
+    if (task->id != id)
+      continue;
+
+    if (scheduler->dispatching) {
+      task->func = NULL;
+    } else {
+      scheduler->tasks = g_list_delete_link (scheduler->tasks, l);
+      g_free (task);
+      scheduler_rearm (scheduler);
+    }
+    break;
+  }
+}
+
+void
+scheduler_set_idle (Scheduler * scheduler, gboolean idle)
+{
+  // Account wakeups separately while nothing is being shown to the user
+  if (scheduler->idle == idle)
+    return;
+
+  if (idle)
+    scheduler->idle_since = g_get_monotonic_time ();
+  else
+    scheduler->idle_time += g_get_monotonic_time () - scheduler->idle_since;
+
+  scheduler->idle = idle;
+}
+
+void
+scheduler_set_suspended (Scheduler * scheduler, gboolean suspended)
+{
+  GList *l;
+  gint64 now;
+
+  if (scheduler->suspended == suspended)
+    return;
+
+  scheduler->suspended = suspended;
+
+  // Overdue tasks run once on resume rather than catching up every period
+  if (!suspended) {
+    now = g_get_monotonic_time ();
+    for (l = scheduler->tasks; l != NULL; l = l->next) {
+      SchedulerTask *task = l->data;
+
+      if (task->deadline < now)
+        task->deadline = now;
+    }
+  }
+
+  if (!scheduler->dispatching)
+    scheduler_rearm (scheduler);
+}
@@ -0,0 +1,42 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _Scheduler Scheduler;
+
+guint scheduler_add (Scheduler * scheduler, guint interval, GSourceFunc func,
+    gpointer data);
+void scheduler_free (Scheduler * scheduler);
+gdouble scheduler_get_idle_wakeup_rate (Scheduler * scheduler);
+Scheduler *scheduler_new (void);
+void scheduler_remove (Scheduler * scheduler, guint id);
+void scheduler_set_idle (Scheduler * scheduler, gboolean idle);
+void scheduler_set_suspended (Scheduler * scheduler, gboolean suspended);
+
+G_END_DECLS
+#endif /* __SCHEDULER_H__ */
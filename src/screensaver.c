@@ -54,6 +54,7 @@
 struct _ScreenSaver
 {
   ClutterStage *stage;
+  Scheduler *scheduler;
   gboolean disabled;
 
 #ifdef HAVE_X11
@@ -76,6 +77,7 @@ struct _ScreenSaver
   gint keycode1, keycode2;
   gint *keycode;
   gboolean have_xtest;
+  guint keepalive_id;
 #endif
 #endif
 };
@@ -219,7 +221,10 @@ screensaver_enable_x11 (ScreenSaver * screensaver)
 
 #ifdef HAVE_XTEST
   if (screensaver->have_xtest) {
-    g_source_remove_by_user_data (screensaver);
+    if (screensaver->keepalive_id != 0) {
+      scheduler_remove (screensaver->scheduler, screensaver->keepalive_id);
+      screensaver->keepalive_id = 0;
+    }
     return;
   }
 #endif
@@ -265,12 +270,13 @@ screensaver_disable_x11 (ScreenSaver * screensaver)
         &screensaver->prefer_blanking, &screensaver->allow_exposures);
     XUnlockDisplay (screensaver->display);
 
-    if (screensaver->timeout != 0) {
-      g_timeout_add_seconds (screensaver->timeout / 2,
-          (GSourceFunc) fake_event, screensaver);
-    } else {
-      g_timeout_add_seconds (XSCREENSAVER_MIN_TIMEOUT / 2,
-          (GSourceFunc) fake_event, screensaver);
+    /* The keepalive shares the scheduler's wakeups with the interface */
+    if (screensaver->keepalive_id == 0) {
+      gint timeout = screensaver->timeout != 0 ?
+          screensaver->timeout : XSCREENSAVER_MIN_TIMEOUT;
+
+      screensaver->keepalive_id = scheduler_add (screensaver->scheduler,
+          timeout / 2 * 1000, (GSourceFunc) fake_event, screensaver);
     }
 
     return;
@@ -316,7 +322,10 @@ screensaver_init_x11 (ScreenSaver * screensaver)
 static void
 screensaver_free_x11 (ScreenSaver * screensaver)
 {
-  g_source_remove_by_user_data (screensaver);
+#ifdef HAVE_XTEST
+  if (screensaver->keepalive_id != 0)
+    scheduler_remove (screensaver->scheduler, screensaver->keepalive_id);
+#endif
 }
 #endif
 
@@ -355,7 +364,7 @@ screensaver_free (ScreenSaver * screensaver)
 }
 
 ScreenSaver *
-screensaver_new (ClutterStage * stage)
+screensaver_new (ClutterStage * stage, Scheduler * scheduler)
 {
   ScreenSaver *screensaver;
 
@@ -363,6 +372,7 @@ screensaver_new (ClutterStage * stage)
 
   screensaver->disabled = FALSE;
   screensaver->stage = stage;
+  screensaver->scheduler = scheduler;
 
 #if HAVE_X11
   screensaver->display = clutter_x11_get_default_display ();
@@ -26,13 +26,15 @@
 #include <glib.h>
 #include <clutter/clutter.h>
 
+#include "scheduler.h"
+
 G_BEGIN_DECLS
 
 typedef struct _ScreenSaver ScreenSaver;
 
 void screensaver_enable (ScreenSaver * screensaver, gboolean enable);
 void screensaver_free (ScreenSaver * screensaver);
-ScreenSaver *screensaver_new (ClutterStage * stage);
+ScreenSaver *screensaver_new (ClutterStage * stage, Scheduler * scheduler);
 
 G_END_DECLS
 #endif /* __SCREENSAVER_H__ */
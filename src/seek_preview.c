@@ -0,0 +1,370 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "seek_preview.h"
+#include "thumbnailer.h"
+
+/* Previews come from a second, decode-only pipeline on the same file,
+ * driven by its own thread so the main loop never waits on it. Only the
+ * latest hovered position is decoded, older ones are simply replaced.
+ * A key-unit seek lands on the keyframe before the position, and the same
+ * picture stands for every position up to the next keyframe, so cached
+ * previews are keyed by that keyframe and the span they were asked for. */
+
+typedef struct _SeekPreviewEntry SeekPreviewEntry;
+typedef struct _SeekPreviewResult SeekPreviewResult;
+
+struct _SeekPreview
+{
+  guint size;
+
+  GThread *thread;
+  GCancellable *cancellable;
+  GMutex lock;
+  GCond cond;
+
+  /* Shared with the thread, under lock */
+  gchar *uri;
+  gboolean uri_changed, quit;
+  guint generation;
+  GstClockTime wanted;
+  gint64 qos_time;
+  GList *results;
+  guint deliver_id;
+
+  /* Main thread only, most recently used first */
+  GQueue cache;
+
+  SeekPreviewFunc func;
+  gpointer data;
+};
+
+struct _SeekPreviewEntry
+{
+  GstClockTime keyframe, covered_end;
+  ClutterContent *content;
+};
+
+struct _SeekPreviewResult
+{
+  guint generation;
+  GstClockTime position, keyframe;
+  GdkPixbuf *pixbuf;
+};
+
+// Declaration of static functions
+static void cache_clear (SeekPreview * preview);
+static void cache_insert (SeekPreview * preview, GstClockTime keyframe,
+    GstClockTime position, ClutterContent * content);
+static ClutterContent *content_from_pixbuf (GdkPixbuf * pixbuf);
+static gboolean deliver_results (gpointer data);
+static void result_free (SeekPreviewResult * result);
+static gpointer run_thread (gpointer data);
+
+/* ---------------------- static functions ----------------------- */
+
+static void
+cache_clear (SeekPreview * preview)
+{
+  SeekPreviewEntry *entry;
+
+  while ((entry = g_queue_pop_head (&preview->cache))) {
+    g_object_unref (entry->content);
+    g_free (entry);
+  }
+}
+
+static void
+cache_insert (SeekPreview * preview, GstClockTime keyframe,
+    GstClockTime position, ClutterContent * content)
+{
+  SeekPreviewEntry *entry;
+  GList *l;
+
+  for (l = preview->cache.head; l != NULL; l = l->next) {
+    entry = l->data;
+    if (entry->keyframe == keyframe) {
+      // Same picture, it now also stands for this position
+      entry->covered_end = MAX (entry->covered_end, position);
+      g_queue_unlink (&preview->cache, l);
+      g_queue_push_head_link (&preview->cache, l);
+      g_object_unref (content);
+      return;
+    }
+  }
+
+  entry = g_new (SeekPreviewEntry, 1);
+  entry->keyframe = keyframe;
+  entry->covered_end = MAX (keyframe, position);
+  entry->content = content;
+  g_queue_push_head (&preview->cache, entry);
+
+  if (g_queue_get_length (&preview->cache) > SEEK_PREVIEW_CACHE_SIZE) {
+    entry = g_queue_pop_tail (&preview->cache);
+    g_object_unref (entry->content);
+    g_free (entry);
+  }
+}
+
+static ClutterContent *
+content_from_pixbuf (GdkPixbuf * pixbuf)
+{
+  ClutterContent *image;
+
+  image = clutter_image_new ();
+  if (!clutter_image_set_data (CLUTTER_IMAGE (image),
+          gdk_pixbuf_get_pixels (pixbuf),
+          gdk_pixbuf_get_has_alpha (pixbuf) ?
+          COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888,
+          gdk_pixbuf_get_width (pixbuf), gdk_pixbuf_get_height (pixbuf),
+          gdk_pixbuf_get_rowstride (pixbuf), NULL)) {
+    g_object_unref (image);
+    return NULL;
+  }
+
+  return image;
+}
+
+static gboolean
+deliver_results (gpointer data)
+{
+  SeekPreview *preview = data;
+  SeekPreviewResult *result;
+  ClutterContent *content;
+  GList *results, *l;
+  guint generation;
+
+  g_mutex_lock (&preview->lock);
+  results = g_list_reverse (preview->results);
+  preview->results = NULL;
+  preview->deliver_id = 0;
+  generation = preview->generation;
+  g_mutex_unlock (&preview->lock);
+
+  for (l = results; l != NULL; l = l->next) {
+    result = l->data;
+
+    // Taken from a file that is no longer playing
+    if (result->generation != generation)
+      continue;
+
+    content = content_from_pixbuf (result->pixbuf);
+    if (content == NULL)
+      continue;
+
+    cache_insert (preview, result->keyframe, result->position, content);
+    preview->func (preview, result->position,
+        seek_preview_lookup (preview, result->position), preview->data);
+  }
+
+  g_list_free_full (results, (GDestroyNotify) result_free);
+
+  return FALSE;
+}
+
+static void
+result_free (SeekPreviewResult * result)
+{
+  g_object_unref (result->pixbuf);
+  g_free (result);
+}
+
+static gpointer
+run_thread (gpointer data)
+{
+  SeekPreview *preview = data;
+  SeekPreviewResult *result;
+  FrameGrabber *grabber = NULL;
+  GdkPixbuf *pixbuf;
+  GstClockTime position, keyframe;
+  gchar *uri = NULL;
+  gboolean failed = FALSE;
+  gint64 resume;
+  guint generation;
+
+  g_mutex_lock (&preview->lock);
+  while (!preview->quit) {
+    if (preview->uri_changed) {
+      // The pipeline is only built once there is something to preview
+      preview->uri_changed = FALSE;
+      g_free (uri);
+      uri = g_strdup (preview->uri);
+      failed = FALSE;
+
+      g_mutex_unlock (&preview->lock);
+      if (grabber != NULL)
+        frame_grabber_free (grabber);
+      grabber = NULL;
+      g_mutex_lock (&preview->lock);
+      continue;
+    }
+
+    if (!GST_CLOCK_TIME_IS_VALID (preview->wanted)) {
+      g_cond_wait (&preview->cond, &preview->lock);
+      continue;
+    }
+
+    // Keep out of the way while playback is struggling; hovering goes on
+    // replacing the wanted position meanwhile
+    resume = preview->qos_time + SEEK_PREVIEW_BACKOFF;
+    if (preview->qos_time > 0 && g_get_monotonic_time () < resume) {
+      g_cond_wait_until (&preview->cond, &preview->lock, resume);
+      continue;
+    }
+
+    position = preview->wanted;
+    preview->wanted = GST_CLOCK_TIME_NONE;
+    generation = preview->generation;
+    g_mutex_unlock (&preview->lock);
+
+    // A file that can't be previewed isn't tried again on every hover
+    if (grabber == NULL && uri != NULL && !failed) {
+      grabber = frame_grabber_new (uri, preview->size, preview->cancellable,
+          NULL);
+      failed = grabber == NULL;
+    }
+
+    keyframe = GST_CLOCK_TIME_NONE;
+    pixbuf = NULL;
+    if (grabber != NULL)
+      pixbuf = frame_grabber_grab (grabber, position, &keyframe,
+          preview->cancellable, NULL);
+
+    g_mutex_lock (&preview->lock);
+    if (pixbuf != NULL) {
+      result = g_new (SeekPreviewResult, 1);
+      result->generation = generation;
+      result->position = position;
+      result->keyframe = GST_CLOCK_TIME_IS_VALID (keyframe) ?
+          keyframe : position;
+      result->pixbuf = pixbuf;
+
+      // Textures can only be made on the main thread
+      preview->results = g_list_prepend (preview->results, result);
+      if (preview->deliver_id == 0)
+        preview->deliver_id = g_idle_add (deliver_results, preview);
+    }
+  }
+  g_mutex_unlock (&preview->lock);
+
+  if (grabber != NULL)
+    frame_grabber_free (grabber);
+  g_free (uri);
+
+  return NULL;
+}
+
+/* -------------------- non-static functions --------------------- */
+
+void
+seek_preview_free (SeekPreview * preview)
+{
+  g_mutex_lock (&preview->lock);
+  preview->quit = TRUE;
+  g_cond_signal (&preview->cond);
+  g_mutex_unlock (&preview->lock);
+
+  // Stops the thread waiting on a file that is slow to open or seek
+  g_cancellable_cancel (preview->cancellable);
+  g_thread_join (preview->thread);
+  g_object_unref (preview->cancellable);
+
+  if (preview->deliver_id != 0)
+    g_source_remove (preview->deliver_id);
+  g_list_free_full (preview->results, (GDestroyNotify) result_free);
+  cache_clear (preview);
+
+  g_mutex_clear (&preview->lock);
+  g_cond_clear (&preview->cond);
+  g_free (preview->uri);
+  g_free (preview);
+}
+
+ClutterContent *
+seek_preview_lookup (SeekPreview * preview, GstClockTime position)
+{
+  SeekPreviewEntry *entry;
+  GList *l;
+
+  for (l = preview->cache.head; l != NULL; l = l->next) {
+    entry = l->data;
+    if (position >= entry->keyframe && position <= entry->covered_end) {
+      g_queue_unlink (&preview->cache, l);
+      g_queue_push_head_link (&preview->cache, l);
+      return entry->content;
+    }
+  }
+
+  return NULL;
+}
+
+SeekPreview *
+seek_preview_new (guint size, SeekPreviewFunc func, gpointer data)
+{
+  SeekPreview *preview;
+
+  preview = g_new0 (SeekPreview, 1);
+  preview->size = size;
+  preview->wanted = GST_CLOCK_TIME_NONE;
+  preview->func = func;
+  preview->data = data;
+  g_mutex_init (&preview->lock);
+  g_cond_init (&preview->cond);
+  g_queue_init (&preview->cache);
+  preview->cancellable = g_cancellable_new ();
+
+  preview->thread = g_thread_new ("seek-preview", run_thread, preview);
+
+  return preview;
+}
+
+void
+seek_preview_report_qos (SeekPreview * preview)
+{
+  g_mutex_lock (&preview->lock);
+  preview->qos_time = g_get_monotonic_time ();
+  g_mutex_unlock (&preview->lock);
+}
+
+void
+seek_preview_request (SeekPreview * preview, GstClockTime position)
+{
+  g_mutex_lock (&preview->lock);
+  preview->wanted = position;
+  g_cond_signal (&preview->cond);
+  g_mutex_unlock (&preview->lock);
+}
+
+void
+seek_preview_set_uri (SeekPreview * preview, const gchar * uri)
+{
+  cache_clear (preview);
+
+  g_mutex_lock (&preview->lock);
+  g_free (preview->uri);
+  preview->uri = g_strdup (uri);
+  preview->uri_changed = TRUE;
+  preview->generation++;
+  preview->wanted = GST_CLOCK_TIME_NONE;
+  g_cond_signal (&preview->cond);
+  g_mutex_unlock (&preview->lock);
+}
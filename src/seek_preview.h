@@ -0,0 +1,54 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __SEEK_PREVIEW_H__
+#define __SEEK_PREVIEW_H__
+
+#include <clutter/clutter.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Largest side of a preview, in pixels */
+#define SEEK_PREVIEW_SIZE 160
+/* Previews kept around, least recently shown dropped first */
+#define SEEK_PREVIEW_CACHE_SIZE 64
+/* How long previews hold off after the main pipeline ran late */
+#define SEEK_PREVIEW_BACKOFF (G_TIME_SPAN_SECOND / 2)
+
+typedef struct _SeekPreview SeekPreview;
+
+/* Called on the main thread when a preview covering position is ready */
+typedef void (*SeekPreviewFunc) (SeekPreview * preview, GstClockTime position,
+    ClutterContent * content, gpointer data);
+
+void seek_preview_free (SeekPreview * preview);
+ClutterContent *seek_preview_lookup (SeekPreview * preview,
+    GstClockTime position);
+SeekPreview *seek_preview_new (guint size, SeekPreviewFunc func,
+    gpointer data);
+void seek_preview_report_qos (SeekPreview * preview);
+void seek_preview_request (SeekPreview * preview, GstClockTime position);
+void seek_preview_set_uri (SeekPreview * preview, const gchar * uri);
+
+G_END_DECLS
+#endif /* __SEEK_PREVIEW_H__ */
@@ -36,7 +36,14 @@
 #include "dlna.h"
 #endif
 
+#include "benchmark.h"
+#include "clip_export.h"
 #include "gst_engine.h"
+#include "media_info.h"
+#include "open_trace.h"
+#include "profiler.h"
+#include "thumbnailer.h"
+#include "timings.h"
 #include "utils.h"
 
 
@@ -56,7 +63,227 @@ close_down (UserInterface * ui, GstEngine * engine)
   screensaver_enable (ui->screensaver, TRUE);
   screensaver_free (ui->screensaver);
 
+  if (ui->wakeups)
+    g_print ("Timer wakeups while playing with hidden controls: %.2f/s\n",
+        scheduler_get_idle_wakeup_rate (ui->scheduler));
+
+  /* Only counted with tools/alloc-counter.so preloaded */
+  if (ui->ticks > 0)
+    g_print ("Progress ticks: %" G_GINT64_FORMAT ", %" G_GINT64_FORMAT
+        " allocated, %" G_GINT64_FORMAT " allocations (%.3f per tick)\n",
+        ui->ticks, ui->allocating_ticks, ui->tick_allocations,
+        (gdouble) ui->tick_allocations / ui->ticks);
+
+  if (ui->profiler != NULL)
+    profiler_free (ui->profiler);
+  stats_overlay_free (ui->stats_overlay);
+  scheduler_free (ui->scheduler);
+
+  if (ui->seek_preview != NULL)
+    seek_preview_free (ui->seek_preview);
+
+  /* Stop an export midway, its half written clip is removed */
+  if (ui->clip_export != NULL)
+    clip_export_cancel (ui->clip_export);
+
   gst_object_unref (G_OBJECT (engine->player));
+  open_trace_free (engine->open_trace);
+}
+
+
+/*      Export a clip of a file from the CLI     */
+gboolean
+export_clip (GList * uri_list, const gchar * range, const gchar * output,
+    gboolean smart)
+{
+  GstClockTime start, stop;
+  gchar **times;
+  gchar *path;
+  GError *error = NULL;
+  gboolean ok;
+
+  if (g_list_length (uri_list) != 1) {
+    g_print ("ERROR: Clips are exported from exactly one file\n");
+    return FALSE;
+  }
+
+  /* IN,OUT where either can be left empty for the start or the end */
+  times = g_strsplit (range, ",", 2);
+  start = 0;
+  stop = GST_CLOCK_TIME_NONE;
+  ok = g_strv_length (times) == 2 &&
+      (times[0][0] == '\0' || parse_time_str (times[0], &start)) &&
+      (times[1][0] == '\0' || parse_time_str (times[1], &stop));
+  g_strfreev (times);
+
+  if (!ok || (GST_CLOCK_TIME_IS_VALID (stop) && stop <= start)) {
+    g_print ("ERROR: Can't understand the clip range %s\n", range);
+    return FALSE;
+  }
+
+  if (output)
+    path = g_strdup (output);
+  else
+    path = clip_export_output_for (uri_list->data, start, stop, smart);
+
+  ok = clip_export_run (uri_list->data, path, start, stop, smart, &error);
+  if (ok) {
+    g_print ("Clip saved to %s\n", path);
+  } else {
+    g_print ("ERROR: Couldn't export the clip: %s\n", error->message);
+    g_error_free (error);
+  }
+  g_free (path);
+
+  return ok;
+}
+
+
+/*    Handle what needs no window to be shown    */
+gboolean
+process_early_args (int argc, char *argv[], gint * ret)
+{
+  gboolean json = FALSE, media_info = FALSE, recent = FALSE;
+  gboolean single_instance = FALSE, thumbnail = FALSE, version = FALSE;
+  gboolean smart = FALSE, benchmark = FALSE, benchmark_clutter = FALSE;
+  gboolean open_times = FALSE, done = FALSE;
+  gint c, index, n_args = argc, thumbnail_frames = 0;
+  gchar *suburi = NULL, *export = NULL, *output = NULL;
+  gchar **args;
+  GList *uri_list = NULL;
+  GOptionContext *context;
+
+  GOptionEntry entries[] = {
+    {"benchmark", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &benchmark,
+        NULL, NULL},
+    {"benchmark-clutter", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE,
+        &benchmark_clutter, NULL, NULL},
+    {"export", 'e', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_STRING, &export,
+        NULL, NULL},
+    {"json", 'j', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &json,
+        NULL, NULL},
+    {"media-info", 'i', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE,
+        &media_info, NULL, NULL},
+    {"open-times", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &open_times,
+        NULL, NULL},
+    {"output", 'o', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_FILENAME, &output,
+        NULL, NULL},
+    {"recent", 'r', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &recent,
+        NULL, NULL},
+    {"single-instance", 'n', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE,
+        &single_instance, NULL, NULL},
+    {"smart", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &smart,
+        NULL, NULL},
+    {"subtitles", 't', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_FILENAME,
+        &suburi, NULL, NULL},
+    {"thumbnail", 'T', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &thumbnail,
+        NULL, NULL},
+    {"thumbnail-frames", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT,
+        &thumbnail_frames, NULL, NULL},
+    {"version", 'v', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &version,
+        NULL, NULL},
+    {NULL}
+  };
+
+  /* Only these flags matter here, the rest is parsed after init */
+  context = g_option_context_new (NULL);
+  g_option_context_set_help_enabled (context, FALSE);
+  g_option_context_set_ignore_unknown_options (context, TRUE);
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  /* Parse a copy so the real argv is left for the full parse */
+  args = g_new (gchar *, argc + 1);
+  memcpy (args, argv, argc * sizeof (gchar *));
+  args[argc] = NULL;
+
+  if (!g_option_context_parse (context, &n_args, &args, NULL))
+    goto out;
+
+  for (index = 1; index < n_args; index++) {
+    if (args[index][0] != '-')
+      uri_list = g_list_append (uri_list, clean_uri (args[index]));
+  }
+
+  if (version) {
+    /* Show snappy's version */
+    g_print ("snappy version %s\n", VERSION);
+    done = TRUE;
+  } else if (recent) {
+    /* Recently viewed uris */
+    gchar **recent = NULL;
+
+    recent = get_recently_viewed ();
+
+    if (recent) {
+      g_print ("These are the recently viewed URIs: \n\n");
+
+      for (c = 0; recent[c] != NULL; c++) {
+        if (c < 9)
+          g_print ("0%d: %s \n", c + 1, recent[c]);
+        else
+          g_print ("%d: %s \n", c + 1, recent[c]);
+      }
+      g_strfreev (recent);
+    } else {
+      g_print ("ERROR: Can't find history of recently viewed URIs\n");
+      *ret = 1;
+    }
+    done = TRUE;
+  } else if (open_times) {
+    /* Summary of the opens traced while playing */
+    if (!open_trace_print_summary ())
+      *ret = 1;
+    done = TRUE;
+  } else if (media_info) {
+    /* Media information only needs GStreamer */
+    gst_init (NULL, NULL);
+    if (!media_info_print (uri_list, json))
+      *ret = 1;
+    done = TRUE;
+  } else if (benchmark && !benchmark_clutter) {
+    /* Decoding into fakesinks only needs GStreamer */
+    gst_init (NULL, NULL);
+    if (!benchmark_print (uri_list, FALSE, json))
+      *ret = 1;
+    done = TRUE;
+  } else if (benchmark_clutter) {
+    /* Clutter's sink uploads to textures, offscreen, without a window */
+    gst_init (NULL, NULL);
+    clutter_set_windowing_backend (CLUTTER_WINDOWING_X11);
+    if (clutter_gst_init (NULL, NULL) != CLUTTER_INIT_SUCCESS ||
+        !benchmark_print (uri_list, TRUE, json))
+      *ret = 1;
+    done = TRUE;
+  } else if (export) {
+    /* Clips are remuxed without any window either */
+    gst_init (NULL, NULL);
+    if (!export_clip (uri_list, export, output, smart))
+      *ret = 1;
+    done = TRUE;
+  } else if (thumbnail || thumbnail_frames > 0) {
+    /* So do thumbnails, decoded without any window */
+    gst_init (NULL, NULL);
+    if (!thumbnail_print (uri_list, THUMBNAIL_SIZE_NORMAL,
+            MAX (thumbnail_frames, 0)))
+      *ret = 1;
+    done = TRUE;
+#ifdef ENABLE_DBUS
+  } else if (single_instance && forward_dlna (uri_list)) {
+    /* Handed the files to a running snappy instead */
+    g_print ("Opening in the running snappy\n");
+    done = TRUE;
+#endif
+  }
+
+out:
+  g_list_free_full (uri_list, g_free);
+  g_free (suburi);
+  g_free (export);
+  g_free (output);
+  g_free (args);
+  g_option_context_free (context);
+
+  return done;
 }
 
 
@@ -64,32 +291,83 @@ close_down (UserInterface * ui, GstEngine * engine)
 GList *
 process_args (int argc, char *argv[],
     gboolean * blind, gboolean * fullscreen, gboolean * hide, gboolean * loop,
-    gboolean * secret, gchar ** suburi, gboolean * tags,
-    GOptionContext * context)
+    gboolean * secret, gchar ** suburi, gboolean * daemon, gboolean * profile,
+    gboolean * wakeups, GOptionContext * context)
 {
-  gboolean recent = FALSE, version = FALSE;
-  guint c, index, pos = 0;
+  /* Handled by process_early_args, only listed here for --help */
+  gboolean json = FALSE, media_info = FALSE, recent = FALSE;
+  gboolean single_instance = FALSE, thumbnail = FALSE, version = FALSE;
+  gboolean smart = FALSE, benchmark = FALSE, benchmark_clutter = FALSE;
+  gboolean open_times = FALSE;
+  gint thumbnail_frames = 0;
+  gchar *export = NULL, *output = NULL;
+  gboolean timings = FALSE, timings_exit = FALSE;
+  gchar *timings_trace = NULL;
+  guint index, pos = 0;
   GList *uri_list = NULL;
 
   GOptionEntry entries[] = {
+    {"benchmark", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &benchmark,
+        "Decode files as fast as possible and report the speed", NULL},
+    {"benchmark-clutter", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE,
+        &benchmark_clutter,
+        "Like --benchmark, uploading frames with Clutter's sink offscreen",
+        NULL},
     {"blind", 'b', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, blind,
         "Blind mode", NULL},
+#ifdef ENABLE_DBUS
+    {"daemon", 'd', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, daemon,
+        "Wait hidden, ready to play files sent over D-Bus", NULL},
+#endif
+    {"export", 'e', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_STRING, &export,
+        "Export a clip of the file without re-encoding it", "IN,OUT"},
     {"fullscreen", 'f', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, fullscreen,
         "Fullscreen mode", NULL},
     {"hide-controls", 'h', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, hide,
         "Hide on screen controls", NULL},
+    {"json", 'j', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &json,
+        "Print media information and benchmarks as JSON lines", NULL},
     {"loop", 'l', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, loop,
         "Looping mode", NULL},
-    {"media-info", 'i', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, tags,
-        "Print media information", NULL},
+    {"media-info", 'i', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE,
+        &media_info, "Print media information of files and directories",
+        NULL},
+    {"open-times", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &open_times,
+        "Summarise where the time to open each file went", NULL},
+    {"output", 'o', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_FILENAME, &output,
+        "File to export the clip to", "FILE"},
+    {"profile", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, profile,
+        "Profile the pipeline, press p for a summary", NULL},
     {"recent", 'r', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &recent,
         "Show recently viewed", NULL},
+#ifdef ENABLE_DBUS
+    {"single-instance", 'n', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE,
+        &single_instance, "Open files in an already running snappy", NULL},
+#endif
     {"secret", 's', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, secret,
         "Views not saved in recently viewed history", NULL},
+    {"smart", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &smart,
+        "Cut --export frame accurately, re-encoding only at the cuts, "
+        "to MPEG-TS", NULL},
     {"subtitles", 't', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_FILENAME,
         suburi, "Use this subtitle file", NULL},
+    {"thumbnail", 'T', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &thumbnail,
+        "Make thumbnails in the freedesktop cache and print their paths",
+        NULL},
+    {"thumbnail-frames", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT,
+        &thumbnail_frames, "Extract this many frames across each file",
+        "N"},
+    {"timings", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &timings,
+        "Print where startup time went, up to the first frame", NULL},
+    {"timings-exit", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE,
+        &timings_exit, "Quit once the startup timings are out", NULL},
+    {"timings-trace", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_FILENAME,
+        &timings_trace, "Save the startup timeline as a Chrome trace",
+        "FILE"},
     {"version", 'v', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &version,
         "Shows snappy's version", NULL},
+    {"wakeups", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, wakeups,
+        "Print timer wakeups per second with hidden controls on exit", NULL},
     {NULL}
   };
   GError *err = NULL;
@@ -104,33 +382,11 @@ process_args (int argc, char *argv[],
     g_error_free (err);
     return NULL;
   }
+  g_free (export);
+  g_free (output);
 
-  /* Recently viewed uris */
-  if (recent) {
-    gchar **recent = NULL;
-    recent = get_recently_viewed ();
-
-    if (recent) {
-      g_print ("These are the recently viewed URIs: \n\n");
-
-      for (c = 0; recent[c] != NULL; c++) {
-        if (c < 9)
-          g_print ("0%d: %s \n", c + 1, recent[c]);
-        else
-          g_print ("%d: %s \n", c + 1, recent[c]);
-      }
-    } else {
-      g_print ("ERROR: Can't find history of recently viewed URIs\n");
-    }
-
-    return NULL;
-  }
-
-  /* Show snappy's version */
-  if (version) {
-    g_print ("snappy version %s\n", VERSION);
-    return NULL;
-  }
+  timings_enable (timings, timings_trace, timings_exit);
+  g_free (timings_trace);
 
   /* Check that at least one URI has been introduced */
   if (argc > 1) {
@@ -140,7 +396,7 @@ process_args (int argc, char *argv[],
       uri_list = g_list_append (uri_list, clean_uri (argv[index]));
       pos++;
     }
-  } else {
+  } else if (!*daemon) {
     /* If no files passed by user display help */
     g_print ("Opening snappy without content.\n\n");
     g_print ("%s", g_option_context_get_help (context, TRUE, NULL));
@@ -160,8 +416,10 @@ main (int argc, char *argv[])
   ClutterGstVideoSink *sink;
 
   gboolean ok, blind = FALSE, fullscreen = FALSE, hide = FALSE, loop = FALSE;
-  gboolean secret = FALSE, tags = FALSE;
+  gboolean daemon = FALSE, secret = FALSE, profile = FALSE, wakeups = FALSE;
+  gboolean timings_quit = FALSE;
   gint ret = 0;
+  gint64 start_time;
   gchar *uri = NULL;
   gchar *suburi = NULL;
   GList *uri_list;
@@ -174,10 +432,21 @@ main (int argc, char *argv[])
   SnappyMP *mp_obj = NULL;
 #endif
 
+  start_time = g_get_monotonic_time ();
+  timings_init (start_time);
+
+  /* Before any of the expensive setup, in case there is nothing to do */
+  timings_begin ("process_early_args");
+  if (process_early_args (argc, argv, &ret))
+    return ret;
+  timings_end ("process_early_args");
+
   context = g_option_context_new ("<media file> - Play movie files");
 
   clutter_set_windowing_backend (CLUTTER_WINDOWING_X11);
+  timings_begin ("gtk_clutter_init");
   ci_err = gtk_clutter_init (&argc, &argv);
+  timings_end ("gtk_clutter_init");
   if (ci_err != CLUTTER_INIT_SUCCESS)
     goto quit;
 
@@ -207,11 +476,21 @@ main (int argc, char *argv[])
   }
 
   /* Process command arguments */
+  timings_begin ("process_args");
   uri_list = process_args (argc, argv, &blind, &fullscreen, &hide,
-      &loop, &secret, &suburi, &tags, context);
+      &loop, &secret, &suburi, &daemon, &profile, &wakeups, context);
+  timings_end ("process_args");
 
+  /* Tracers are loaded by gst_init */
+  if (profile)
+    profiler_setup ();
+
+  timings_begin ("gst_init");
   gst_init (&argc, &argv);
+  timings_end ("gst_init");
+  timings_begin ("clutter_gst_init");
   clutter_gst_init (NULL, NULL);
+  timings_end ("clutter_gst_init");
 
   /* User Interface */
   ui = g_new (UserInterface, 1);
@@ -219,9 +498,14 @@ main (int argc, char *argv[])
   ui->blind = blind;
   ui->fullscreen = fullscreen;
   ui->hide = hide;
-  ui->tags = tags;
+  ui->daemon = daemon;
+  ui->profile = profile;
+  ui->wakeups = wakeups;
   ui->data_dir = data_dir;
+  timings_begin ("interface_init");
   interface_init (ui);
+  timings_end ("interface_init");
+  ui->open_time = start_time;
 
   /* Gstreamer engine */
   engine = g_new (GstEngine, 1);
@@ -234,13 +518,19 @@ main (int argc, char *argv[])
       g_object_new (CLUTTER_GST_TYPE_CONTENT, "sink", sink, NULL),
       "name", "texture", NULL);
 
+  timings_begin ("engine_init");
   ok = engine_init (engine, sink);
+  timings_end ("engine_init");
   if (!ok)
     goto quit;
 
   engine->secret = secret;
   engine->loop = loop;
 
+  /* Pay for plugin loading now rather than on the first request */
+  if (daemon)
+    g_print ("Preloaded %u plugin features\n", engine_preload (engine));
+
   ui->engine = engine;
   ui->texture = video_texture;
 
@@ -273,24 +563,30 @@ main (int argc, char *argv[])
     set_subtitle_uri (engine, suburi);
   }
 
-  /* Start playing if we have a URI to play */
+  /* Start playing if we have a URI to play, otherwise startup ends here */
   if (uri) {
+    /* Ended by the player reaching PAUSED */
+    timings_begin ("preroll");
     change_state (engine, "Paused");
     change_state (engine, "Playing");
+  } else {
+    timings_quit = timings_finish ();
   }
 #ifdef ENABLE_DBUS
   /* Start MPRIS Dbus object */
-  mp_obj = g_new (SnappyMP, 1);
+  mp_obj = g_new0 (SnappyMP, 1);
   mp_obj->engine = engine;
   mp_obj->ui = ui;
   load_dlna (mp_obj);
 #endif
 
-  /* Main loop */
-  gtk_main ();
+  /* Main loop, unless --timings-exit is already done */
+  if (!timings_quit)
+    gtk_main ();
 
   /* Close snappy */
   close_down (ui, engine);
+  uri_list = ui->uri_list;
 #ifdef ENABLE_DBUS
   close_dlna (mp_obj);
 #endif
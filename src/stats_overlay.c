@@ -0,0 +1,334 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <gst/video/video.h>
+
+#include "stats_overlay.h"
+
+/* Playback statistics drawn over the video. Frame counts come from the
+ * sink, which keeps them from its streaming thread, QoS and buffering
+ * levels from the engine's bus watch, so an update is only a few reads. It
+ * runs once a second, and only while the overlay is shown.
+ *
+ * Sinks only have stats since GStreamer 1.18. Before that, frames are
+ * counted by a probe on the sink's pad and the dropped ones taken from its
+ * QoS messages. */
+
+#define STATS_OVERLAY_FONT "Monospace 12px"
+#define STATS_OVERLAY_MARGIN 16.0f
+#define STATS_OVERLAY_PADDING 8.0f
+
+struct _StatsOverlay
+{
+  GstEngine *engine;
+  Scheduler *scheduler;
+  ClutterActor *actor, *text;
+  guint update_id;
+
+  guint64 last_rendered;
+  gint64 last_time, last_cpu;
+
+#if !GST_CHECK_VERSION(1, 18, 0)
+  GstPad *sink_pad;
+  gulong probe_id;
+  gint received;
+#endif
+};
+
+// Declaration of static functions
+static gchar *caps_description (GstEngine * engine);
+static gint64 cpu_time (void);
+static gchar *decoder_name (GstEngine * engine);
+static gint find_video_decoder (const GValue * item, gconstpointer unused);
+static gdouble rss_megabytes (void);
+#if !GST_CHECK_VERSION(1, 18, 0)
+static GstPadProbeReturn sink_probe_cb (GstPad * pad, GstPadProbeInfo * info,
+    StatsOverlay * overlay);
+#endif
+static gboolean update (gpointer data);
+
+/* ---------------------- static functions ----------------------- */
+
+static gchar *
+caps_description (GstEngine * engine)
+{
+  GstVideoInfo info;
+  GstCaps *caps = NULL;
+  GstPad *pad;
+  gchar *description;
+
+  pad = gst_element_get_static_pad (GST_ELEMENT (engine->sink), "sink");
+  if (pad != NULL) {
+    caps = gst_pad_get_current_caps (pad);
+    gst_object_unref (pad);
+  }
+  if (caps == NULL)
+    return g_strdup ("-");
+
+  if (gst_video_info_from_caps (&info, caps))
+    description = g_strdup_printf ("%s %dx%d %.3f fps",
+        gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (&info)),
+        GST_VIDEO_INFO_WIDTH (&info), GST_VIDEO_INFO_HEIGHT (&info),
+        GST_VIDEO_INFO_FPS_D (&info) ? (gdouble) GST_VIDEO_INFO_FPS_N (&info)
+        / GST_VIDEO_INFO_FPS_D (&info) : 0.0);
+  else
+    description = gst_caps_to_string (caps);
+  gst_caps_unref (caps);
+
+  return description;
+}
+
+// User and system time, in µs
+static gint64
+cpu_time (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_TIME_SPAN_SECOND
+      + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static gchar *
+decoder_name (GstEngine * engine)
+{
+  GValue value = G_VALUE_INIT;
+  GstIterator *it;
+  gchar *name;
+
+  it = gst_bin_iterate_recurse (GST_BIN (engine->player));
+  if (!gst_iterator_find_custom (it, (GCompareFunc) find_video_decoder,
+          &value, NULL)) {
+    gst_iterator_free (it);
+    return g_strdup ("-");
+  }
+
+  name = g_strdup (GST_OBJECT_NAME (gst_element_get_factory
+          (g_value_get_object (&value))));
+  g_value_unset (&value);
+  gst_iterator_free (it);
+
+  return name;
+}
+
+static gint
+find_video_decoder (const GValue * item, gconstpointer unused)
+{
+  GstElement *element = g_value_get_object (item);
+  GstElementFactory *factory = gst_element_get_factory (element);
+  const gchar *klass;
+
+  // decodebin and uridecodebin call themselves decoders too
+  if (factory == NULL || GST_IS_BIN (element))
+    return 1;
+
+  klass = gst_element_factory_get_metadata (factory,
+      GST_ELEMENT_METADATA_KLASS);
+
+  return !(strstr (klass, "Decoder") != NULL && strstr (klass, "Video"));
+}
+
+// Resident now, where /proc has it, otherwise the peak
+static gdouble
+rss_megabytes (void)
+{
+  struct rusage usage;
+  glong pages;
+  FILE *statm;
+
+  statm = fopen ("/proc/self/statm", "r");
+  if (statm != NULL) {
+    gboolean ok = fscanf (statm, "%*s %ld", &pages) == 1;
+
+    fclose (statm);
+    if (ok)
+      return pages * (gdouble) sysconf (_SC_PAGESIZE) / (1024 * 1024);
+  }
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  return usage.ru_maxrss / 1024.0;
+}
+
+#if !GST_CHECK_VERSION(1, 18, 0)
+static GstPadProbeReturn
+sink_probe_cb (GstPad * pad, GstPadProbeInfo * info, StatsOverlay * overlay)
+{
+  // Like the sink's own stats, counting starts again for every file
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+    g_atomic_int_inc (&overlay->received);
+  else if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+      GST_EVENT_STREAM_START)
+    g_atomic_int_set (&overlay->received, 0);
+
+  return GST_PAD_PROBE_OK;
+}
+#endif
+
+static gboolean
+update (gpointer data)
+{
+  StatsOverlay *overlay = data;
+  GstEngine *engine = overlay->engine;
+#if GST_CHECK_VERSION(1, 18, 0)
+  GstStructure *stats = NULL;
+#endif
+  guint64 rendered = 0, dropped = 0;
+  gint64 now = g_get_monotonic_time (), cpu = cpu_time ();
+  gdouble fps = 0, cpu_usage = 0;
+  gchar *decoder, *caps, *text;
+
+#if GST_CHECK_VERSION(1, 18, 0)
+  g_object_get (engine->sink, "stats", &stats, NULL);
+  if (stats != NULL) {
+    gst_structure_get_uint64 (stats, "rendered", &rendered);
+    gst_structure_get_uint64 (stats, "dropped", &dropped);
+    gst_structure_free (stats);
+  }
+#else
+  // Every frame the sink got was either shown or dropped
+  rendered = g_atomic_int_get (&overlay->received);
+  dropped = MIN (engine->qos_dropped, rendered);
+  rendered -= dropped;
+#endif
+
+  if (overlay->last_time > 0 && now > overlay->last_time) {
+    // The sink starts counting again for every file
+    if (rendered >= overlay->last_rendered)
+      fps = (rendered - overlay->last_rendered) * (gdouble) G_TIME_SPAN_SECOND
+          / (now - overlay->last_time);
+    cpu_usage = 100.0 * (cpu - overlay->last_cpu) / (now - overlay->last_time);
+  }
+  overlay->last_rendered = rendered;
+  overlay->last_time = now;
+  overlay->last_cpu = cpu;
+
+  decoder = decoder_name (engine);
+  caps = caps_description (engine);
+  text = g_strdup_printf ("fps      %.1f\n"
+      "frames   %" G_GUINT64_FORMAT " rendered, %" G_GUINT64_FORMAT
+      " dropped\n"
+      "qos      %u messages\n"
+      "a/v      %+.1f ms late, offset %+.0f ms\n"
+      "buffer   %d%%\n"
+      "decoder  %s\n"
+      "caps     %s\n"
+      "cpu      %.1f%%\n"
+      "rss      %.1f MB", fps, rendered, dropped, engine->qos_count,
+      engine->qos_jitter / (gdouble) GST_MSECOND,
+      engine->av_offset / (gdouble) GST_MSECOND, engine->buffering, decoder,
+      caps, cpu_usage, rss_megabytes ());
+  clutter_text_set_text (CLUTTER_TEXT (overlay->text), text);
+
+  g_free (text);
+  g_free (caps);
+  g_free (decoder);
+
+  return TRUE;
+}
+
+/* -------------------- non-static functions --------------------- */
+
+void
+stats_overlay_free (StatsOverlay * overlay)
+{
+  if (overlay->update_id)
+    scheduler_remove (overlay->scheduler, overlay->update_id);
+
+#if !GST_CHECK_VERSION(1, 18, 0)
+  if (overlay->sink_pad != NULL) {
+    gst_pad_remove_probe (overlay->sink_pad, overlay->probe_id);
+    gst_object_unref (overlay->sink_pad);
+  }
+#endif
+
+  g_free (overlay);
+}
+
+ClutterActor *
+stats_overlay_get_actor (StatsOverlay * overlay)
+{
+  return overlay->actor;
+}
+
+StatsOverlay *
+stats_overlay_new (GstEngine * engine, Scheduler * scheduler)
+{
+  StatsOverlay *overlay;
+  ClutterColor text_color = { 0xff, 0xff, 0xff, 0xff };
+  ClutterColor bg_color = { 0x00, 0x00, 0x00, 0xb0 };
+  ClutterMargin padding = { STATS_OVERLAY_PADDING, STATS_OVERLAY_PADDING,
+    STATS_OVERLAY_PADDING, STATS_OVERLAY_PADDING
+  };
+
+  overlay = g_new0 (StatsOverlay, 1);
+  overlay->engine = engine;
+  overlay->scheduler = scheduler;
+
+#if !GST_CHECK_VERSION(1, 18, 0)
+  overlay->sink_pad = gst_element_get_static_pad (GST_ELEMENT (engine->sink),
+      "sink");
+  if (overlay->sink_pad != NULL)
+    overlay->probe_id = gst_pad_add_probe (overlay->sink_pad,
+        GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        (GstPadProbeCallback) sink_probe_cb, overlay, NULL);
+#endif
+
+  overlay->text = clutter_text_new_full (STATS_OVERLAY_FONT, "", &text_color);
+  clutter_actor_set_margin (overlay->text, &padding);
+
+  overlay->actor = clutter_actor_new ();
+  clutter_actor_set_layout_manager (overlay->actor, clutter_bin_layout_new
+      (CLUTTER_BIN_ALIGNMENT_START, CLUTTER_BIN_ALIGNMENT_START));
+  clutter_actor_set_background_color (overlay->actor, &bg_color);
+  clutter_actor_add_child (overlay->actor, overlay->text);
+  clutter_actor_set_position (overlay->actor, STATS_OVERLAY_MARGIN,
+      STATS_OVERLAY_MARGIN);
+  clutter_actor_set_reactive (overlay->actor, FALSE);
+  clutter_actor_hide (overlay->actor);
+
+  return overlay;
+}
+
+void
+stats_overlay_toggle (StatsOverlay * overlay)
+{
+  if (overlay->update_id) {
+    scheduler_remove (overlay->scheduler, overlay->update_id);
+    overlay->update_id = 0;
+    clutter_actor_hide (overlay->actor);
+    return;
+  }
+
+  // Rates need two updates, the first one only reads the counters
+  overlay->last_time = 0;
+  update (overlay);
+  overlay->update_id = scheduler_add (overlay->scheduler,
+      STATS_OVERLAY_INTERVAL, update, overlay);
+  clutter_actor_show (overlay->actor);
+}
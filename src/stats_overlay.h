@@ -0,0 +1,44 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __STATS_OVERLAY_H__
+#define __STATS_OVERLAY_H__
+
+#include <clutter/clutter.h>
+
+#include "gst_engine.h"
+#include "scheduler.h"
+
+G_BEGIN_DECLS
+
+/* How often the overlay is updated while shown, in ms */
+#define STATS_OVERLAY_INTERVAL G_TIME_SPAN_MILLISECOND
+
+typedef struct _StatsOverlay StatsOverlay;
+
+void stats_overlay_free (StatsOverlay * overlay);
+ClutterActor *stats_overlay_get_actor (StatsOverlay * overlay);
+StatsOverlay *stats_overlay_new (GstEngine * engine, Scheduler * scheduler);
+void stats_overlay_toggle (StatsOverlay * overlay);
+
+G_END_DECLS
+#endif /* __STATS_OVERLAY_H__ */
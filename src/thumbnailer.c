@@ -0,0 +1,592 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "thumbnailer.h"
+
+/* Thumbnails are taken by decode-only pipelines, one per job, running on a
+ * pool of worker threads. Results live in the freedesktop thumbnail cache
+ * so whatever the desktop already made is reused, and the other way round.
+ * Extra frames of a file go to snappy's own cache as they have no place in
+ * the spec. */
+
+/* Only decode video, the rest of playbin's flags are left off */
+#define THUMBNAIL_PLAY_FLAGS (1 << 0)
+/* How often a wait on the pipeline checks whether it was cancelled */
+#define THUMBNAIL_POLL (100 * GST_MSECOND)
+
+typedef struct _ThumbnailJob ThumbnailJob;
+
+struct _Thumbnailer
+{
+  guint size;
+
+  GThreadPool *pool;
+};
+
+struct _FrameGrabber
+{
+  GstElement *pipeline;
+  GstElement *sink;
+};
+
+struct _ThumbnailJob
+{
+  gchar *uri;
+  guint index, n_frames;
+
+  ThumbnailFunc func;
+  gpointer data;
+};
+
+// Declaration of static functions
+static gchar *cache_name (const gchar * uri);
+static gchar *canonical_uri (const gchar * uri);
+static gchar *fail_path (const gchar * uri);
+static gchar *frame_path (const gchar * uri, guint size, guint index);
+static GdkPixbuf *pixbuf_from_sample (GstSample * sample);
+static void print_result (const gchar * uri, guint index, const gchar * path,
+    const GError * error, gint * failed);
+static void run_job (ThumbnailJob * job, Thumbnailer * thumbnailer);
+static gboolean save_thumbnail (GdkPixbuf * pixbuf, const gchar * path,
+    const gchar * uri, guint64 mtime, GError ** error);
+static guint64 uri_mtime (const gchar * uri);
+static gboolean valid_thumbnail (const gchar * path, const gchar * uri,
+    guint64 mtime);
+static gboolean wait_async_done (GstElement * pipeline,
+    GCancellable * cancellable, GError ** error);
+
+/* ---------------------- static functions ----------------------- */
+
+static gchar *
+cache_name (const gchar * uri)
+{
+  gchar *canonical, *md5, *name;
+
+  canonical = canonical_uri (uri);
+  md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, canonical, -1);
+  name = g_strdup_printf ("%s.png", md5);
+
+  g_free (md5);
+  g_free (canonical);
+
+  return name;
+}
+
+static gchar *
+canonical_uri (const gchar * uri)
+{
+  GFile *file;
+  gchar *canonical;
+
+  // The spec uses the escaped URI, as the desktop writes it
+  file = g_file_new_for_uri (uri);
+  canonical = g_file_get_uri (file);
+  g_object_unref (file);
+
+  return canonical;
+}
+
+static gchar *
+fail_path (const gchar * uri)
+{
+  gchar *name, *path;
+
+  name = cache_name (uri);
+  path = g_build_filename (g_get_user_cache_dir (), "thumbnails", "fail",
+      THUMBNAIL_FAIL_DIR, name, NULL);
+  g_free (name);
+
+  return path;
+}
+
+static gchar *
+frame_path (const gchar * uri, guint size, guint index)
+{
+  gchar *name, *frame, *size_dir, *path;
+
+  name = cache_name (uri);
+  // name ends in ".png", the frame number goes before it
+  name[strlen (name) - 4] = '\0';
+  frame = g_strdup_printf ("%s-%u.png", name, index);
+  size_dir = g_strdup_printf ("%u", size);
+  path = g_build_filename (g_get_user_cache_dir (), "snappy", "frames",
+      size_dir, frame, NULL);
+
+  g_free (size_dir);
+  g_free (frame);
+  g_free (name);
+
+  return path;
+}
+
+static GdkPixbuf *
+pixbuf_from_sample (GstSample * sample)
+{
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  GdkPixbuf *pixbuf;
+  guint8 *src, *dest;
+  gint row, src_stride, dest_stride;
+
+  if (!gst_video_info_from_caps (&info, gst_sample_get_caps (sample)))
+    return NULL;
+  if (!gst_video_frame_map (&frame, &info, gst_sample_get_buffer (sample),
+          GST_MAP_READ))
+    return NULL;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+      GST_VIDEO_INFO_WIDTH (&info), GST_VIDEO_INFO_HEIGHT (&info));
+
+  // Rows are padded differently on each side
+  src = GST_VIDEO_FRAME_PLANE_DATA (&frame, 0);
+  src_stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0);
+  dest = gdk_pixbuf_get_pixels (pixbuf);
+  dest_stride = gdk_pixbuf_get_rowstride (pixbuf);
+  for (row = 0; row < GST_VIDEO_INFO_HEIGHT (&info); row++)
+    memcpy (dest + row * dest_stride, src + row * src_stride,
+        GST_VIDEO_INFO_WIDTH (&info) * 3);
+
+  gst_video_frame_unmap (&frame);
+
+  return pixbuf;
+}
+
+static void
+print_result (const gchar * uri, guint index, const gchar * path,
+    const GError * error, gint * failed)
+{
+  if (error != NULL) {
+    g_print ("%s: ERROR: %s\n", uri, error->message);
+    g_atomic_int_inc (failed);
+  } else {
+    g_print ("%s [%u]: %s\n", uri, index, path);
+  }
+}
+
+static void
+run_job (ThumbnailJob * job, Thumbnailer * thumbnailer)
+{
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+  gchar *path, *failed = NULL;
+  guint64 mtime;
+
+  if (job->n_frames > 0)
+    path = frame_path (job->uri, thumbnailer->size, job->index);
+  else
+    path = thumbnail_path (job->uri, thumbnailer->size);
+
+  // Only files we can tell have not changed are served from the cache
+  mtime = uri_mtime (job->uri);
+  if (mtime > 0 && valid_thumbnail (path, job->uri, mtime)) {
+    job->func (job->uri, job->index, path, NULL, job->data);
+    goto done;
+  }
+
+  if (job->n_frames == 0) {
+    failed = fail_path (job->uri);
+    if (mtime > 0 && valid_thumbnail (failed, job->uri, mtime)) {
+      g_set_error (&error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED,
+          "No thumbnail could be made last time");
+      goto report;
+    }
+  }
+
+  pixbuf = thumbnail_grab_frame (job->uri, job->index, job->n_frames,
+      thumbnailer->size, &error);
+  if (pixbuf != NULL) {
+    save_thumbnail (pixbuf, path, job->uri, mtime, &error);
+    g_object_unref (pixbuf);
+  } else if (failed != NULL && mtime > 0) {
+    // An empty entry in fail/ keeps everyone from trying again
+    pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 1, 1);
+    save_thumbnail (pixbuf, failed, job->uri, mtime, NULL);
+    g_object_unref (pixbuf);
+  }
+
+report:
+  job->func (job->uri, job->index, error ? NULL : path, error, job->data);
+  g_clear_error (&error);
+
+done:
+  g_free (failed);
+  g_free (path);
+  g_free (job->uri);
+  g_free (job);
+}
+
+static gboolean
+save_thumbnail (GdkPixbuf * pixbuf, const gchar * path, const gchar * uri,
+    guint64 mtime, GError ** error)
+{
+  gchar *dir, *tmp, *mtime_str, *canonical;
+  gboolean ok;
+  gint fd;
+
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  // Written aside and renamed so readers never see half a PNG
+  tmp = g_strdup_printf ("%s.XXXXXX", path);
+  fd = g_mkstemp_full (tmp, O_RDWR, 0600);
+  if (fd == -1) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Unable to write %s", path);
+    g_free (tmp);
+    return FALSE;
+  }
+  close (fd);
+
+  mtime_str = g_strdup_printf ("%" G_GUINT64_FORMAT, mtime);
+  canonical = canonical_uri (uri);
+  ok = gdk_pixbuf_save (pixbuf, tmp, "png", error,
+      "tEXt::Thumb::URI", canonical,
+      "tEXt::Thumb::MTime", mtime_str, "tEXt::Software", "snappy", NULL);
+  if (ok)
+    ok = g_rename (tmp, path) == 0;
+  if (!ok)
+    g_unlink (tmp);
+
+  g_free (canonical);
+  g_free (mtime_str);
+  g_free (tmp);
+
+  return ok;
+}
+
+static guint64
+uri_mtime (const gchar * uri)
+{
+  GFile *file;
+  GFileInfo *info;
+  guint64 mtime = 0;
+
+  file = g_file_new_for_uri (uri);
+  if (g_file_has_uri_scheme (file, "file")) {
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+        G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    if (info != NULL) {
+      mtime = g_file_info_get_attribute_uint64 (info,
+          G_FILE_ATTRIBUTE_TIME_MODIFIED);
+      g_object_unref (info);
+    }
+  }
+  g_object_unref (file);
+
+  return mtime;
+}
+
+static gboolean
+valid_thumbnail (const gchar * path, const gchar * uri, guint64 mtime)
+{
+  GdkPixbuf *pixbuf;
+  const gchar *thumb_uri, *thumb_mtime;
+  gchar *canonical;
+  gboolean valid;
+
+  if (!g_file_test (path, G_FILE_TEST_IS_REGULAR))
+    return FALSE;
+
+  pixbuf = gdk_pixbuf_new_from_file (path, NULL);
+  if (pixbuf == NULL)
+    return FALSE;
+
+  // Stale once the file has been modified since
+  thumb_uri = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::URI");
+  thumb_mtime = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::MTime");
+  canonical = canonical_uri (uri);
+  valid = g_strcmp0 (thumb_uri, canonical) == 0 && thumb_mtime != NULL &&
+      g_ascii_strtoull (thumb_mtime, NULL, 10) == mtime;
+
+  g_free (canonical);
+  g_object_unref (pixbuf);
+
+  return valid;
+}
+
+static gboolean
+wait_async_done (GstElement * pipeline, GCancellable * cancellable,
+    GError ** error)
+{
+  GstBus *bus;
+  GstMessage *msg = NULL;
+  gint64 deadline;
+  gboolean ok = FALSE;
+
+  bus = gst_element_get_bus (pipeline);
+
+  // Without anything to cancel it, a single wait does
+  if (cancellable == NULL) {
+    msg = gst_bus_timed_pop_filtered (bus, THUMBNAIL_TIMEOUT * GST_SECOND,
+        GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR);
+  } else {
+    deadline = g_get_monotonic_time () +
+        THUMBNAIL_TIMEOUT * G_TIME_SPAN_SECOND;
+    while (msg == NULL && !g_cancellable_is_cancelled (cancellable) &&
+        g_get_monotonic_time () < deadline)
+      msg = gst_bus_timed_pop_filtered (bus, THUMBNAIL_POLL,
+          GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR);
+  }
+
+  if (msg == NULL) {
+    if (!g_cancellable_set_error_if_cancelled (cancellable, error))
+      g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_STATE_CHANGE,
+          "Timed out waiting for a frame");
+  } else if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    gst_message_parse_error (msg, error, NULL);
+  } else {
+    ok = TRUE;
+  }
+
+  if (msg != NULL)
+    gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  return ok;
+}
+
+/* -------------------- non-static functions --------------------- */
+
+void
+frame_grabber_free (FrameGrabber * grabber)
+{
+  gst_element_set_state (grabber->pipeline, GST_STATE_NULL);
+  gst_object_unref (grabber->pipeline);
+  g_free (grabber);
+}
+
+GstClockTime
+frame_grabber_get_duration (FrameGrabber * grabber)
+{
+  gint64 duration;
+
+  if (!gst_element_query_duration (grabber->pipeline, GST_FORMAT_TIME,
+          &duration) || duration <= 0)
+    return GST_CLOCK_TIME_NONE;
+
+  return duration;
+}
+
+GdkPixbuf *
+frame_grabber_grab (FrameGrabber * grabber, GstClockTime position,
+    GstClockTime * keyframe, GCancellable * cancellable, GError ** error)
+{
+  GstSample *sample;
+  GstBuffer *buffer;
+  GstSegment *segment;
+  GdkPixbuf *pixbuf = NULL;
+
+  // Stop at the keyframe before the wanted time, nothing gets decoded
+  // between it and the exact position
+  if (GST_CLOCK_TIME_IS_VALID (position) &&
+      gst_element_seek_simple (grabber->pipeline, GST_FORMAT_TIME,
+          GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+          GST_SEEK_FLAG_SNAP_BEFORE, position) &&
+      !wait_async_done (grabber->pipeline, cancellable, error))
+    return NULL;
+
+  sample = gst_app_sink_pull_preroll (GST_APP_SINK (grabber->sink));
+  if (sample != NULL) {
+    pixbuf = pixbuf_from_sample (sample);
+
+    if (keyframe != NULL) {
+      buffer = gst_sample_get_buffer (sample);
+      segment = gst_sample_get_segment (sample);
+      *keyframe = gst_segment_to_stream_time (segment, GST_FORMAT_TIME,
+          GST_BUFFER_PTS (buffer));
+    }
+
+    gst_sample_unref (sample);
+  }
+
+  if (pixbuf == NULL)
+    g_set_error (error, GST_STREAM_ERROR, GST_STREAM_ERROR_DECODE,
+        "No video frame to grab");
+
+  return pixbuf;
+}
+
+FrameGrabber *
+frame_grabber_new (const gchar * uri, guint size,
+    GCancellable * cancellable, GError ** error)
+{
+  FrameGrabber *grabber;
+  GstElement *pipeline, *bin, *convert, *scale, *sink;
+  GstCaps *caps;
+  GstPad *pad;
+
+  pipeline = gst_element_factory_make ("playbin", NULL);
+  convert = gst_element_factory_make ("videoconvert", NULL);
+  scale = gst_element_factory_make ("videoscale", NULL);
+  sink = gst_element_factory_make ("appsink", NULL);
+  if (!pipeline || !convert || !scale || !sink) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+        "Missing playbin, videoconvert, videoscale or appsink");
+    if (pipeline)
+      gst_object_unref (pipeline);
+    if (convert)
+      gst_object_unref (convert);
+    if (scale)
+      gst_object_unref (scale);
+    if (sink)
+      gst_object_unref (sink);
+    return NULL;
+  }
+
+  // Scaled down to fit before it is copied out, with square pixels
+  caps = gst_caps_new_simple ("video/x-raw",
+      "format", G_TYPE_STRING, "RGB",
+      "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+      "width", GST_TYPE_INT_RANGE, 1, size,
+      "height", GST_TYPE_INT_RANGE, 1, size, NULL);
+  g_object_set (G_OBJECT (sink), "caps", caps, "sync", FALSE, NULL);
+  gst_caps_unref (caps);
+
+  bin = gst_bin_new (NULL);
+  gst_bin_add_many (GST_BIN (bin), convert, scale, sink, NULL);
+  gst_element_link_many (convert, scale, sink, NULL);
+  pad = gst_element_get_static_pad (convert, "sink");
+  gst_element_add_pad (bin, gst_ghost_pad_new ("sink", pad));
+  gst_object_unref (pad);
+
+  g_object_set (G_OBJECT (pipeline), "uri", uri,
+      "flags", THUMBNAIL_PLAY_FLAGS, "video-sink", bin, NULL);
+
+  grabber = g_new (FrameGrabber, 1);
+  grabber->pipeline = pipeline;
+  grabber->sink = sink;
+
+  gst_element_set_state (pipeline, GST_STATE_PAUSED);
+  if (!wait_async_done (pipeline, cancellable, error)) {
+    frame_grabber_free (grabber);
+    return NULL;
+  }
+
+  return grabber;
+}
+
+GdkPixbuf *
+thumbnail_grab_frame (const gchar * uri, guint index, guint n_frames,
+    guint size, GError ** error)
+{
+  FrameGrabber *grabber;
+  GdkPixbuf *pixbuf;
+  GstClockTime duration, position = GST_CLOCK_TIME_NONE;
+
+  grabber = frame_grabber_new (uri, size, NULL, error);
+  if (grabber == NULL)
+    return NULL;
+
+  // Without a duration the first frame is all there is to take
+  duration = frame_grabber_get_duration (grabber);
+  if (GST_CLOCK_TIME_IS_VALID (duration)) {
+    if (n_frames > 0)
+      position = gst_util_uint64_scale (duration, index + 1, n_frames + 1);
+    else
+      position = gst_util_uint64_scale (duration, THUMBNAIL_POSITION, 100);
+  }
+
+  pixbuf = frame_grabber_grab (grabber, position, NULL, NULL, error);
+  frame_grabber_free (grabber);
+
+  return pixbuf;
+}
+
+gchar *
+thumbnail_path (const gchar * uri, guint size)
+{
+  gchar *name, *path;
+
+  name = cache_name (uri);
+  path = g_build_filename (g_get_user_cache_dir (), "thumbnails",
+      size > THUMBNAIL_SIZE_NORMAL ? "large" : "normal", name, NULL);
+  g_free (name);
+
+  return path;
+}
+
+gboolean
+thumbnail_print (GList * uri_list, guint size, guint n_frames)
+{
+  Thumbnailer *thumbnailer;
+  gint failed = 0;
+  GList *l;
+
+  thumbnailer = thumbnailer_new (size);
+  for (l = uri_list; l != NULL; l = l->next)
+    thumbnailer_request (thumbnailer, l->data, n_frames,
+        (ThumbnailFunc) print_result, &failed);
+  thumbnailer_free (thumbnailer);
+
+  return failed == 0;
+}
+
+void
+thumbnailer_free (Thumbnailer * thumbnailer)
+{
+  // Finishes whatever was already requested
+  g_thread_pool_free (thumbnailer->pool, FALSE, TRUE);
+  g_free (thumbnailer);
+}
+
+Thumbnailer *
+thumbnailer_new (guint size)
+{
+  Thumbnailer *thumbnailer;
+
+  thumbnailer = g_new0 (Thumbnailer, 1);
+  thumbnailer->size = size;
+  thumbnailer->pool = g_thread_pool_new ((GFunc) run_job, thumbnailer,
+      g_get_num_processors (), FALSE, NULL);
+
+  return thumbnailer;
+}
+
+void
+thumbnailer_request (Thumbnailer * thumbnailer, const gchar * uri,
+    guint n_frames, ThumbnailFunc func, gpointer data)
+{
+  ThumbnailJob *job;
+  guint index;
+
+  // Frames of one file are separate jobs, decoded side by side
+  for (index = 0; index < MAX (n_frames, 1); index++) {
+    job = g_new (ThumbnailJob, 1);
+    job->uri = g_strdup (uri);
+    job->index = index;
+    job->n_frames = n_frames;
+    job->func = func;
+    job->data = data;
+
+    g_thread_pool_push (thumbnailer->pool, job, NULL);
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __THUMBNAILER_H__
+#define __THUMBNAILER_H__
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gio/gio.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Sizes, and directory names, from the freedesktop thumbnail spec */
+#define THUMBNAIL_SIZE_NORMAL 128
+#define THUMBNAIL_SIZE_LARGE 256
+#define THUMBNAIL_FAIL_DIR "snappy-1.0"
+
+/* Where in the file, in percent, a single thumbnail is taken from */
+#define THUMBNAIL_POSITION 10
+/* Seconds to wait on a file before giving up on it */
+#define THUMBNAIL_TIMEOUT 10
+
+typedef struct _FrameGrabber FrameGrabber;
+typedef struct _Thumbnailer Thumbnailer;
+
+/* Called from a worker thread with the cached PNG, or why there is none */
+typedef void (*ThumbnailFunc) (const gchar * uri, guint index,
+    const gchar * path, const GError * error, gpointer data);
+
+void frame_grabber_free (FrameGrabber * grabber);
+GstClockTime frame_grabber_get_duration (FrameGrabber * grabber);
+GdkPixbuf *frame_grabber_grab (FrameGrabber * grabber, GstClockTime position,
+    GstClockTime * keyframe, GCancellable * cancellable, GError ** error);
+FrameGrabber *frame_grabber_new (const gchar * uri, guint size,
+    GCancellable * cancellable, GError ** error);
+GdkPixbuf *thumbnail_grab_frame (const gchar * uri, guint index,
+    guint n_frames, guint size, GError ** error);
+gchar *thumbnail_path (const gchar * uri, guint size);
+gboolean thumbnail_print (GList * uri_list, guint size, guint n_frames);
+void thumbnailer_free (Thumbnailer * thumbnailer);
+Thumbnailer *thumbnailer_new (guint size);
+void thumbnailer_request (Thumbnailer * thumbnailer, const gchar * uri,
+    guint n_frames, ThumbnailFunc func, gpointer data);
+
+G_END_DECLS
+#endif /* __THUMBNAILER_H__ */
@@ -0,0 +1,192 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "timings.h"
+#include "utils.h"
+
+typedef struct
+{
+  const gchar *name;
+  gint64 begin, end;            // end is -1 for marks, 0 while still open
+} TimingEvent;
+
+static struct
+{
+  gint64 origin;
+  gboolean print, quit, finished;
+  gchar *trace_file;
+
+  TimingEvent events[TIMINGS_MAX_EVENTS];
+  guint count;
+} timings;
+
+// Declaration of static functions
+static void print_timeline (void);
+static TimingEvent *record (const gchar * name, gint64 end);
+static gboolean write_trace (const gchar * path);
+
+/* ---------------------- static functions ----------------------- */
+
+static void
+print_timeline (void)
+{
+  guint i;
+
+  g_print ("Startup timeline (ms since main):\n");
+  for (i = 0; i < timings.count; i++) {
+    TimingEvent *event = &timings.events[i];
+    gdouble begin = (event->begin - timings.origin) /
+        (gdouble) G_TIME_SPAN_MILLISECOND;
+
+    if (event->end == -1)
+      g_print ("  %9.2f %9s  %s\n", begin, "", event->name);
+    else if (event->end == 0)
+      g_print ("  %9.2f %9s  %s\n", begin, "-", event->name);
+    else
+      g_print ("  %9.2f %9.2f  %s\n", begin,
+          (event->end - event->begin) / (gdouble) G_TIME_SPAN_MILLISECOND,
+          event->name);
+  }
+}
+
+static TimingEvent *
+record (const gchar * name, gint64 end)
+{
+  TimingEvent *event;
+
+  if (timings.finished || timings.count == TIMINGS_MAX_EVENTS)
+    return NULL;
+
+  event = &timings.events[timings.count++];
+  event->name = name;
+  event->begin = g_get_monotonic_time ();
+  event->end = end;
+
+  return event;
+}
+
+// Chrome's trace event format, which chrome://tracing and Perfetto load
+static gboolean
+write_trace (const gchar * path)
+{
+  GString *out = g_string_new ("{\"traceEvents\":[");
+  GError *error = NULL;
+  gboolean ok;
+  guint i;
+  gint pid = getpid ();
+
+  for (i = 0; i < timings.count; i++) {
+    TimingEvent *event = &timings.events[i];
+
+    g_string_append (out, i ? ",\n{\"name\":" : "\n{\"name\":");
+    append_json_string (out, event->name);
+    g_string_append_printf (out, ",\"cat\":\"startup\",\"ts\":%"
+        G_GINT64_FORMAT, event->begin - timings.origin);
+    if (event->end == -1)
+      g_string_append (out, ",\"ph\":\"i\",\"s\":\"p\"");
+    else if (event->end > 0)
+      g_string_append_printf (out, ",\"ph\":\"X\",\"dur\":%" G_GINT64_FORMAT,
+          event->end - event->begin);
+    else
+      g_string_append (out, ",\"ph\":\"B\"");
+    g_string_append_printf (out, ",\"pid\":%d,\"tid\":%d}", pid, pid);
+  }
+  g_string_append (out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  ok = g_file_set_contents (path, out->str, out->len, &error);
+  if (!ok) {
+    g_print ("ERROR: Couldn't write %s: %s\n", path, error->message);
+    g_error_free (error);
+  }
+  g_string_free (out, TRUE);
+
+  return ok;
+}
+
+/* -------------------- non-static functions --------------------- */
+
+void
+timings_begin (const gchar * name)
+{
+  record (name, 0);
+}
+
+void
+timings_enable (gboolean print, const gchar * trace_file, gboolean quit)
+{
+  timings.print = print;
+  timings.quit = quit;
+  g_free (timings.trace_file);
+  timings.trace_file = g_strdup (trace_file);
+}
+
+// Close the last open span of that name, if there is one
+void
+timings_end (const gchar * name)
+{
+  gint i;
+
+  if (timings.finished)
+    return;
+
+  for (i = timings.count - 1; i >= 0; i--) {
+    TimingEvent *event = &timings.events[i];
+
+    if (event->end == 0 && !g_strcmp0 (event->name, name)) {
+      event->end = g_get_monotonic_time ();
+      return;
+    }
+  }
+}
+
+// Stop recording and report. Returns whether snappy was asked to quit then
+gboolean
+timings_finish (void)
+{
+  if (timings.finished)
+    return FALSE;
+  timings.finished = TRUE;
+
+  if (timings.print)
+    print_timeline ();
+  if (timings.trace_file) {
+    write_trace (timings.trace_file);
+    g_clear_pointer (&timings.trace_file, g_free);
+  }
+
+  return timings.quit;
+}
+
+void
+timings_init (gint64 origin)
+{
+  timings.origin = origin;
+}
+
+void
+timings_mark (const gchar * name)
+{
+  record (name, -1);
+}
@@ -0,0 +1,45 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __TIMINGS_H__
+#define __TIMINGS_H__
+
+#include <glib.h>
+
+#define TIMINGS_MAX_EVENTS 64
+
+G_BEGIN_DECLS
+
+/* A timeline of where startup time goes, from the start of main() to the
+ * first painted frame. Spans and marks are always recorded, as they only
+ * cost a clock read; they are printed or saved once timings_enable() asked
+ * for it. Names must be static strings. Main thread only. */
+void timings_begin (const gchar * name);
+void timings_enable (gboolean print, const gchar * trace_file,
+    gboolean quit);
+void timings_end (const gchar * name);
+gboolean timings_finish (void);
+void timings_init (gint64 origin);
+void timings_mark (const gchar * name);
+
+G_END_DECLS
+#endif /* __TIMINGS_H__ */
@@ -29,26 +29,55 @@
 #include <clutter-gst/clutter-gst.h>
 #include <clutter-gtk/clutter-gtk.h>
 
+#include "timings.h"
 #include "user_interface.h"
 #include "utils.h"
 
 // Declaration of static functions
+static gboolean actor_contains_point (ClutterActor * actor, gfloat x,
+    gfloat y);
+static ClutterActor *actor_at_pos (UserInterface * ui, gfloat x, gfloat y);
+static void clip_export_cb (ClipExport * export, gdouble progress,
+    gboolean done, const GError * error, UserInterface * ui);
+static void clip_mark (UserInterface * ui, gboolean in);
+static void clip_start_export (UserInterface * ui, gboolean smart);
+static void close_window (UserInterface * ui);
+static void controls_faded_cb (ClutterActor * actor, UserInterface * ui);
 static gboolean controls_timeout_cb (gpointer data);
 static gboolean draw_background (ClutterCanvas * canvas, cairo_t * cr,
     int surface_width, int surface_height, UserInterface * ui);
-static gboolean draw_progressbar (ClutterCanvas * canvas, cairo_t * cr,
+static gboolean draw_progressbar_fill (ClutterCanvas * canvas, cairo_t * cr,
+    int surface_width, int surface_height, UserInterface * ui);
+static gboolean draw_progressbar_track (ClutterCanvas * canvas, cairo_t * cr,
     int surface_width, int surface_height, UserInterface * ui);
 static gboolean event_cb (ClutterStage * stage, ClutterEvent * event,
     UserInterface * ui);
+static void first_paint_cb (ClutterStage * stage, UserInterface * ui);
 static void hide_cursor (UserInterface * ui, float *x, float *y);
+static void layout_queue (UserInterface * ui);
+static gboolean layout_update (gpointer data);
 static void load_controls (UserInterface * ui);
+static void new_frame_cb (ClutterGstVideoSink * sink, UserInterface * ui);
 static void new_video_size (UserInterface * ui, gfloat width, gfloat height,
     gfloat * new_width, gfloat * new_height);
 static gboolean penalty_box (gpointer data);
-static gchar *position_ns_to_str (UserInterface * ui, gint64 nanoseconds);
-static void progress_timing (UserInterface * ui);
-static gboolean progress_update_text (gpointer data);
-static gboolean progress_update_seekbar (gpointer data);
+static void position_ns_to_str (gint64 nanoseconds, gchar * str, gsize size);
+static void preview_hide (UserInterface * ui);
+static void preview_place (UserInterface * ui);
+static void preview_ready_cb (SeekPreview * preview, GstClockTime position,
+    ClutterContent * content, UserInterface * ui);
+static void preview_show (UserInterface * ui, gfloat x);
+static void preview_show_content (UserInterface * ui, ClutterContent * content);
+static void progress_new_frame_cb (ClutterTimeline * timeline, gint msecs,
+    UserInterface * ui);
+static void progress_timeline_update (UserInterface * ui);
+static void progress_update (UserInterface * ui);
+static ClutterActor *progressbar_new (UserInterface * ui, ClutterActor ** fill);
+static void progressbar_path (cairo_t * cr, int surface_width,
+    int surface_height);
+static void progressbar_set_fill (ClutterActor * fill, gfloat position);
+static void progressbar_set_size (ClutterActor * bar, ClutterActor * fill,
+    gfloat width, gfloat height);
 gboolean rotate_video (UserInterface * ui);
 static void size_change (ClutterStage * stage,
     const ClutterActorBox * allocation, ClutterAllocationFlags flags,
@@ -58,9 +87,154 @@ static void toggle_fullscreen (UserInterface * ui);
 static void toggle_playing (UserInterface * ui);
 static void update_controls_size (UserInterface * ui);
 static gboolean update_volume (UserInterface * ui, gdouble volume);
+static gboolean window_delete_cb (GtkWidget * widget, GdkEvent * event,
+    UserInterface * ui);
+static gboolean window_map_cb (GtkWidget * widget, GdkEvent * event,
+    UserInterface * ui);
+static gboolean window_state_cb (GtkWidget * widget,
+    GdkEventWindowState * event, UserInterface * ui);
+static gboolean window_visibility_cb (GtkWidget * widget,
+    GdkEventVisibility * event, UserInterface * ui);
+static void window_visibility_update (UserInterface * ui);
 
 /* ---------------------- static functions ----------------------- */
 
+static gboolean
+actor_contains_point (ClutterActor * actor, gfloat x, gfloat y)
+{
+  gfloat actor_x, actor_y;
+
+  if (actor == NULL || !clutter_actor_is_mapped (actor))
+    return FALSE;
+
+  // Invert the actor's transformation on the CPU, no pick pass needed
+  if (!clutter_actor_transform_stage_point (actor, x, y, &actor_x, &actor_y))
+    return FALSE;
+
+  return (actor_x >= 0 && actor_y >= 0 &&
+      actor_x < clutter_actor_get_width (actor) &&
+      actor_y < clutter_actor_get_height (actor));
+}
+
+static ClutterActor *
+actor_at_pos (UserInterface * ui, gfloat x, gfloat y)
+{
+  ClutterActor *targets[] = {
+    ui->control_play_toggle,
+    ui->control_seekbar,
+    ui->vol_int,
+    ui->fullscreen_button,
+    ui->audio_stream_toggle,
+    ui->subtitle_toggle,
+    ui->video_stream_toggle,
+    ui->control_pos,
+  };
+  guint c;
+
+  // Geometric hit-testing against the control boxes we know about, so
+  // pointer handling never forces a GPU pick and readback
+  if (ui->controls_showing && actor_contains_point (ui->control_box, x, y)) {
+    for (c = 0; c < G_N_ELEMENTS (targets); c++) {
+      if (actor_contains_point (targets[c], x, y))
+        return targets[c];
+    }
+
+    return ui->control_box;
+  }
+
+  if (actor_contains_point (ui->texture, x, y))
+    return ui->texture;
+
+  return ui->stage;
+}
+
+static void
+clip_export_cb (ClipExport * export, gdouble progress, gboolean done,
+    const GError * error, UserInterface * ui)
+{
+  gchar text[TITLE_STR_SIZE];
+
+  // Progress takes the place of the title until the clip is written
+  if (!done) {
+    g_snprintf (text, sizeof (text), "Exporting clip %.0f%%", progress * 100);
+    clutter_text_set_text (CLUTTER_TEXT (ui->control_title), text);
+    return;
+  }
+
+  ui->clip_export = NULL;
+  clutter_text_set_text (CLUTTER_TEXT (ui->control_title), ui->title_str);
+
+  if (error != NULL)
+    g_print ("Couldn't export the clip: %s\n", error->message);
+  else
+    g_print ("Clip saved to %s\n", clip_export_get_output (export));
+}
+
+static void
+clip_mark (UserInterface * ui, gboolean in)
+{
+  gint64 pos;
+  gchar pos_str[TIME_STR_SIZE];
+
+  pos = query_position (ui->engine);
+  position_ns_to_str (pos, pos_str, sizeof (pos_str));
+
+  if (in) {
+    ui->clip_in = pos;
+    g_print ("Clip in: %s\n", pos_str);
+  } else {
+    ui->clip_out = pos;
+    g_print ("Clip out: %s\n", pos_str);
+  }
+}
+
+static void
+clip_start_export (UserInterface * ui, gboolean smart)
+{
+  GstClockTime start, stop;
+  gchar *output;
+
+  if (ui->clip_export != NULL || ui->engine->uri == NULL)
+    return;
+
+  // Without marks the clip runs from the start or to the end
+  start = GST_CLOCK_TIME_IS_VALID (ui->clip_in) ? ui->clip_in : 0;
+  stop = ui->clip_out;
+  if (GST_CLOCK_TIME_IS_VALID (stop) && stop <= start) {
+    g_print ("The clip ends before it starts\n");
+    return;
+  }
+
+  output = clip_export_output_for (ui->engine->uri, start, stop, smart);
+  g_print ("Exporting clip to %s\n", output);
+  ui->clip_export = clip_export_start (ui->engine->uri, output, start, stop,
+      smart, (ClipExportFunc) clip_export_cb, ui);
+  g_free (output);
+}
+
+static void
+close_window (UserInterface * ui)
+{
+  if (!ui->daemon) {
+    gtk_main_quit ();
+    return;
+  }
+
+  // Stay resident, with everything initialised, for the next request
+  add_uri_unfinished (ui->engine);
+  engine_stop (ui->engine);
+  gtk_widget_hide (ui->window);
+  screensaver_enable (ui->screensaver, TRUE);
+}
+
+static void
+controls_faded_cb (ClutterActor * actor, UserInterface * ui)
+{
+  // Drop the faded out overlay from the scene so it isn't painted at all
+  if (!ui->controls_showing)
+    clutter_actor_hide (ui->control_box);
+}
+
 static gboolean
 controls_timeout_cb (gpointer data)
 {
@@ -78,8 +252,7 @@ controls_timeout_cb (gpointer data)
   ui->controls_timeout = -1;
 
   // Only hide controls and cursor if the cursor is outside the control box.
-  actor = clutter_stage_get_actor_at_pos (CLUTTER_STAGE (ui->stage),
-      CLUTTER_PICK_ALL, point.x, point.y);
+  actor = actor_at_pos (ui, point.x, point.y);
   if (actor == ui->texture) {
     hide_cursor (ui, &point.x, &point.y);
     if (!ui->keep_showing_controls) {
@@ -153,39 +326,20 @@ draw_background (ClutterCanvas * canvas, cairo_t * cr, int surface_width,
 
 
 static gboolean
-draw_progressbar (ClutterCanvas * canvas, cairo_t * cr, int surface_width,
+draw_progressbar_fill (ClutterCanvas * canvas, cairo_t * cr, int surface_width,
     int surface_height, UserInterface * ui)
 {
-  double x, y, width, height, aspect, corner_radius, radius, degrees;
   double red, green, blue, alpha;
-  gfloat position;
   cairo_pattern_t *pattern;
 
-  x = 1.0;
-  y = 1.0;
-  width = surface_width - 2.0;
-  height = surface_height - 2.0;
-  aspect = 1.0;                 // aspect ratio
-  corner_radius = height / 4.0; // and corner curvature radius
-
-  radius = corner_radius / aspect;
-  degrees = M_PI / 180.0;
-
   cairo_save (cr);
   cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
   cairo_paint (cr);
   cairo_restore (cr);
 
+  // The whole bar is filled, the visible extent is set with a clip
   pattern = cairo_pattern_create_linear (0.0, 0.0, surface_width, 0.0);
 
-  if (canvas == CLUTTER_CANVAS (ui->seek_canvas)) {
-    // if called for seek canvas, update playback position
-    position = ui->playback_position;
-  } else {
-    // if called for volume canvas, update volume level
-    position = ui->volume;
-  }
-
   red = (double) ui->gradient_start.red / 256.0;
   green = (double) ui->gradient_start.green / 256.0;
   blue = (double) ui->gradient_start.blue / 256.0;
@@ -196,23 +350,38 @@ draw_progressbar (ClutterCanvas * canvas, cairo_t * cr, int surface_width,
   green = (double) ui->gradient_finish.green / 256.0;
   blue = (double) ui->gradient_finish.blue / 256.0;
   alpha = (double) ui->gradient_finish.alpha / 256.0;
-  cairo_pattern_add_color_stop_rgba (pattern, position, red, green, blue,
-      alpha);
-
-  cairo_pattern_add_color_stop_rgba (pattern, position + 0.0001, 0, 0, 0, 0.0);
-  cairo_pattern_add_color_stop_rgba (pattern, 1.0, 0, 0, 0, 0.0);
+  cairo_pattern_add_color_stop_rgba (pattern, 1.0, red, green, blue, alpha);
   cairo_set_source (cr, pattern);
 
-  cairo_arc (cr, x + width - radius, y + radius, radius, -90 * degrees,
-      0 * degrees);
-  cairo_arc (cr, x + width - radius, y + height - radius, radius, 0 * degrees,
-      90 * degrees);
-  cairo_arc (cr, x + radius, y + height - radius, radius, 90 * degrees,
-      180 * degrees);
-  cairo_arc (cr, x + radius, y + radius, radius, 180 * degrees, 270 * degrees);
-  cairo_close_path (cr);
-
+  progressbar_path (cr, surface_width, surface_height);
   cairo_fill_preserve (cr);
+  cairo_pattern_destroy (pattern);
+
+  red = (double) ui->border_color.red / 256.0;
+  green = (double) ui->border_color.green / 256.0;
+  blue = (double) ui->border_color.blue / 256.0;
+  alpha = (double) ui->border_color.alpha / 256.0;
+
+  cairo_set_source_rgba (cr, red, green, blue, alpha);
+  cairo_stroke (cr);
+
+  // We are done drawing
+  return TRUE;
+}
+
+
+static gboolean
+draw_progressbar_track (ClutterCanvas * canvas, cairo_t * cr,
+    int surface_width, int surface_height, UserInterface * ui)
+{
+  double red, green, blue, alpha;
+
+  cairo_save (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_restore (cr);
+
+  progressbar_path (cr, surface_width, surface_height);
 
   red = (double) ui->border_color.red / 256.0;
   green = (double) ui->border_color.green / 256.0;
@@ -243,7 +412,7 @@ event_cb (ClutterStage * stage, ClutterEvent * event, UserInterface * ui)
         case CLUTTER_Q:
         case CLUTTER_Escape:
         {
-          gtk_main_quit ();
+          close_window (ui);
 
           handled = TRUE;
           break;
@@ -274,6 +443,7 @@ event_cb (ClutterStage * stage, ClutterEvent * event, UserInterface * ui)
         {
           // Loop
           ui->engine->loop = !ui->engine->loop;
+          engine_notify (ui->engine, ENGINE_CHANGE_LOOP);
 
           handled = TRUE;
           break;
@@ -363,8 +533,7 @@ event_cb (ClutterStage * stage, ClutterEvent * event, UserInterface * ui)
           engine_seek (ui->engine, pos, FALSE);
 
           ui->playback_position = (float) pos / ui->engine->media_duration;
-          // Invalidate calls a redraw of the canvas
-          clutter_content_invalidate (ui->seek_canvas);
+          progressbar_set_fill (ui->seek_fill, ui->playback_position);
 
           handled = TRUE;
           break;
@@ -450,10 +619,55 @@ event_cb (ClutterStage * stage, ClutterEvent * event, UserInterface * ui)
           break;
         }
 
+        case CLUTTER_I:
+        case CLUTTER_O:
+        {
+          // mark where the clip to export starts or ends
+          clip_mark (ui, keyval == CLUTTER_I);
+
+          handled = TRUE;
+          break;
+        }
+
+        case CLUTTER_x:
+        case CLUTTER_X:
+        {
+          // export the marked clip, only re-encoding its ends with X
+          clip_start_export (ui, keyval == CLUTTER_X);
+
+          handled = TRUE;
+          break;
+        }
+
+        case CLUTTER_p:
+        case CLUTTER_P:
+        {
+          // dump what the profiler gathered so far
+          if (ui->profiler != NULL)
+            profiler_dump (ui->profiler);
+          else
+            g_print ("Start snappy with --profile to profile playback\n");
+
+          handled = TRUE;
+          break;
+        }
+
+        case CLUTTER_s:
+        case CLUTTER_S:
+        {
+          // show/hide playback statistics
+          stats_overlay_toggle (ui->stats_overlay);
+
+          handled = TRUE;
+          break;
+        }
+
         case CLUTTER_o:
         {
           // switch display to time left of the stream
           ui->duration_str_fwd_direction = !ui->duration_str_fwd_direction;
+          ui->progress_second = -1;
+          progress_update (ui);
 
           handled = TRUE;
           break;
@@ -524,8 +738,7 @@ event_cb (ClutterStage * stage, ClutterEvent * event, UserInterface * ui)
         ClutterActor *actor;
         ClutterButtonEvent *bev = (ClutterButtonEvent *) event;
 
-        actor = clutter_stage_get_actor_at_pos (stage, CLUTTER_PICK_ALL,
-            bev->x, bev->y);
+        actor = actor_at_pos (ui, bev->x, bev->y);
         if (actor == ui->control_play_toggle) {
           toggle_playing (ui);
 
@@ -545,8 +758,7 @@ event_cb (ClutterStage * stage, ClutterEvent * event, UserInterface * ui)
           engine_seek (ui->engine, pos, FALSE);
 
           ui->playback_position = (float) pos / ui->engine->media_duration;
-          // Invalidate calls a redraw of the canvas
-          clutter_content_invalidate (ui->seek_canvas);
+          progressbar_set_fill (ui->seek_fill, ui->playback_position);
 
         } else if (actor == ui->vol_int) {
           gfloat x, y, dist;
@@ -559,7 +771,7 @@ event_cb (ClutterStage * stage, ClutterEvent * event, UserInterface * ui)
           volume = dist / ui->volume_width;
           g_object_set (G_OBJECT (ui->engine->player), "volume", volume, NULL);
           ui->volume = (float) volume;
-          clutter_content_invalidate (ui->vol_int_canvas);
+          progressbar_set_fill (ui->vol_int_fill, ui->volume);
 
         } else if (actor == ui->texture || actor == ui->stage) {
           if (!ui->penalty_box_active) {
@@ -591,6 +803,8 @@ event_cb (ClutterStage * stage, ClutterEvent * event, UserInterface * ui)
 
         } else if (actor == ui->control_pos) {
           ui->duration_str_fwd_direction = !ui->duration_str_fwd_direction;
+          ui->progress_second = -1;
+          progress_update (ui);
         }
       }
 
@@ -600,9 +814,17 @@ event_cb (ClutterStage * stage, ClutterEvent * event, UserInterface * ui)
 
     case CLUTTER_MOTION:
     {
+      ClutterMotionEvent *mev = (ClutterMotionEvent *) event;
+
       if (!ui->penalty_box_active)
         show_controls (ui, TRUE);
 
+      if (ui->controls_showing &&
+          actor_at_pos (ui, mev->x, mev->y) == ui->control_seekbar)
+        preview_show (ui, mev->x);
+      else
+        preview_hide (ui);
+
       handled = TRUE;
       break;
     }
@@ -617,6 +839,17 @@ event_cb (ClutterStage * stage, ClutterEvent * event, UserInterface * ui)
   return handled;
 }
 
+static void
+first_paint_cb (ClutterStage * stage, UserInterface * ui)
+{
+  g_signal_handlers_disconnect_by_func (stage, first_paint_cb, ui);
+
+  // Startup is over, report it
+  timings_mark ("first_paint");
+  if (timings_finish ())
+    gtk_main_quit ();
+}
+
 
 static void
 hide_cursor (UserInterface * ui, float *x, float *y)
@@ -640,12 +873,64 @@ hide_cursor (UserInterface * ui, float *x, float *y)
   }
 }
 
+static void
+layout_queue (UserInterface * ui)
+{
+  // Coalesce every size change into a single layout before the next frame
+  if (ui->layout_id == 0) {
+    ui->layout_id =
+        clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT
+        | CLUTTER_REPAINT_FLAGS_QUEUE_REDRAW_ON_ADD, layout_update, ui, NULL);
+  }
+}
+
+static gboolean
+layout_update (gpointer data)
+{
+  UserInterface *ui = data;
+  gboolean stage_changed;
+  gfloat video_width, video_height;
+
+  ui->layout_id = 0;
+
+  ui->stage_width = clutter_actor_get_width (ui->stage);
+  ui->stage_height = clutter_actor_get_height (ui->stage);
+
+  stage_changed = (ui->stage_width != ui->layout_stage_width ||
+      ui->stage_height != ui->layout_stage_height);
+
+  // The texture is reset to the media size when new media is loaded
+  if (stage_changed ||
+      clutter_actor_get_width (ui->texture) != ui->layout_video_width ||
+      clutter_actor_get_height (ui->texture) != ui->layout_video_height) {
+    new_video_size (ui, ui->stage_width, ui->stage_height, &video_width,
+        &video_height);
+    clutter_actor_set_size (CLUTTER_ACTOR (ui->texture), video_width,
+        video_height);
+
+    ui->layout_video_width = video_width;
+    ui->layout_video_height = video_height;
+  }
+
+  if (stage_changed || ui->layout_controls_dirty ||
+      ui->subtitles_available != ui->layout_subtitles) {
+    update_controls_size (ui);
+
+    ui->layout_controls_dirty = FALSE;
+    ui->layout_subtitles = ui->subtitles_available;
+  }
+
+  ui->layout_stage_width = ui->stage_width;
+  ui->layout_stage_height = ui->stage_height;
+
+  return FALSE;
+}
+
 static void
 load_controls (UserInterface * ui)
 {
   // Check icon files exist
   gchar *icon_files[9];
-  gchar *duration_str = NULL;
   gint c;
 
   ClutterContent *canvas;
@@ -701,6 +986,13 @@ load_controls (UserInterface * ui)
   ui->control_box = clutter_actor_new ();
   clutter_actor_set_layout_manager (ui->control_box, controls_layout);
 
+  // Flatten the overlay into a cached layer that is only redrawn when its
+  // content changes, so a fade blends a single textured quad
+  clutter_actor_set_offscreen_redirect (ui->control_box,
+      CLUTTER_OFFSCREEN_REDIRECT_ALWAYS);
+  g_signal_connect (ui->control_box, "transitions-completed",
+      G_CALLBACK (controls_faded_cb), ui);
+
   // Controls rectangular background with curved edges (drawn in cairo)
   canvas = clutter_canvas_new ();
   clutter_canvas_set_size (CLUTTER_CANVAS (canvas),
@@ -737,8 +1029,10 @@ load_controls (UserInterface * ui)
       CLUTTER_ACTOR (ui->main_box));
 
   // Controls title
+  cut_long_filename (ui->filename, ui->title_length, ui->title_str,
+      sizeof (ui->title_str));
   ui->control_title = clutter_text_new_full ("Clear Sans Bold 32px",
-      cut_long_filename (ui->filename, ui->title_length), &ui->text_color);
+      ui->title_str, &ui->text_color);
   if (strcmp (ui->filename, "") == 0) {
     clutter_text_set_text (CLUTTER_TEXT (ui->control_title),
         "Drag and drop a file here to play it");
@@ -793,15 +1087,7 @@ load_controls (UserInterface * ui)
   clutter_actor_set_layout_manager (ui->pos_n_vol_box, ui->pos_n_vol_layout);
 
   // Seek progress bar
-  ui->seek_canvas = clutter_canvas_new ();
-  clutter_canvas_set_size (CLUTTER_CANVAS (ui->seek_canvas),
-      ui->media_width * CONTROLS_WIDTH_RATIO,
-      (ui->media_height * CONTROLS_HEIGHT_RATIO) / 5);
-  ui->control_seekbar = clutter_actor_new ();
-  clutter_actor_set_content (ui->control_seekbar, ui->seek_canvas);
-
-  g_signal_connect (ui->seek_canvas, "draw", G_CALLBACK (draw_progressbar), ui);
-  clutter_content_invalidate (ui->seek_canvas);
+  ui->control_seekbar = progressbar_new (ui, &ui->seek_fill);
 
   // Add seek box to Position and Volume Layout
   clutter_box_layout_pack (CLUTTER_BOX_LAYOUT (ui->pos_n_vol_layout), ui->control_seekbar, TRUE,        /* expand */
@@ -843,16 +1129,7 @@ load_controls (UserInterface * ui)
   // Controls volume intensity
   vol_int_box = clutter_actor_new ();
 
-  ui->vol_int_canvas = clutter_canvas_new ();
-  clutter_canvas_set_size (CLUTTER_CANVAS (ui->vol_int_canvas),
-      ui->media_width * CONTROLS_WIDTH_RATIO,
-      (ui->media_height * CONTROLS_HEIGHT_RATIO) / 5);
-  ui->vol_int = clutter_actor_new ();
-  clutter_actor_set_content (ui->vol_int, ui->vol_int_canvas);
-
-  g_signal_connect (ui->vol_int_canvas, "draw", G_CALLBACK (draw_progressbar),
-      ui);
-  clutter_content_invalidate (ui->vol_int_canvas);
+  ui->vol_int = progressbar_new (ui, &ui->vol_int_fill);
 
   clutter_actor_add_child (vol_int_box, ui->vol_int);
   clutter_actor_add_child (ui->volume_box, vol_int_box);
@@ -870,8 +1147,9 @@ load_controls (UserInterface * ui)
   clutter_actor_add_child (ui->volume_box, ui->volume_high);
 
   // Controls position text
-  duration_str = g_strdup_printf ("   0:00:00 | %s", ui->duration_str);
-  ui->control_pos = clutter_text_new_full ("Clear Sans 22px", duration_str,
+  g_snprintf (ui->position_str, sizeof (ui->position_str), "   0:00:00 | %s",
+      ui->duration_str);
+  ui->control_pos = clutter_text_new_full ("Clear Sans 22px", ui->position_str,
       &ui->text_color);
   clutter_actor_add_child (middle_box, ui->control_pos);
 
@@ -982,7 +1260,46 @@ load_controls (UserInterface * ui)
   clutter_actor_set_child_below_sibling (ui->control_box, ui->control_bg,
       ui->main_box);
 
-  size_change (CLUTTER_STAGE (ui->stage), NULL, 0, ui);
+  ui->layout_controls_dirty = TRUE;
+  layout_queue (ui);
+}
+
+static void
+new_frame_cb (ClutterGstVideoSink * sink, UserInterface * ui)
+{
+  gint64 elapsed;
+
+  // Every open is traced to its first frame, not just those waited on here
+  open_trace_step (ui->engine->open_trace, OPEN_STEP_FIRST_FRAME);
+
+  if (!ui->frame_pending) {
+    open_trace_finish (ui->engine->open_trace);
+    return;
+  }
+
+  ui->frame_pending = FALSE;
+  elapsed = g_get_monotonic_time () - ui->open_time;
+  g_print ("Time to first frame: %" G_GINT64_FORMAT " ms (%s start)\n",
+      elapsed / G_TIME_SPAN_MILLISECOND, ui->warm_start ? "warm" : "cold");
+
+  // The frame is only on screen once the stage has painted it
+  timings_mark ("first_frame");
+  if (!ui->blind)
+    g_signal_connect (ui->stage, "after-paint", G_CALLBACK (first_paint_cb),
+        ui);
+  else if (timings_finish ())
+    gtk_main_quit ();
+
+  // A daemon only shows up once there is a frame to show
+  if (ui->daemon && !ui->blind && !gtk_widget_get_visible (ui->window)) {
+    screensaver_enable (ui->screensaver, FALSE);
+    gtk_window_present (GTK_WINDOW (ui->window));
+  }
+
+  window_visibility_update (ui);
+
+  // Reported once the first frame is on its way to the screen
+  open_trace_finish (ui->engine->open_trace);
 }
 
 static void
@@ -1030,94 +1347,264 @@ penalty_box (gpointer data)
     ui->penalty_box_active = FALSE;
   } else {
     ui->penalty_box_active = TRUE;
-    g_timeout_add (PENALTY_TIME, penalty_box, ui);
+    scheduler_add (ui->scheduler, PENALTY_TIME, penalty_box, ui);
   }
 
   return FALSE;
 }
 
-static gchar *
-position_ns_to_str (UserInterface * ui, gint64 nanoseconds)
+static void
+position_ns_to_str (gint64 nanoseconds, gchar * str, gsize size)
 {
   gint64 seconds;
   gint hours, minutes;
 
-  if (!ui->duration_str_fwd_direction)
-    nanoseconds = ui->engine->media_duration - nanoseconds;
-
-  seconds = nanoseconds / GST_SECOND;
+  seconds = MAX (nanoseconds, 0) / GST_SECOND;
   hours = seconds / SEC_IN_HOUR;
   seconds = seconds - (hours * SEC_IN_HOUR);
   minutes = seconds / SEC_IN_MIN;
   seconds = seconds - (minutes * SEC_IN_MIN);
 
   if (hours >= 1)
-    return g_strdup_printf ("%d:%02d:%02" G_GINT64_FORMAT, hours, minutes, seconds);
+    g_snprintf (str, size, "%d:%02d:%02" G_GINT64_FORMAT, hours, minutes,
+        seconds);
   else
-    return g_strdup_printf ("%02d:%02" G_GINT64_FORMAT, minutes, seconds);
+    g_snprintf (str, size, "%02d:%02" G_GINT64_FORMAT, minutes, seconds);
 }
 
 static void
-progress_timing (UserInterface * ui)
+preview_hide (UserInterface * ui)
 {
-  gint64 duration_ms;
-  gint64 timeout_ms;
+  ui->preview_position = GST_CLOCK_TIME_NONE;
+  clutter_actor_hide (ui->seek_preview_actor);
+}
 
-  if (ui->progress_id != -1)
-    g_source_remove (ui->progress_id);
+// Centred over the pointer, kept within the stage
+static void
+preview_place (UserInterface * ui)
+{
+  gfloat bar_x, bar_y, width, height;
+
+  clutter_actor_get_transformed_position (ui->control_seekbar, &bar_x,
+      &bar_y);
+  clutter_actor_get_size (ui->seek_preview_actor, &width, &height);
+  clutter_actor_set_position (ui->seek_preview_actor,
+      CLAMP (ui->preview_x - width / 2, 0, MAX (ui->stage_width - width, 0)),
+      MAX (bar_y - height - ui->seek_height, 0));
+}
 
-  duration_ms = ui->engine->media_duration / GST_MSECOND;
-  if (duration_ms > 0) {
-    timeout_ms = MAX (250, duration_ms / ui->seek_width);
-    ui->progress_id = g_timeout_add (timeout_ms, progress_update_seekbar, ui);
+static void
+preview_ready_cb (SeekPreview * preview, GstClockTime position,
+    ClutterContent * content, UserInterface * ui)
+{
+  // The pointer may have moved on, show whatever covers where it is now
+  if (GST_CLOCK_TIME_IS_VALID (ui->preview_position)) {
+    content = seek_preview_lookup (preview, ui->preview_position);
+    if (content != NULL)
+      preview_show_content (ui, content);
   }
 }
 
-static gboolean
-progress_update_text (gpointer data)
+static void
+preview_show (UserInterface * ui, gfloat x)
 {
-  UserInterface *ui = (UserInterface *) data;
-  GstEngine *engine = ui->engine;
-
-  if (ui->controls_showing && !engine->queries_blocked) {
-    if (engine->media_duration != -1) {
-      gchar *duration_str;
-      gint64 pos;
+  ClutterContent *content;
+  gfloat bar_x, bar_y, dist;
+
+  if (ui->seek_preview == NULL || ui->engine->media_duration <= 0 ||
+      !ui->engine->has_video)
+    return;
+
+  clutter_actor_get_transformed_position (ui->control_seekbar, &bar_x,
+      &bar_y);
+  dist = CLAMP (x - bar_x, 0, ui->seek_width);
+  ui->preview_position = ui->engine->media_duration * (dist / ui->seek_width);
+  ui->preview_x = x;
+  preview_place (ui);
+
+  content = seek_preview_lookup (ui->seek_preview, ui->preview_position);
+  if (content != NULL)
+    preview_show_content (ui, content);
+  else
+    seek_preview_request (ui->seek_preview, ui->preview_position);
+}
 
-      if (ui->media_duration != engine->media_duration) {
-        progress_timing (ui);
-      }
+static void
+preview_show_content (UserInterface * ui, ClutterContent * content)
+{
+  gfloat width, height;
+
+  if (clutter_actor_get_content (ui->seek_preview_actor) != content) {
+    clutter_actor_set_content (ui->seek_preview_actor, content);
+    // The first preview sets the size, it is placed again for it
+    if (clutter_content_get_preferred_size (content, &width, &height)) {
+      clutter_actor_set_size (ui->seek_preview_actor, width, height);
+      preview_place (ui);
+    }
+  }
 
-      pos = query_position (engine);
+  clutter_actor_show (ui->seek_preview_actor);
+}
 
-      duration_str = g_strdup_printf ("   %s | %s",
-          position_ns_to_str (ui, pos), ui->duration_str);
-      clutter_text_set_text (CLUTTER_TEXT (ui->control_pos), duration_str);
-    }
+static void
+progress_new_frame_cb (ClutterTimeline * timeline, gint msecs,
+    UserInterface * ui)
+{
+  gint64 before, made;
+
+  // Soak runs preload a counter to check ticks don't allocate
+  before = thread_allocations ();
+  progress_update (ui);
+  if (before >= 0) {
+    made = thread_allocations () - before;
+    ui->ticks++;
+    ui->tick_allocations += made;
+    if (made > 0)
+      ui->allocating_ticks++;
   }
+}
 
-  return TRUE;
+static void
+progress_timeline_update (UserInterface * ui)
+{
+  // Playing with hidden controls is the state we want the fewest wakeups in
+  scheduler_set_idle (ui->scheduler, !ui->controls_showing
+      && ui->engine->playing);
+
+  // Follow the stage frame clock only while there is progress to show
+  if (ui->controls_showing && ui->engine->playing) {
+    if (!clutter_timeline_is_playing (ui->progress_timeline))
+      clutter_timeline_start (ui->progress_timeline);
+  } else {
+    clutter_timeline_stop (ui->progress_timeline);
+  }
 }
 
-static gboolean
-progress_update_seekbar (gpointer data)
+static void
+progress_update (UserInterface * ui)
 {
-  UserInterface *ui = (UserInterface *) data;
   GstEngine *engine = ui->engine;
+  gint64 pos, shown, second;
 
-  if (ui->controls_showing && !engine->queries_blocked) {
-    if (engine->media_duration != -1) {
-      gfloat pos;
+  if (engine->media_duration <= 0)
+    return;
 
-      pos = (float) query_position (engine) / engine->media_duration;
-      ui->playback_position = pos;
+  if (ui->media_duration != engine->media_duration) {
+    ui->media_duration = engine->media_duration;
+    position_ns_to_str (ui->media_duration, ui->duration_str,
+        sizeof (ui->duration_str));
+    ui->progress_second = -1;
+  }
 
-      // Invalidate calls a redraw of the canvas
-      clutter_content_invalidate (ui->seek_canvas);
-    }
+  // Interpolated from the pipeline clock, no query walks the pipeline
+  pos = engine_interpolate_position (engine);
+
+  ui->playback_position = (float) pos / engine->media_duration;
+  progressbar_set_fill (ui->seek_fill, ui->playback_position);
+
+  // The position label only changes once per displayed second, and is
+  // formatted into buffers owned by the interface so ticks don't allocate
+  if (ui->duration_str_fwd_direction)
+    shown = pos;
+  else
+    shown = engine->media_duration - pos;
+
+  second = shown / GST_SECOND;
+  if (second != ui->progress_second) {
+    gchar shown_str[TIME_STR_SIZE];
+
+    ui->progress_second = second;
+    position_ns_to_str (shown, shown_str, sizeof (shown_str));
+    g_snprintf (ui->position_str, sizeof (ui->position_str), "   %s | %s",
+        shown_str, ui->duration_str);
+    clutter_text_set_text (CLUTTER_TEXT (ui->control_pos), ui->position_str);
   }
+}
 
-  return TRUE;
+static void
+progressbar_path (cairo_t * cr, int surface_width, int surface_height)
+{
+  double x, y, width, height, aspect, corner_radius, radius, degrees;
+
+  x = 1.0;
+  y = 1.0;
+  width = surface_width - 2.0;
+  height = surface_height - 2.0;
+  aspect = 1.0;                 // aspect ratio
+  corner_radius = height / 4.0; // and corner curvature radius
+
+  radius = corner_radius / aspect;
+  degrees = M_PI / 180.0;
+
+  cairo_arc (cr, x + width - radius, y + radius, radius, -90 * degrees,
+      0 * degrees);
+  cairo_arc (cr, x + width - radius, y + height - radius, radius, 0 * degrees,
+      90 * degrees);
+  cairo_arc (cr, x + radius, y + height - radius, radius, 90 * degrees,
+      180 * degrees);
+  cairo_arc (cr, x + radius, y + radius, radius, 180 * degrees, 270 * degrees);
+  cairo_close_path (cr);
+}
+
+
+static ClutterActor *
+progressbar_new (UserInterface * ui, ClutterActor ** fill)
+{
+  ClutterActor *bar;
+  ClutterContent *canvas;
+
+  // Static track, only redrawn by clutter when the bar changes size
+  canvas = clutter_canvas_new ();
+  g_signal_connect (canvas, "draw", G_CALLBACK (draw_progressbar_track), ui);
+  bar = clutter_actor_new ();
+  clutter_actor_set_content (bar, canvas);
+  g_object_unref (canvas);
+
+  // Pre-rendered fill on top of the track, progress only changes its clip
+  canvas = clutter_canvas_new ();
+  g_signal_connect (canvas, "draw", G_CALLBACK (draw_progressbar_fill), ui);
+  *fill = clutter_actor_new ();
+  clutter_actor_set_content (*fill, canvas);
+  g_object_unref (canvas);
+
+  clutter_actor_add_constraint (*fill,
+      clutter_bind_constraint_new (bar, CLUTTER_BIND_SIZE, 0));
+  clutter_actor_add_child (bar, *fill);
+
+  return bar;
+}
+
+static void
+progressbar_set_fill (ClutterActor * fill, gfloat position)
+{
+  gfloat width, height, clip_x, clip_y, clip_width, clip_height;
+
+  clutter_actor_get_size (clutter_actor_get_parent (fill), &width, &height);
+  position = CLAMP (position, 0.0f, 1.0f);
+  width = (gint) (width * position + 0.5f);
+
+  // Most ticks don't move the fill by a whole pixel. Setting the clip
+  // anyway would redraw the control box's offscreen copy for nothing
+  clutter_actor_get_clip (fill, &clip_x, &clip_y, &clip_width, &clip_height);
+  if (clutter_actor_has_clip (fill) && clip_width == width &&
+      clip_height == height)
+    return;
+
+  // Only an actor property changes, no rasterisation or texture upload
+  clutter_actor_set_clip (fill, 0, 0, width, height);
+}
+
+static void
+progressbar_set_size (ClutterActor * bar, ClutterActor * fill, gfloat width,
+    gfloat height)
+{
+  clutter_actor_set_size (bar, width, height);
+
+  // Canvases only redraw when their size actually changes
+  clutter_canvas_set_size (CLUTTER_CANVAS (clutter_actor_get_content (bar)),
+      width, height);
+  clutter_canvas_set_size (CLUTTER_CANVAS (clutter_actor_get_content (fill)),
+      width, height);
 }
 
 gboolean
@@ -1131,7 +1618,7 @@ rotate_video (UserInterface * ui)
     angle = 0;
   clutter_actor_set_rotation_angle (ui->texture, CLUTTER_Z_AXIS, angle);
 
-  size_change (CLUTTER_STAGE (ui->stage), NULL, 0, ui);
+  layout_queue (ui);
 
   return TRUE;
 }
@@ -1141,18 +1628,7 @@ size_change (ClutterStage * stage,
     const ClutterActorBox * allocation,
     ClutterAllocationFlags flags, UserInterface * ui)
 {
-  gfloat video_width, video_height;
-
-  ui->stage_width = clutter_actor_get_width (ui->stage);
-  ui->stage_height = clutter_actor_get_height (ui->stage);
-
-  new_video_size (ui, ui->stage_width, ui->stage_height, &video_width,
-      &video_height);
-  clutter_actor_set_size (CLUTTER_ACTOR (ui->texture), video_width,
-      video_height);
-
-  update_controls_size (ui);
-  progress_timing (ui);
+  layout_queue (ui);
 }
 
 static void
@@ -1166,8 +1642,8 @@ show_controls (UserInterface * ui, gboolean vis)
     if (!cursor)
       clutter_stage_show_cursor (CLUTTER_STAGE (ui->stage));
     if (ui->controls_timeout == -1) {
-      ui->controls_timeout = g_timeout_add_seconds (CTL_SHOW_SEC,
-          controls_timeout_cb, ui);
+      ui->controls_timeout = scheduler_add (ui->scheduler,
+          CTL_SHOW_SEC * G_TIME_SPAN_MILLISECOND, controls_timeout_cb, ui);
     }
   }
 
@@ -1180,11 +1656,14 @@ show_controls (UserInterface * ui, gboolean vis)
       clutter_actor_hide (ui->subtitle_toggle);
     }
 
-    update_controls_size (ui);
-    progress_update_seekbar (ui);
-    progress_update_text (ui);
+    // The position label may have changed width while hidden
+    ui->layout_controls_dirty = TRUE;
+    layout_queue (ui);
+    progress_update (ui);
+    progress_timeline_update (ui);
     clutter_stage_show_cursor (CLUTTER_STAGE (ui->stage));
 
+    clutter_actor_show (ui->control_box);
     clutter_actor_set_easing_mode (CLUTTER_ACTOR (ui->control_box),
         CLUTTER_EASE_OUT_QUINT);
     clutter_actor_set_easing_duration (CLUTTER_ACTOR (ui->control_box),
@@ -1192,13 +1671,15 @@ show_controls (UserInterface * ui, gboolean vis)
     clutter_actor_set_opacity (CLUTTER_ACTOR (ui->control_box), 0xff);
 
     if (ui->controls_timeout == -1) {
-      ui->controls_timeout = g_timeout_add_seconds (CTL_SHOW_SEC,
-          controls_timeout_cb, ui);
+      ui->controls_timeout = scheduler_add (ui->scheduler,
+          CTL_SHOW_SEC * G_TIME_SPAN_MILLISECOND, controls_timeout_cb, ui);
     }
   }
 
   else if (vis == FALSE && ui->controls_showing == TRUE) {
     ui->controls_showing = FALSE;
+    progress_timeline_update (ui);
+    preview_hide (ui);
 
     hide_cursor (ui, NULL, NULL);
 
@@ -1263,7 +1744,8 @@ toggle_playing (UserInterface * ui)
 static void
 update_controls_size (UserInterface * ui)
 {
-  gchar *font_name;
+  gchar font_name[FONT_NAME_SIZE];
+  gint font_size;
   gfloat ctl_width, ctl_height;
   gfloat icon_size;
   gfloat control_box_width, control_box_height;
@@ -1307,10 +1789,15 @@ update_controls_size (UserInterface * ui)
   clutter_box_layout_set_spacing (CLUTTER_BOX_LAYOUT (ui->info_box_layout),
       ctl_width * 0.04f);
 
-  font_name =
-      g_strdup_printf ("Clear Sans Bold %dpx",
-      (gint) (ctl_width * TITLE_RATIO));
-  clutter_text_set_font_name (CLUTTER_TEXT (ui->control_title), font_name);
+  // Only touch the font when the pixel size changes, as setting it drops
+  // the cached text layouts
+  font_size = (gint) (ctl_width * TITLE_RATIO);
+  if (font_size != ui->title_font_size) {
+    ui->title_font_size = font_size;
+    g_snprintf (font_name, sizeof (font_name), "Clear Sans Bold %dpx",
+        font_size);
+    clutter_text_set_font_name (CLUTTER_TEXT (ui->control_title), font_name);
+  }
 
   clutter_box_layout_set_spacing (CLUTTER_BOX_LAYOUT (ui->main_box_layout),
       ctl_height * 0.10f);
@@ -1319,24 +1806,28 @@ update_controls_size (UserInterface * ui)
       (ctl_width * MAIN_BOX_W - icon_size) * SEEK_WIDTH_RATIO - 4.0f;
   ui->seek_height = ctl_height * MAIN_BOX_H * SEEK_HEIGHT_RATIO - 4.0f;
 
-  clutter_actor_set_size (ui->control_seekbar,
+  progressbar_set_size (ui->control_seekbar, ui->seek_fill,
       ui->seek_width + 4.0f, ui->seek_height + 4.0f);
 
   clutter_box_layout_set_spacing (CLUTTER_BOX_LAYOUT (ui->pos_n_vol_layout),
       ctl_height * 0.16f);
 
-  progress_update_seekbar (ui);
+  progressbar_set_fill (ui->seek_fill, ui->playback_position);
 
-  font_name =
-      g_strdup_printf ("Clear Sans %dpx", (gint) (ctl_height * POS_RATIO));
-  clutter_text_set_font_name (CLUTTER_TEXT (ui->control_pos), font_name);
+  font_size = (gint) (ctl_height * POS_RATIO);
+  if (font_size != ui->pos_font_size) {
+    ui->pos_font_size = font_size;
+    g_snprintf (font_name, sizeof (font_name), "Clear Sans %dpx", font_size);
+    clutter_text_set_font_name (CLUTTER_TEXT (ui->control_pos), font_name);
+  }
 
   ui->volume_width =
       (ctl_width * MAIN_BOX_W - icon_size -
       clutter_actor_get_width (CLUTTER_ACTOR (ui->control_pos))) *
       VOLUME_WIDTH_RATIO;
   ui->volume_height = ctl_height * MAIN_BOX_H * VOLUME_HEIGHT_RATIO;
-  clutter_actor_set_size (ui->vol_int, ui->volume_width, ui->volume_height);
+  progressbar_set_size (ui->vol_int, ui->vol_int_fill, ui->volume_width,
+      ui->volume_height);
 
   icon_size = ctl_height * VOLUME_ICON_RATIO;
   clutter_actor_set_size (ui->volume_low, icon_size, icon_size);
@@ -1370,11 +1861,73 @@ update_volume (UserInterface * ui, gdouble volume)
     g_object_get (G_OBJECT (ui->engine->player), "volume", &volume, NULL);
 
   ui->volume = (float) volume;
-  clutter_content_invalidate (ui->vol_int_canvas);
+  progressbar_set_fill (ui->vol_int_fill, ui->volume);
 
   return TRUE;
 }
 
+static gboolean
+window_delete_cb (GtkWidget * widget, GdkEvent * event, UserInterface * ui)
+{
+  close_window (ui);
+
+  // A daemon keeps its window around, hidden
+  return ui->daemon;
+}
+
+static gboolean
+window_map_cb (GtkWidget * widget, GdkEvent * event, UserInterface * ui)
+{
+  ui->window_mapped = (event->type == GDK_MAP);
+  window_visibility_update (ui);
+
+  return FALSE;
+}
+
+static gboolean
+window_state_cb (GtkWidget * widget, GdkEventWindowState * event,
+    UserInterface * ui)
+{
+  ui->window_iconified =
+      (event->new_window_state & GDK_WINDOW_STATE_ICONIFIED) != 0;
+  window_visibility_update (ui);
+
+  return FALSE;
+}
+
+// Only non-compositing X window managers send these. Compositors render
+// every window offscreen and always report them unobscured, so on most
+// desktops a fully covered window keeps decoding video; only iconified,
+// unmapped and other workspace windows (hidden or unmapped by the window
+// manager) stop it there
+static gboolean
+window_visibility_cb (GtkWidget * widget, GdkEventVisibility * event,
+    UserInterface * ui)
+{
+  ui->window_obscured = (event->state == GDK_VISIBILITY_FULLY_OBSCURED);
+  window_visibility_update (ui);
+
+  return FALSE;
+}
+
+static void
+window_visibility_update (UserInterface * ui)
+{
+  gboolean visible;
+
+  // A hidden daemon still needs video to get the frame that maps it
+  visible = (ui->window_mapped && !ui->window_iconified &&
+      !ui->window_obscured) || (ui->daemon && ui->frame_pending);
+  if (visible == ui->window_visible)
+    return;
+
+  ui->window_visible = visible;
+
+  // Nobody sees the video or the controls, only keep the audio going
+  scheduler_set_suspended (ui->scheduler, !visible);
+  engine_set_video_enabled (ui->engine, visible);
+}
+
 /* -------------------- non-static functions --------------------- */
 
 void
@@ -1395,7 +1948,11 @@ interface_init (UserInterface * ui)
   ui->video_stream_toggle_png = NULL;
   ui->audio_stream_toggle_png = NULL;
 
-  ui->duration_str = NULL;
+  ui->duration_str[0] = '\0';
+  ui->position_str[0] = '\0';
+  ui->title_str[0] = '\0';
+  ui->title_font_size = -1;
+  ui->pos_font_size = -1;
 
   ui->stage = NULL;
   ui->texture = NULL;
@@ -1406,17 +1963,29 @@ interface_init (UserInterface * ui)
   ui->control_play_toggle = NULL;
 
   ui->control_seekbar = NULL;
+  ui->seek_fill = NULL;
   ui->control_pos = NULL;
 
+  ui->fullscreen_button = NULL;
+  ui->subtitle_toggle = NULL;
+  ui->video_stream_toggle = NULL;
+  ui->audio_stream_toggle = NULL;
+
   ui->volume_box = NULL;
   ui->volume_low = NULL;
   ui->volume_high = NULL;
   ui->vol_int = NULL;
+  ui->vol_int_fill = NULL;
   ui->vol_int_bg = NULL;
   ui->volume_point = NULL;
 
   ui->info_box = NULL;
   ui->main_box = NULL;
+  ui->seek_preview_actor = NULL;
+  ui->preview_position = GST_CLOCK_TIME_NONE;
+  ui->preview_x = 0;
+  ui->clip_in = GST_CLOCK_TIME_NONE;
+  ui->clip_out = GST_CLOCK_TIME_NONE;
 
   ui->main_box_layout = NULL;
   ui->info_box_layout = NULL;
@@ -1425,6 +1994,29 @@ interface_init (UserInterface * ui)
 
   ui->engine = NULL;
   ui->screensaver = NULL;
+  ui->scheduler = NULL;
+  ui->seek_preview = NULL;
+  ui->clip_export = NULL;
+  ui->profiler = NULL;
+  ui->stats_overlay = NULL;
+
+  ui->frame_pending = TRUE;
+  ui->warm_start = FALSE;
+  ui->open_time = g_get_monotonic_time ();
+
+  ui->window_mapped = TRUE;
+  ui->window_iconified = FALSE;
+  ui->window_obscured = FALSE;
+  ui->window_visible = TRUE;
+  ui->progress_timeline = NULL;
+
+  ui->layout_id = 0;
+  ui->layout_controls_dirty = TRUE;
+  ui->layout_subtitles = FALSE;
+  ui->layout_stage_width = -1;
+  ui->layout_stage_height = -1;
+  ui->layout_video_width = -1;
+  ui->layout_video_height = -1;
 
   ui->playback_position = 0.0;
 
@@ -1440,6 +2032,17 @@ interface_init (UserInterface * ui)
   ui->gradient_finish = gradient_finish;
 }
 
+void
+interface_expect_frame (UserInterface * ui)
+{
+  // Everything is already initialised when a request comes in
+  ui->open_time = g_get_monotonic_time ();
+  ui->frame_pending = TRUE;
+  ui->warm_start = TRUE;
+
+  window_visibility_update (ui);
+}
+
 gboolean
 interface_is_it_last (UserInterface * ui)
 {
@@ -1456,14 +2059,30 @@ interface_load_uri (UserInterface * ui, gchar * uri)
 {
   ui->fileuri = uri;
 
+  g_free (ui->filename);
   ui->filename = g_path_get_basename (ui->fileuri);
 
+  if (!CLUTTER_ACTOR_IS_VISIBLE (ui->texture))
+    clutter_actor_show (ui->texture);
+
+  if (ui->seek_preview != NULL) {
+    preview_hide (ui);
+    seek_preview_set_uri (ui->seek_preview, uri);
+  }
+
+  // Clip marks belong to the file they were set on
+  ui->clip_in = GST_CLOCK_TIME_NONE;
+  ui->clip_out = GST_CLOCK_TIME_NONE;
+
   if (ui->stage != NULL) {
     gtk_window_set_title (GTK_WINDOW (ui->window), ui->filename);
-    clutter_text_set_text (CLUTTER_TEXT (ui->control_title), ui->filename);
+    cut_long_filename (ui->filename, ui->title_length, ui->title_str,
+        sizeof (ui->title_str));
+    clutter_text_set_text (CLUTTER_TEXT (ui->control_title), ui->title_str);
   }
 
-  ui->duration_str = position_ns_to_str (ui, ui->engine->media_duration);
+  position_ns_to_str (ui->engine->media_duration, ui->duration_str,
+      sizeof (ui->duration_str));
   ui->media_width = ui->engine->media_width;
   ui->media_height = ui->engine->media_height;
   ui->windowed_width = ui->media_width;
@@ -1471,7 +2090,7 @@ interface_load_uri (UserInterface * ui, gchar * uri)
 
   clutter_actor_set_size (CLUTTER_ACTOR (ui->texture), ui->media_width,
       ui->media_height);
-  size_change (CLUTTER_STAGE (ui->stage), NULL, 0, ui);
+  layout_queue (ui);
 
   if (!ui->fullscreen) {
     ui->stage_width = ui->media_width;
@@ -1547,6 +2166,7 @@ interface_start (UserInterface * ui, gchar * uri)
   GtkSettings *gtk_settings;
   GdkScreen *screen;
 
+  timings_begin ("interface_start");
   g_print ("Loading ui!\n");
 
   // Init UserInterface structure variables
@@ -1585,7 +2205,7 @@ interface_start (UserInterface * ui, gchar * uri)
     }
 
   } else {
-    ui->filename = "";
+    ui->filename = g_strdup ("");
 
     ui->media_width = DEFAULT_WIDTH;
     ui->media_height = DEFAULT_HEIGHT;
@@ -1601,6 +2221,8 @@ interface_start (UserInterface * ui, gchar * uri)
   else
     gtk_window_set_title (GTK_WINDOW (ui->window), "snappy");
   g_signal_connect (ui->window, "destroy", G_CALLBACK (gtk_main_quit), NULL);
+  g_signal_connect (ui->window, "delete-event", G_CALLBACK (window_delete_cb),
+      ui);
   gtk_settings = gtk_settings_get_default ();
   g_object_set (G_OBJECT (gtk_settings), "gtk-application-prefer-dark-theme",
       TRUE, NULL);
@@ -1634,14 +2256,19 @@ interface_start (UserInterface * ui, gchar * uri)
   ui->penalty_box_active = FALSE;
   ui->duration_str_fwd_direction = TRUE;
   ui->controls_timeout = -1;
+  ui->scheduler = scheduler_new ();
+  if (ui->profile)
+    ui->profiler = profiler_new (ui->engine->player, ui->scheduler);
 
   ui->seek_width = ui->stage_width / SEEK_WIDTH_RATIO;
   ui->seek_height = ui->stage_height / SEEK_HEIGHT_RATIO;
 
-  ui->progress_id = -1;
+  ui->progress_second = -1;
+  ui->ticks = ui->tick_allocations = ui->allocating_ticks = 0;
   ui->title_length = TITLE_LENGTH;
   ui->media_duration = -1;
-  ui->duration_str = position_ns_to_str (ui, ui->engine->media_duration);
+  position_ns_to_str (ui->engine->media_duration, ui->duration_str,
+      sizeof (ui->duration_str));
 
   clutter_actor_set_size (CLUTTER_ACTOR (ui->stage), ui->stage_width,
       ui->stage_height);
@@ -1651,13 +2278,18 @@ interface_start (UserInterface * ui, gchar * uri)
     gtk_window_fullscreen (GTK_WINDOW (ui->window));
   }
   // Controls
+  timings_begin ("load_controls");
   load_controls (ui);
+  timings_end ("load_controls");
 
   // Add video texture and control UI to stage
   clutter_actor_add_child (ui->stage, ui->texture);
   if (!ui->hide) {
     clutter_actor_add_child (ui->stage, CLUTTER_ACTOR (ui->control_box));
   }
+  ui->stats_overlay = stats_overlay_new (ui->engine, ui->scheduler);
+  clutter_actor_add_child (ui->stage,
+      stats_overlay_get_actor (ui->stats_overlay));
   clutter_actor_add_constraint (ui->texture,
       clutter_align_constraint_new (ui->stage, CLUTTER_ALIGN_X_AXIS, 0.5));
   clutter_actor_add_constraint (ui->texture,
@@ -1665,6 +2297,20 @@ interface_start (UserInterface * ui, gchar * uri)
 
   clutter_actor_set_pivot_point (ui->texture, 0.5, 0.5);
 
+  // Hover previews over the seekbar, decoded away from the main pipeline
+  ui->seek_preview_actor = clutter_actor_new ();
+  clutter_actor_set_content_gravity (ui->seek_preview_actor,
+      CLUTTER_CONTENT_GRAVITY_RESIZE_ASPECT);
+  clutter_actor_hide (ui->seek_preview_actor);
+  clutter_actor_add_child (ui->stage, ui->seek_preview_actor);
+  // Nothing is ever shown blind, no pipeline is needed for it
+  if (!ui->blind) {
+    ui->seek_preview = seek_preview_new (SEEK_PREVIEW_SIZE,
+        (SeekPreviewFunc) preview_ready_cb, ui);
+    if (ui->fileuri)
+      seek_preview_set_uri (ui->seek_preview, ui->fileuri);
+  }
+
   clutter_actor_set_easing_mode (CLUTTER_ACTOR (ui->control_box),
       CLUTTER_EASE_OUT_QUINT);
   clutter_actor_set_easing_duration (CLUTTER_ACTOR (ui->control_box),
@@ -1677,14 +2323,30 @@ interface_start (UserInterface * ui, gchar * uri)
   g_signal_connect (CLUTTER_STAGE (ui->stage), "event", G_CALLBACK (event_cb),
       ui);
 
-  progress_timing (ui);
+  ui->progress_timeline = clutter_timeline_new (G_TIME_SPAN_MILLISECOND);
+  clutter_timeline_set_repeat_count (ui->progress_timeline, -1);
+  g_signal_connect (ui->progress_timeline, "new-frame",
+      G_CALLBACK (progress_new_frame_cb), ui);
+
+  gtk_widget_add_events (ui->window, GDK_VISIBILITY_NOTIFY_MASK);
+  g_signal_connect (ui->window, "map-event", G_CALLBACK (window_map_cb), ui);
+  g_signal_connect (ui->window, "unmap-event", G_CALLBACK (window_map_cb), ui);
+  g_signal_connect (ui->window, "window-state-event",
+      G_CALLBACK (window_state_cb), ui);
+  g_signal_connect (ui->window, "visibility-notify-event",
+      G_CALLBACK (window_visibility_cb), ui);
+  g_signal_connect (ui->engine->sink, "new-frame", G_CALLBACK (new_frame_cb),
+      ui);
 
-  ui->screensaver = screensaver_new (CLUTTER_STAGE (ui->stage));
+  ui->screensaver = screensaver_new (CLUTTER_STAGE (ui->stage),
+      ui->scheduler);
   screensaver_enable (ui->screensaver, FALSE);
 
-  g_timeout_add (G_TIME_SPAN_MILLISECOND, progress_update_text, ui);
-
-  if (!ui->blind) {
+  if (ui->daemon) {
+    /* Realize the stage and its GL context without mapping the window */
+    gtk_widget_show_all (ui->box);
+    gtk_widget_realize (ui->clutter_widget);
+  } else if (!ui->blind) {
     /* Show the window */
     gtk_widget_show_all (ui->window);
   }
@@ -1698,13 +2360,15 @@ interface_start (UserInterface * ui, gchar * uri)
       GDK_ACTION_COPY | GDK_ACTION_MOVE);
   g_signal_connect (G_OBJECT (ui->box), "drag_data_received",
       G_CALLBACK (interface_on_drop_cb), ui);
+
+  timings_end ("interface_start");
 }
 
 gboolean
 interface_update_controls (UserInterface * ui)
 {
-  progress_update_text (ui);
-  progress_update_seekbar (ui);
+  progress_update (ui);
+  progress_timeline_update (ui);
   update_volume (ui, -1);
 
   return TRUE;
@@ -29,8 +29,13 @@
 
 #include <gtk/gtk.h>
 
+#include "clip_export.h"
 #include "gst_engine.h"
+#include "profiler.h"
+#include "scheduler.h"
 #include "screensaver.h"
+#include "seek_preview.h"
+#include "stats_overlay.h"
 
 #define CTL_SHOW_SEC 3
 #define CTL_FADE_DURATION G_TIME_SPAN_MILLISECOND / 4
@@ -54,6 +59,10 @@
 #define VOLUME_HEIGHT_RATIO 0.05f
 
 #define TITLE_LENGTH 40
+#define TITLE_STR_SIZE (TITLE_LENGTH * 4 + 1)
+#define TIME_STR_SIZE 32
+#define POSITION_STR_SIZE (TIME_STR_SIZE * 2 + 8)
+#define FONT_NAME_SIZE 64
 
 #define SEC_IN_HOUR 3600
 #define SEC_IN_MIN 60
@@ -77,13 +86,26 @@ typedef struct _UserInterface UserInterface;
 struct _UserInterface
 {
   gboolean controls_showing, keep_showing_controls;
-  gboolean blind, fullscreen, hide, penalty_box_active, tags;
+  gboolean blind, fullscreen, hide, penalty_box_active;
+  gboolean daemon, frame_pending, warm_start, profile, wakeups;
   gboolean subtitles_available;
   gboolean duration_str_fwd_direction;
+  gboolean layout_controls_dirty, layout_subtitles;
+  gboolean window_mapped, window_iconified, window_obscured, window_visible;
 
-  gint title_length, controls_timeout, progress_id;
+  gint title_length, controls_timeout;
+  gint title_font_size, pos_font_size;
   guint media_width, media_height;
   gint64 media_duration;
+  gint64 progress_second;
+  gint64 ticks, tick_allocations, allocating_ticks;
+  gint64 open_time;
+  GstClockTime preview_position;
+  gfloat preview_x;
+  GstClockTime clip_in, clip_out;
+  guint layout_id;
+  gfloat layout_stage_width, layout_stage_height;
+  gfloat layout_video_width, layout_video_height;
   gfloat stage_width, stage_height;
   gfloat screen_width, screen_height;
   gfloat windowed_width, windowed_height;
@@ -99,7 +121,9 @@ struct _UserInterface
   gchar *subtitle_active_png, *subtitle_inactive_png;
   gchar *video_stream_toggle_png, *audio_stream_toggle_png;
   gchar *data_dir;
-  gchar *duration_str;
+  gchar duration_str[TIME_STR_SIZE];
+  gchar position_str[POSITION_STR_SIZE];
+  gchar title_str[TITLE_STR_SIZE];
 
   GList *uri_list;
 
@@ -112,28 +136,33 @@ struct _UserInterface
   ClutterActor *texture;
   ClutterActor *control_box;
   ClutterActor *control_bg, *control_title, *control_play_toggle;
-  ClutterActor *control_seekbar;
+  ClutterActor *control_seekbar, *seek_fill;
   ClutterActor *control_pos;
   ClutterActor *volume_box;
   ClutterActor *volume_low, *volume_high;
   ClutterActor *fullscreen_button;
   ClutterActor *subtitle_toggle;
   ClutterActor *video_stream_toggle, *audio_stream_toggle;
-  ClutterActor *vol_int, *vol_int_bg, *volume_point;
+  ClutterActor *vol_int, *vol_int_fill, *vol_int_bg, *volume_point;
   ClutterActor *info_box;
   ClutterActor *pos_n_vol_box;
   ClutterActor *main_box;
-
-  ClutterContent *seek_canvas;
-  ClutterContent *vol_int_canvas;
+  ClutterActor *seek_preview_actor;
 
   ClutterLayoutManager *main_box_layout;
   ClutterLayoutManager *info_box_layout;
   ClutterLayoutManager *pos_n_vol_layout;
   ClutterLayoutManager *middle_box_layout;
 
+  ClutterTimeline *progress_timeline;
+
   GstEngine *engine;
   ScreenSaver *screensaver;
+  Scheduler *scheduler;
+  SeekPreview *seek_preview;
+  ClipExport *clip_export;
+  Profiler *profiler;
+  StatsOverlay *stats_overlay;
 };
 
 static const GtkTargetEntry drop_target_table[] = {
@@ -143,6 +172,7 @@ static const GtkTargetEntry drop_target_table[] = {
 
 // Declaration of non-static functions
 void interface_init (UserInterface * ui);
+void interface_expect_frame (UserInterface * ui);
 gboolean interface_is_it_last (UserInterface * ui);
 gboolean interface_load_uri (UserInterface * ui, gchar * uri);
 void interface_on_drop_cb (GtkWidget * widget, GdkDragContext * context, gint x,
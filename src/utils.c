@@ -20,31 +20,85 @@
  * USA
  */
 
+#include <gmodule.h>
+
 #include "utils.h"
 
 
-gchar *
-cut_long_filename (gchar * filename, gint length)
+/* Copy at most length characters of filename into dest as valid UTF-8,
+ * replacing undecodable bytes, without allocating. */
+void
+cut_long_filename (const gchar * filename, gint length, gchar * dest,
+    gsize dest_size)
 {
-  gchar *ret;
-  gint c;
-  gchar short_filename[length];
+  const gchar *c, *next;
+  gsize bytes = 0;
+  gint chars;
 
-  for (c = 0; filename[c] != '\0'; c++);
+  g_return_if_fail (dest_size > 0);
 
-  if (c >= length) {
-    for (c = 0; c < length; c++) {
-      short_filename[c] = filename[c];
+  for (c = filename, chars = 0; *c != '\0' && chars < length; chars++) {
+    gunichar uc = g_utf8_get_char_validated (c, -1);
+
+    if (uc == (gunichar) - 1 || uc == (gunichar) - 2) {
+      if (bytes + 1 >= dest_size)
+        break;
+      dest[bytes++] = '?';
+      c++;
+    } else {
+      next = g_utf8_next_char (c);
+      if (bytes + (next - c) >= dest_size)
+        break;
+      memcpy (dest + bytes, c, next - c);
+      bytes += next - c;
+      c = next;
     }
-    short_filename[length] = '\0';
-    ret = g_filename_to_utf8 (short_filename, length, NULL, NULL, NULL);
-  } else {
-    ret = g_locale_to_utf8 (filename, -1, NULL, NULL, NULL);
   }
 
-  if (ret == NULL)
-    g_print ("no filename. really?\n");
-  return ret;
+  dest[bytes] = '\0';
+}
+
+/* Append ,"key":value to a JSON object being built */
+void
+append_json_double (GString * out, const gchar * key, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  /* Always a '.' decimal separator, whatever the locale */
+  g_string_append_printf (out, ",\"%s\":%s", key,
+      g_ascii_formatd (buf, sizeof (buf), "%.3f", value));
+}
+
+/* Append str as a quoted, escaped JSON string */
+void
+append_json_string (GString * out, const gchar * str)
+{
+  const gchar *p;
+
+  g_string_append_c (out, '"');
+  for (p = str; *p != '\0'; p++) {
+    switch (*p) {
+      case '"':
+        g_string_append (out, "\\\"");
+        break;
+      case '\\':
+        g_string_append (out, "\\\\");
+        break;
+      case '\n':
+        g_string_append (out, "\\n");
+        break;
+      case '\t':
+        g_string_append (out, "\\t");
+        break;
+      default:
+        if ((guchar) * p < 0x20)
+          g_string_append_printf (out, "\\u%04x", (guchar) * p);
+        else
+          g_string_append_c (out, *p);
+        break;
+    }
+  }
+  g_string_append_c (out, '"');
 }
 
 gchar *
@@ -90,6 +144,39 @@ clean_brackets_in_uri (gchar * uri)
   return clean_uri;
 }
 
+/* Parse "[[hh:]mm:]ss[.fff]" into nanoseconds */
+gboolean
+parse_time_str (const gchar * str, GstClockTime * time)
+{
+  gchar **fields;
+  gchar *end;
+  gdouble value, seconds = 0;
+  guint n_fields, i;
+
+  fields = g_strsplit (str, ":", 0);
+  n_fields = g_strv_length (fields);
+
+  if (n_fields == 0 || n_fields > 3) {
+    g_strfreev (fields);
+    return FALSE;
+  }
+
+  for (i = 0; i < n_fields; i++) {
+    value = g_ascii_strtod (fields[i], &end);
+    if (end == fields[i] || *end != '\0' || value < 0 ||
+        (i < n_fields - 1 && value != (guint) value)) {
+      g_strfreev (fields);
+      return FALSE;
+    }
+    seconds = seconds * 60 + value;
+  }
+  g_strfreev (fields);
+
+  *time = (GstClockTime) (seconds * GST_SECOND);
+
+  return TRUE;
+}
+
 gchar *
 strip_filename_extension (gchar * filename)
 {
@@ -110,3 +197,83 @@ strip_filename_extension (gchar * filename)
 
   return retstr;
 }
+
+/* Heap allocations made so far by the calling thread, or -1 unless
+ * tools/alloc-counter.so was preloaded to count them */
+gint64
+thread_allocations (void)
+{
+  static gulong (*counter_get) (void) = NULL;
+  static gsize looked_up = 0;
+  GModule *self;
+
+  if (g_once_init_enter (&looked_up)) {
+    self = g_module_open (NULL, 0);
+    if (self != NULL) {
+      if (!g_module_symbol (self, "alloc_counter_get",
+              (gpointer *) & counter_get))
+        counter_get = NULL;
+      g_module_close (self);
+    }
+    g_once_init_leave (&looked_up, 1);
+  }
+
+  return counter_get != NULL ? (gint64) counter_get () : -1;
+}
+
+typedef struct
+{
+  WatchElementFunc func;
+  gpointer data;
+} ElementWatch;
+
+static void watch_element (GstElement * element, ElementWatch * watch);
+
+static void
+watch_added_cb (GstBin * bin, GstElement * element, ElementWatch * watch)
+{
+  watch_element (element, watch);
+}
+
+static void
+watch_child (const GValue * item, ElementWatch * watch)
+{
+  watch_element (g_value_get_object (item), watch);
+}
+
+static void
+watch_element (GstElement * element, ElementWatch * watch)
+{
+  GstIterator *it;
+
+  // Bins are watched for the elements they create, and may be re-added
+  if (GST_IS_BIN (element)) {
+    g_signal_handlers_disconnect_by_func (element, watch_added_cb, watch);
+    g_signal_connect (element, "element-added", G_CALLBACK (watch_added_cb),
+        watch);
+
+    it = gst_bin_iterate_elements (GST_BIN (element));
+    gst_iterator_foreach (it, (GstIteratorForeachFunction) watch_child,
+        watch);
+    gst_iterator_free (it);
+  }
+
+  watch->func (element, watch->data);
+}
+
+/* Call func on element and, if it is a bin, on every element inside it,
+ * now and whenever one is added, from whichever thread adds it. Bins are
+ * passed to func too, after their children. The watch lasts as long as
+ * element does. */
+void
+watch_elements (GstElement * element, WatchElementFunc func, gpointer data)
+{
+  ElementWatch *watch;
+
+  watch = g_new (ElementWatch, 1);
+  watch->func = func;
+  watch->data = data;
+  g_object_weak_ref (G_OBJECT (element), (GWeakNotify) g_free, watch);
+
+  watch_element (element, watch);
+}
@@ -30,10 +30,19 @@
 
 G_BEGIN_DECLS
 
-gchar * cut_long_filename (gchar * filename, gint length);
+typedef void (*WatchElementFunc) (GstElement * element, gpointer data);
+
+void append_json_double (GString * out, const gchar * key, gdouble value);
+void append_json_string (GString * out, const gchar * str);
+void cut_long_filename (const gchar * filename, gint length, gchar * dest,
+    gsize dest_size);
 gchar * clean_uri (gchar * input_arg);
 gchar * clean_brackets_in_uri (gchar * uri);
+gboolean parse_time_str (const gchar * str, GstClockTime * time);
 gchar * strip_filename_extension (gchar * filename);
+gint64 thread_allocations (void);
+void watch_elements (GstElement * element, WatchElementFunc func,
+    gpointer data);
 
 G_END_DECLS
 #endif /* __UTILS_H__ */
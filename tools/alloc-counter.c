@@ -0,0 +1,96 @@
+/*
+ * snappy - 1.0
+ *
+ * Copyright (C) 2011-2014 Collabora Ltd.
+ * Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Counts the heap allocations made by each thread, for soak runs. Preload
+ * it into snappy and the interface reports how many of them its ticks
+ * made when it closes (see tools/alloc-soak.sh). Needs glibc, whose
+ * allocator is called straight through its __libc_ entry points. */
+
+#include <stddef.h>
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+/* Initial-exec, so the counter never needs allocating itself */
+static __thread unsigned long allocations
+    __attribute__ ((tls_model ("initial-exec")));
+
+unsigned long
+alloc_counter_get (void)
+{
+  return allocations;
+}
+
+void *
+malloc (size_t size)
+{
+  allocations++;
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+  allocations++;
+  return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  allocations++;
+  return __libc_realloc (ptr, size);
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+  allocations++;
+  return __libc_memalign (alignment, size);
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+  allocations++;
+  return __libc_memalign (alignment, size);
+}
+
+int
+posix_memalign (void **ptr, size_t alignment, size_t size)
+{
+  void *mem;
+
+  if (alignment % sizeof (void *) != 0 ||
+      (alignment & (alignment - 1)) != 0)
+    return 22;                  /* EINVAL */
+
+  allocations++;
+  mem = __libc_memalign (alignment, size);
+  if (mem == NULL)
+    return 12;                  /* ENOMEM */
+
+  *ptr = mem;
+  return 0;
+}
@@ -0,0 +1,63 @@
+#!/bin/sh
+# Play a file in a loop with the controls kept on screen, so the progress
+# bar and position label tick on every frame, then report how many heap
+# allocations those ticks made.
+#
+# The counter is tools/alloc-counter.so, preloaded into snappy, which only
+# counts the ticks' own thread while they run. The first ticks format the
+# duration and lay the label out, a steady state allocating nothing shows
+# as a number of allocating ticks that stops growing with the length of the
+# run. Needs a display, glibc and xdotool.
+
+seconds=600
+
+usage() {
+    echo "Usage: $0 [-s seconds] <snappy binary> <alloc-counter.so>" \
+        "<media file>"
+    exit 1
+}
+
+while getopts s: opt; do
+    case $opt in
+        s) seconds=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift `expr $OPTIND - 1`
+
+test $# -eq 3 || usage
+snappy=$1
+counter=$2
+media=$3
+test -x "$snappy" || { echo "$snappy is not executable"; exit 1; }
+test -f "$counter" || { echo "$counter is not a file"; exit 1; }
+test -f "$media" || { echo "$media is not a file"; exit 1; }
+which xdotool > /dev/null 2>&1 || { echo "xdotool is needed"; exit 1; }
+
+case $counter in
+    /*) ;;
+    *) counter="`pwd`/$counter" ;;
+esac
+
+output=`mktemp`
+pid=
+trap 'kill $pid 2> /dev/null; rm -f "$output"' EXIT
+
+LD_PRELOAD="$counter" "$snappy" --secret --loop --hide-controls "$media" \
+    > "$output" 2> /dev/null &
+pid=$!
+
+window=`timeout 30 xdotool search --sync --onlyvisible --pid $pid | head -n 1`
+test -n "$window" || { echo "snappy did not show a window"; exit 1; }
+
+# "c" shows the controls and keeps them up until it is pressed again
+xdotool windowactivate --sync $window key c
+sleep $seconds
+xdotool windowactivate --sync $window key q
+wait $pid
+pid=
+
+grep "^Progress ticks:" "$output" || {
+    echo "No ticks counted, was the counter preloaded?"
+    exit 1
+}
@@ -0,0 +1,124 @@
+#!/bin/sh
+# Start snappy on a file and time MPRIS calls over the session bus, idle and
+# while other clients keep asking it to open the file again, then report
+# percentiles of each call's round-trip.
+#
+# Every call spawns gdbus, so times include its start-up. Peer.Ping is
+# answered by GDBus itself, off the main loop, and gives that baseline;
+# anything above it is time spent queued behind snappy's main loop. Needs a
+# display, a session bus and GNU date.
+
+runs=100
+load=4
+
+bus_name=org.mpris.MediaPlayer2.snappy
+object=/org/mpris/MediaPlayer2
+player=org.mpris.MediaPlayer2.Player
+
+usage() {
+    echo "Usage: $0 [-n runs] [-l load clients] <snappy binary> <media file>"
+    exit 1
+}
+
+while getopts n:l: opt; do
+    case $opt in
+        n) runs=$OPTARG ;;
+        l) load=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift `expr $OPTIND - 1`
+
+test $# -eq 2 || usage
+snappy=$1
+media=$2
+test -x "$snappy" || { echo "$snappy is not executable"; exit 1; }
+test -f "$media" || { echo "$media is not a file"; exit 1; }
+which gdbus > /dev/null 2>&1 || { echo "gdbus is needed"; exit 1; }
+
+case $media in
+    /*) uri="file://$media" ;;
+    *) uri="file://`pwd`/$media" ;;
+esac
+
+results=`mktemp`
+pids=
+trap 'kill $pids 2> /dev/null; rm -f "$results"' EXIT
+
+now() {
+    date +%s%N
+}
+
+# Appends "<mode> <call> <ms>" for one gdbus call on snappy
+call() {
+    mode=$1
+    name=$2
+    shift 2
+    start=`now`
+    gdbus call --session --dest $bus_name --object-path $object \
+        --method "$@" > /dev/null 2>&1 || return
+    echo "$mode $name `now` $start" | \
+        awk '{ printf "%s %s %.3f\n", $1, $2, ($3 - $4) / 1000000 }' \
+        >> "$results"
+}
+
+measure() {
+    i=0
+    while test $i -lt $runs; do
+        call $1 Ping org.freedesktop.DBus.Peer.Ping
+        call $1 Position org.freedesktop.DBus.Properties.Get \
+            $player Position
+        call $1 OpenUri $player.OpenUri "$uri"
+        i=`expr $i + 1`
+    done
+}
+
+report() {
+    test -n "`grep "^$1 " "$results"`" || return
+
+    printf "\n%s, %s runs\n" "$2" $runs
+    printf "  %-20s %9s %9s %9s %9s\n" "(ms)" p50 p90 p99 max
+    for name in Ping Position OpenUri; do
+        awk -v mode=$1 -v name=$name '$1 == mode && $2 == name { print $3 }' \
+            "$results" | sort -n | awk -v name=$name '
+            { v[NR] = $1 }
+            function p(f,  i) {
+                i = int(f * NR + 0.999999)
+                return v[i < 1 ? 1 : i]
+            }
+            END { if (NR) printf "  %-20s %9.2f %9.2f %9.2f %9.2f\n", name,
+                p(0.5), p(0.9), p(0.99), v[NR] }'
+    done
+}
+
+"$snappy" --secret "$media" > /dev/null 2>&1 &
+pids=$!
+
+# Wait for snappy to own its name on the bus
+i=0
+until gdbus call --session --dest org.freedesktop.DBus \
+        --object-path /org/freedesktop/DBus \
+        --method org.freedesktop.DBus.NameHasOwner $bus_name 2> /dev/null | \
+        grep -q true; do
+    i=`expr $i + 1`
+    test $i -lt 100 || { echo "snappy did not show up on the bus"; exit 1; }
+    sleep 0.1
+done
+
+measure idle
+
+# Clients reopening the file keep the discoverer and the pipeline busy
+i=0
+while test $i -lt $load; do
+    while true; do
+        gdbus call --session --dest $bus_name --object-path $object \
+            --method $player.OpenUri "$uri" > /dev/null 2>&1
+    done &
+    pids="$pids $!"
+    i=`expr $i + 1`
+done
+
+measure loaded
+
+report idle "Idle"
+report loaded "Under load, $load clients opening"
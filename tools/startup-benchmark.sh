@@ -0,0 +1,97 @@
+#!/bin/sh
+# Start snappy on a file again and again, until its first painted frame, and
+# report percentiles of each step of the --timings startup timeline.
+#
+# Cold runs drop the page cache before each start, which needs root (or
+# vmtouch, to evict at least the media file and the snappy binary). Warm
+# runs start with everything already cached. Needs a display.
+
+runs=10
+
+usage() {
+    echo "Usage: $0 [-n runs] <snappy binary> <media file>"
+    exit 1
+}
+
+while getopts n: opt; do
+    case $opt in
+        n) runs=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift `expr $OPTIND - 1`
+
+test $# -eq 2 || usage
+snappy=$1
+media=$2
+test -x "$snappy" || { echo "$snappy is not executable"; exit 1; }
+test -f "$media" || { echo "$media is not a file"; exit 1; }
+
+results=`mktemp`
+trap 'rm -f "$results"' EXIT
+
+drop_caches() {
+    if test -w /proc/sys/vm/drop_caches; then
+        sync && echo 3 > /proc/sys/vm/drop_caches
+    elif which vmtouch > /dev/null 2>&1; then
+        vmtouch -qe "$media" "$snappy"
+    else
+        return 1
+    fi
+}
+
+# Appends "<mode> <step> <ms>" lines: the duration of spans, the time
+# since main() of marks
+run() {
+    timeout 60 "$snappy" --secret --timings --timings-exit "$media" \
+        2> /dev/null | awk -v mode=$1 '
+        /^Startup timeline/ { timeline = 1; next }
+        !timeline { next }
+        # Rows start with a time, anything else is printed after it ends.
+        # Read on rather than exit, snappy would die of SIGPIPE
+        $1 !~ /^[0-9.]+$/ { timeline = 0; next }
+        NF == 3 && $2 != "-" { print mode, $3, $2 }
+        NF == 2 { print mode, $2, $1 }' >> "$results"
+}
+
+report() {
+    test -n "`grep "^$1 " "$results"`" || return
+
+    printf "\n%s start, %s runs\n" $1 $runs
+    printf "  %-20s %9s %9s %9s %9s\n" "(ms)" p50 p90 p99 max
+    # Steps in timeline order
+    for step in `awk -v mode=$1 '$1 == mode && !seen[$2]++ { print $2 }' \
+            "$results"`; do
+        awk -v mode=$1 -v step=$step '$1 == mode && $2 == step { print $3 }' \
+            "$results" | sort -n | awk -v step=$step '
+            { v[NR] = $1 }
+            function p(f,  i) {
+                i = int(f * NR + 0.999999)
+                return v[i < 1 ? 1 : i]
+            }
+            END { printf "  %-20s %9.2f %9.2f %9.2f %9.2f\n", step,
+                p(0.5), p(0.9), p(0.99), v[NR] }'
+    done
+}
+
+if drop_caches; then
+    i=0
+    while test $i -lt $runs; do
+        drop_caches
+        run cold
+        i=`expr $i + 1`
+    done
+else
+    echo "Skipping cold starts: dropping caches needs root or vmtouch"
+fi
+
+# One unmeasured start to warm the caches up
+run warmup
+i=0
+while test $i -lt $runs; do
+    run warm
+    i=`expr $i + 1`
+done
+
+report cold
+report warm